@@ -1,12 +1,16 @@
 /*
  * @file ms561101ba.c
  * driver for the MS5611-01BA03 Barometric Pressure Sensor connected via I2C
+ * or SPI
  *
  * write by Sarlor, 01/19/2017
  *  */
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
+#ifdef CONFIG_SPI_MASTER
+#include <linux/spi/spi.h>
+#endif
 #include <linux/input.h>
 #include <linux/workqueue.h>
 #include <linux/mutex.h>
@@ -16,11 +20,42 @@
 #include <linux/delay.h>
 #include <linux/kernel.h>
 #include <linux/uaccess.h>
+#include <linux/seqlock.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
 #endif
+#if (defined(CONFIG_IIO_SW_RING) || defined(CONFIG_IIO_SW_RING_MODULE)) && \
+	defined(CONFIG_IIO_TRIGGER)
+#define MS5611_IIO
+/* Staging IIO, see the Makefile for the include path */
+#include "iio.h"
+#include "sysfs.h"
+#include "buffer.h"
+#include "ring_sw.h"
+#include "trigger.h"
+#include "trigger_consumer.h"
+#endif
+#include "ms561101ba.h"
 
-#define MS5611_ADDRESS 		 	0X77 	/* Slave Address */
+#define CREATE_TRACE_POINTS
+#include "ms561101ba_trace.h"
 
 #define CMD_ADC_READ			0x00	/* ADC Read 	 */
 #define CMD_RST     	 		0x1E	/* Reset 	 */
@@ -29,6 +64,32 @@
 #define CALI_DATA_LEN			8	/* Length of PROM */
 #define SENSOR_NAME			"ms561101ba"
 
+#define MS5611_MODE_ON_DEMAND		0	/* Convert when a reader asks */
+#define MS5611_MODE_CONTINUOUS		1	/* Convert in background work */
+#define MS5611_DEFAULT_PERIOD_USEC	20000	/* Continuous sampling period */
+#define MS5611_CYCLE_TIMEOUT_MSEC	100	/* On-demand reader gives up */
+#define MS5611_RING_SIZE		1024	/* Records, power of two */
+#define MS5611_BATCH_MAX		65536	/* Samples per batch ioctl */
+#define MS5611_TEMP_DECIMATION_MAX	1000	/* D1 conversions per D2 */
+
+#define MS5611_OSR_MANUAL		0	/* OSR set through sysfs */
+#define MS5611_OSR_RATE			1	/* Highest OSR fitting period */
+#define MS5611_OSR_NOISE		2	/* Lowest OSR for noise */
+#define MS5611_BUS_OVERHEAD_USEC	300	/* Bus time per cycle */
+#define MS5611_NOISE_SHIFT		4	/* Noise EWMA, 16 samples */
+#define MS5611_NOISE_SETTLE		32	/* Samples between switches */
+#define MS5611_BUS_SHIFT		4	/* Bus time EWMA, 16 samples */
+#define MS5611_MERGE_SIZE		4096	/* Merged records, 2^n */
+#define MS5611_WINDOW_NSEC		NSEC_PER_SEC	/* Rate, load window */
+#define MS5611_CMD_RETRIES		1	/* Resends of a convert */
+#define MS5611_HIST_SIZE		32	/* log2 ns buckets, up to 2 s */
+
+/* Acquisition state machine, see ms5611_step() */
+#define MS5611_STATE_IDLE		0	/* No cycle in flight */
+#define MS5611_STATE_START		1	/* Cycle requested */
+#define MS5611_STATE_CONV_PRESSURE	2	/* D1 conversion running */
+#define MS5611_STATE_CONV_TEMP		3	/* D2 conversion running */
+
 #define MS5611_INIT_OSR(_cmd, _conv_usec, _rate)		\
 		{ .cmd = _cmd, .conv_usec = _conv_usec, .rate = _rate  }
 
@@ -42,18 +103,186 @@ struct ms5611_osr {
 	unsigned short rate;		/* The frequency of conversion 	     */
 };
 
+/* Temperature independent terms of the compensation */
+struct ms5611_coeffs {
+	s64 sens;			/* C1 << 15 */
+	s64 off;			/* C2 << 16 */
+	s64 tcs;			/* C3 	    */
+	s64 tco;			/* C4 	    */
+	s64 tref;			/* C5 << 8  */
+	s64 tempsens;			/* C6 	    */
+};
+
+/*
+ * Sensors on one I2C adapter or SPI master share an ordered workqueue,
+ * so their steps take turns on the bus: while one sensor converts the
+ * others read or start conversions, and sensors on different adapters
+ * run in parallel. The load only counts the transfers of this driver
+ * and, like the rest of the structure, is only touched from the
+ * workqueue.
+ *  */
+struct ms5611_bus {
+	struct list_head list;		/* On ms5611_buses */
+	u32 nr;				/* Sensor id >> 8 */
+	unsigned int users;
+	char name[16];			/* Workqueue name, must outlive it */
+	struct workqueue_struct *wq;
+	ktime_t window_start;
+	s64 window_busy_nsec;
+	unsigned int load;		/* Permille of the last window */
+};
+
+struct ms5611_data;
+
+/*
+ * Bus access. Every exchange with the sensor is a command byte, optionally
+ * followed by reading 'len' bytes. 'read_command' also sends the command
+ * @next after the read, in the same bus transaction, see
+ * ms5611_read_adc_start(). Returning negative errno else zero on success.
+ *  */
+struct ms5611_transport {
+	u16 bustype;			/* For the input device */
+	int (*command)(struct ms5611_data *data, u8 cmd);
+	int (*read)(struct ms5611_data *data, u8 cmd, u8 *buf, int len);
+	int (*read_command)(struct ms5611_data *data, u8 cmd, u8 *buf,
+			int len, u8 next);
+};
+
 /* Each client has this additional data */
 struct ms5611_data {
 	u16 calibration[CALI_DATA_LEN];	/* Calivbration data from PROM */
-	u32 raw_pressure;
+	struct ms5611_coeffs coeffs;	/* Derived from calibration */
+	u32 raw_pressure;		/* Latest sample, under cache_lock */
 	u32 raw_temperature;
+	ktime_t timestamp;		/* Midpoint of its D1 conversion */
+	seqlock_t cache_lock;
 	const struct ms5611_osr *temp_osr;
 	const struct ms5611_osr *pressure_osr;
-	struct i2c_client *ms5611_client;
+	struct device *dev;		/* The I2C client or SPI device */
+	const struct ms5611_transport *tf;
+	u32 sensor_id;			/* See struct ms5611_merged_record */
 	struct input_dev *input;
+	struct mutex lock;		/* Serialize bus access and OSR */
+	unsigned int mode;
+	unsigned int period_usec;
+
+	/* Acquisition state machine */
+	spinlock_t state_lock;
+	unsigned int state;
+	int stopping;
+	struct hrtimer timer;		/* Conversion and period deadlines */
+	struct work_struct step;	/* Bus transaction of each state */
+	struct workqueue_struct *wq;	/* That of the bus */
+	ktime_t cycle_start;
+	ktime_t d1_mid;			/* Midpoint of the D1 conversion */
+	u32 pending_pressure;		/* D1 waiting for its D2 */
+
+	/* Bus pipelining, see ms5611_read_adc_start() */
+	int can_pipeline;		/* The bus can do 'read_command' */
+	int pipelined;			/* ADC read and next convert folded */
+	int chain_burst;		/* Chained cycle was taken from burst */
+	s64 bus_nsec;			/* Bus time of the sample in flight */
+	s64 bus_last_nsec;		/* Bus time of the latest sample */
+	s64 bus_avg_nsec;
+	s64 bus_max_nsec;
+
+	/* Counters and histograms, see ms5611_debugfs_init() */
+	ktime_t bus_end;		/* End of the latest transaction */
+	atomic64_t conversions;		/* Convert commands sent */
+	atomic64_t bus_errors;		/* Failed transactions */
+	atomic64_t retries;		/* Convert commands sent again */
+	atomic64_t overruns;		/* Records lost by stream readers */
+	atomic64_t dropped;		/* Cycles that ended in an error */
+	u64 bus_hist[MS5611_HIST_SIZE];	/* Transactions, by duration */
+	u64 sample_hist[MS5611_HIST_SIZE]; /* D1 start to publish */
+	struct dentry *debugfs;
+
+	/* Multi-sensor scheduling, see struct ms5611_bus */
+	struct ms5611_bus *bus;
+	struct list_head sensors;	/* On ms5611_merge.sensors */
+	s64 merge_bound;		/* Start of the cycle in flight or 0 */
+	ktime_t window_start;
+	s64 window_busy_nsec;
+	unsigned int window_samples;
+	unsigned int rate_mhz;		/* Samples per 1000 s, last window */
+	unsigned int load;		/* Permille bus time, last window */
+
+	/* Temperature decimation, see ms5611_temp_due() */
+	unsigned int temp_decimation;	/* Samples per D2 conversion */
+	unsigned int temp_max_age_usec;	/* Refresh older D2, 0 never */
+	u32 cached_temp;		/* Latest D2 */
+	ktime_t temp_timestamp;		/* When cached_temp was converted */
+	unsigned int temp_uses;		/* Samples that used cached_temp */
+	int temp_valid;
+
+	/* Adaptive oversampling, see ms5611_adapt_osr() */
+	unsigned int osr_mode;
+	unsigned int target_noise;	/* RMS noise, 0.001 mbar */
+	s32 last_pressure;
+	s64 noise_ewma;			/* Mean square of diffs, << 8 */
+	unsigned int noise_samples;	/* Samples at the current OSR */
+	unsigned long samples;		/* Published samples, cache_lock */
+	unsigned long cycles;		/* Finished cycles, good or bad */
+	unsigned int burst;		/* Cycles to run back to back */
+	int error;			/* Status of the last cycle */
+	wait_queue_head_t wait;
+
+	/* Sample stream, see ms5611_fops */
+	void *ring_area;		/* Header page and slots, mmap()ed */
+	struct ms5611_ring_header *ring_hdr;
+	struct ms5611_record *ring;
+	unsigned long ring_head;	/* Records ever written */
+	struct miscdevice miscdev;
+	char name[20];
+	struct kref kref;		/* Held by probe and open files */
+#ifdef MS5611_IIO
+	struct iio_dev *indio_dev;
+	struct iio_trigger *iio_trig;	/* Fires on every published sample */
+	unsigned int iio_holds;		/* See ms5611_iio_hold() */
+	unsigned int iio_mode;		/* Mode before the first hold */
+#endif
+	u8 spi_buf[8] ____cacheline_aligned;	/* DMA safe, see ms5611_spi_* */
+};
+
+/* Each open file of the sample stream has its own read position */
+struct ms5611_reader {
+	struct ms5611_data *data;
+	struct mutex lock;
+	unsigned long tail;		/* Next record to read */
+	unsigned int watermark;
+	size_t record_size;		/* Of the format read() returns */
+	u64 overruns;
+};
+
+/*
+ * Records of all sensors merged in timestamp order, see
+ * ms5611_merge_push(). Slots [stable, head) are still being sorted and
+ * not visible to readers.
+ *  */
+struct ms5611_merge {
+	spinlock_t lock;
+	struct list_head sensors;
+	struct ms5611_merged_record *ring;
+	unsigned long head;		/* Records ever inserted */
+	unsigned long stable;		/* Records released to readers */
+	wait_queue_head_t wait;
+	struct miscdevice miscdev;
+};
+
+/* Each open file of the merged stream */
+struct ms5611_merge_reader {
 	struct mutex lock;
+	unsigned long tail;
+	size_t record_size;		/* Of the format read() returns */
+	u64 overruns;
 };
 
+static LIST_HEAD(ms5611_buses);
+static DEFINE_MUTEX(ms5611_bus_lock);
+static struct ms5611_merge ms5611_merge;
+
+static void ms5611_iio_notify(struct ms5611_data *data);
+
 /* This OSR array is for pressure. */
 static const struct ms5611_osr ms5611_avail_pressure_osr[] = {
 	MS5611_INIT_OSR(0x40, 600,  256),
@@ -104,9 +333,222 @@ static int ms5611_prom_is_valid(u16 *prom, size_t len)
 	return crc_orig != 0x0000 && crc == crc_orig;
 }
 
+/*
+ * Precompute the temperature independent terms of the compensation.
+ * @k: Stores the coefficient block.
+ * @c: Calibration data from PROM, c[1] to c[6] are C1 to C6.
+ *  */
+static void ms5611_load_coeffs(struct ms5611_coeffs *k, const u16 *c)
+{
+	k->sens = (s64)c[1] << 15;
+	k->off = (s64)c[2] << 16;
+	k->tcs = c[3];
+	k->tco = c[4];
+	k->tref = (s64)c[5] << 8;
+	k->tempsens = c[6];
+}
+
+/*
+ * Compensate a raw sample with the second order algorithm of the datasheet.
+ * @k: Coefficient block of the device.
+ * @d1: Raw pressure.
+ * @d2: Raw temperature.
+ * @pressure: Stores the pressure in 0.01 mbar.
+ * @temperature: Stores the temperature in 0.01 degC.
+ *
+ * The products need 64 bits, 'd1 * sens' alone is up to 56 bits wide.
+ *  */
+static void ms5611_compensate(const struct ms5611_coeffs *k, u32 d1, u32 d2,
+		s32 *pressure, s32 *temperature)
+{
+	s64 dt, t, off, sens;
+
+	dt = (s64)d2 - k->tref;
+	t = 2000 + ((dt * k->tempsens) >> 23);
+	off = k->off + ((dt * k->tco) >> 7);
+	sens = k->sens + ((dt * k->tcs) >> 8);
+
+	if (t < 2000) {
+		s64 t2, off2, sens2, tmp;
+
+		t2 = (dt * dt) >> 31;
+		tmp = (t - 2000) * (t - 2000);
+		off2 = (5 * tmp) >> 1;
+		sens2 = (5 * tmp) >> 2;
+
+		if (t < -1500) {
+			tmp = (t + 1500) * (t + 1500);
+			off2 += 7 * tmp;
+			sens2 += (11 * tmp) >> 1;
+		}
+
+		t -= t2;
+		off -= off2;
+		sens -= sens2;
+	}
+
+	*temperature = (s32)t;
+	*pressure = (s32)((((d1 * sens) >> 21) - off) >> 15);
+}
+
+/*
+ * Check ms5611_compensate() against known samples at module load. The
+ * first vector is the example of the datasheet, the others exercise the
+ * second order branches below 20 degC and below -15 degC.
+ *  */
+static int __init ms5611_compensate_selftest(void)
+{
+	static const u16 prom[CALI_DATA_LEN] __initconst = {
+		0, 40127, 36924, 23317, 23282, 33464, 28312, 0
+	};
+	static const struct {
+		u32 d1, d2;
+		s32 pressure, temperature;
+	} vectors[] __initconst = {
+		{ 9085466, 8569150, 100009,  2007 },
+		{ 9500000, 9200000, 112383,  4137 },
+		{ 8500000, 8000000,  85265,   -62 },
+		{ 8000000, 7400000,  72173, -2571 },
+	};
+	struct ms5611_coeffs k;
+	s32 p, t;
+	int i;
+
+	ms5611_load_coeffs(&k, prom);
+	for (i = 0; i < ARRAY_SIZE(vectors); i++) {
+		ms5611_compensate(&k, vectors[i].d1, vectors[i].d2, &p, &t);
+		if (p != vectors[i].pressure || t != vectors[i].temperature) {
+			printk(KERN_ERR "ms5611: compensation self-test %d "
+					"failed: %d %d\n", i, p, t);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * I2C transport. A read is a write of the command and a read with a
+ * repeated start, as the SMBus block read does it.
+ *  */
+static int ms5611_i2c_command(struct ms5611_data *data, u8 cmd)
+{
+	return i2c_smbus_write_byte(to_i2c_client(data->dev), cmd);
+}
+
+static int ms5611_i2c_read(struct ms5611_data *data, u8 cmd, u8 *buf,
+		int len)
+{
+	int status;
+
+	status = i2c_smbus_read_i2c_block_data(to_i2c_client(data->dev), cmd,
+			len, buf);
+	if (status < 0)
+		return status;
+
+	return status == len ? 0 : -EIO;
+}
+
+/* Needs an adapter with I2C_FUNC_I2C */
+static int ms5611_i2c_read_command(struct ms5611_data *data, u8 cmd,
+		u8 *buf, int len, u8 next)
+{
+	struct i2c_client *client = to_i2c_client(data->dev);
+	struct i2c_msg msgs[3];
+	int status;
+
+	msgs[0].addr = client->addr;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &cmd;
+	msgs[1].addr = client->addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = len;
+	msgs[1].buf = buf;
+	msgs[2].addr = client->addr;
+	msgs[2].flags = 0;
+	msgs[2].len = 1;
+	msgs[2].buf = &next;
+
+	status = i2c_transfer(client->adapter, msgs, ARRAY_SIZE(msgs));
+	if (status < 0)
+		return status;
+
+	return status == ARRAY_SIZE(msgs) ? 0 : -EIO;
+}
+
+static const struct ms5611_transport ms5611_i2c_transport = {
+	.bustype	= BUS_I2C,
+	.command	= ms5611_i2c_command,
+	.read		= ms5611_i2c_read,
+	.read_command	= ms5611_i2c_read_command,
+};
+
+#ifdef CONFIG_SPI_MASTER
+/*
+ * SPI transport, mode 0 or 3 at up to 20 MHz. Chip select frames each
+ * command, so a command and its read are one transfer and a pipelined
+ * read drops chip select before the next command. spi_write_then_read()
+ * bounces through its own buffer; spi_sync() needs 'spi_buf'.
+ *  */
+static int ms5611_spi_command(struct ms5611_data *data, u8 cmd)
+{
+	return spi_write_then_read(to_spi_device(data->dev), &cmd, 1,
+			NULL, 0);
+}
+
+static int ms5611_spi_read(struct ms5611_data *data, u8 cmd, u8 *buf,
+		int len)
+{
+	return spi_write_then_read(to_spi_device(data->dev), &cmd, 1,
+			buf, len);
+}
+
+static int ms5611_spi_read_command(struct ms5611_data *data, u8 cmd,
+		u8 *buf, int len, u8 next)
+{
+	struct spi_transfer t[3];
+	struct spi_message m;
+	int status;
+
+	if (len > sizeof(data->spi_buf) - 2)
+		return -EINVAL;
+
+	memset(t, 0, sizeof(t));
+	data->spi_buf[0] = cmd;
+	data->spi_buf[1] = next;
+	t[0].tx_buf = &data->spi_buf[0];
+	t[0].len = 1;
+	t[1].rx_buf = &data->spi_buf[2];
+	t[1].len = len;
+	t[1].cs_change = 1;
+	t[2].tx_buf = &data->spi_buf[1];
+	t[2].len = 1;
+
+	spi_message_init(&m);
+	spi_message_add_tail(&t[0], &m);
+	spi_message_add_tail(&t[1], &m);
+	spi_message_add_tail(&t[2], &m);
+
+	status = spi_sync(to_spi_device(data->dev), &m);
+	if (status < 0)
+		return status;
+
+	memcpy(buf, &data->spi_buf[2], len);
+	return 0;
+}
+
+static const struct ms5611_transport ms5611_spi_transport = {
+	.bustype	= BUS_SPI,
+	.command	= ms5611_spi_command,
+	.read		= ms5611_spi_read,
+	.read_command	= ms5611_spi_read_command,
+};
+#endif
+
 /*
  * Read a PROM memory with 128-bit of MS5611-01BA, and verify.
- * @client: Handle to slave device.
+ * @data: The device.
  *
  * A 4-bit CRC has been implemented to check the data validity in memory.
  * 16 bit reserved for manufacturer of CALI_DATA_START. The next 12 bytes
@@ -114,19 +556,17 @@ static int ms5611_prom_is_valid(u16 *prom, size_t len)
  * The fourth bit of the last two bytes is the CRC check value. Returning
  * negative errno else zero on success.
  *    */
-static s32 ms5611_read_calibration_data(struct i2c_client *client)
+static s32 ms5611_read_calibration_data(struct ms5611_data *data)
 {
-	unsigned char i;
+	unsigned char i, tmp[2];
 	int status;
-	struct ms5611_data *data = i2c_get_clientdata(client);
 
 	for (i=0; i<CALI_DATA_LEN; i++) {
-		status = i2c_smbus_read_word_swapped(client,
-				CALI_DATA_START+i*2);
+		status = data->tf->read(data, CALI_DATA_START+i*2, tmp, 2);
 		if (status < 0)
 			return status;
 
-		data->calibration[i] = (u16)(status & 0xffff);
+		data->calibration[i] = (tmp[0] << 8) | tmp[1];
 	}
 
 	if (!ms5611_prom_is_valid(data->calibration, CALI_DATA_LEN)) {
@@ -134,327 +574,2638 @@ static s32 ms5611_read_calibration_data(struct i2c_client *client)
 		return -ENODEV;
 	}
 
+	ms5611_load_coeffs(&data->coeffs, data->calibration);
+
 	return 0;
 }
 
+/* Count @nsec in @hist, bucket i holds [2^i, 2^(i+1)) ns */
+static void ms5611_hist_add(u64 *hist, s64 nsec)
+{
+	int i = nsec > 0 ? fls64(nsec) - 1 : 0;
+
+	hist[min(i, MS5611_HIST_SIZE - 1)]++;
+}
+
+/*
+ * Account a bus transaction that started at @start and just ended with
+ * @status: its time goes to the sample in flight and to the load windows,
+ * 'bus_end' is set to now. Returning the duration in ns.
+ *  */
+static s64 ms5611_bus_done(struct ms5611_data *data, ktime_t start,
+		int status)
+{
+	s64 nsec;
+
+	data->bus_end = ktime_get();
+	nsec = ktime_to_ns(ktime_sub(data->bus_end, start));
+	data->bus_nsec += nsec;
+	data->window_busy_nsec += nsec;
+	data->bus->window_busy_nsec += nsec;
+	ms5611_hist_add(data->bus_hist, nsec);
+	if (status < 0)
+		atomic64_inc(&data->bus_errors);
+
+	return nsec;
+}
+
 /*
- * Read the temperature or atmospheric pressure value.
- * @client: Handle to slave device.
+ * Start a temperature or atmospheric pressure conversion.
+ * @data: The device.
  * @osr: Pointer to the osr structure.
- * @data: Stores the read data value.
  *
- * After the conversion command is sent, the value of the ADC can not be
- * read until the segment time has elapsed. Different sampling rates require
- * different periods of sleep. Returning negative errno else zero on success.
+ * The result can not be read until 'osr->conv_usec' has elapsed; the
+ * caller arms the acquisition timer for that. A command that failed did
+ * not start anything, so it is sent again up to MS5611_CMD_RETRIES times.
+ * Returning negative errno else zero on success.
  *  */
-static int ms5611_update_raw_data(struct i2c_client *client,
-		const struct ms5611_osr *osr, u32 *data)
+static int ms5611_start_conversion(struct ms5611_data *data,
+		const struct ms5611_osr *osr)
 {
-	unsigned char tmp[3] = {0};
+	unsigned int tries = 0;
+	ktime_t start;
+	s64 nsec;
 	int status;
 
-	status = i2c_smbus_write_byte(client, osr->cmd);
-	if (status < 0) {
-		dev_err(&client->dev, "Error while requesting measurement.\n");
-		return status;
+	for (;;) {
+		start = ktime_get();
+		status = data->tf->command(data, osr->cmd);
+		nsec = ms5611_bus_done(data, start, status);
+		trace_ms5611_convert(data->sensor_id, osr->cmd, osr->rate,
+				nsec, status);
+		if (status >= 0 || tries++ >= MS5611_CMD_RETRIES)
+			break;
+		atomic64_inc(&data->retries);
 	}
-	usleep_range(osr->conv_usec, osr->conv_usec + (osr->conv_usec / 10UL));
 
-	status = i2c_smbus_read_i2c_block_data(client, CMD_ADC_READ, 3, tmp);
 	if (status < 0) {
-                printk(KERN_ERR "ERROR: i2c read adc\n");
+		dev_err(data->dev, "Error while requesting measurement.\n");
 		return status;
 	}
 
-	*data = (tmp[0] << 16) | (tmp[1] << 8) | tmp[2];
+	atomic64_inc(&data->conversions);
 	return 0;
 }
 
 /*
- * Update the value of the sample rate.
- * @array: An array of pre-defined sample rate information.
- * @osr:   Save the array offset for the new specified sample rate.
- * @data:  The value of the stored sample rate.
+ * Read the 24-bit result of the finished conversion.
+ * @data: The device.
+ * @value: Stores the read data value.
  *
- * Because the temperature and atmospheric pressure sampling rate range
- * of the same value, so a common function. Returning negative errno
- * else zero on success.
+ * Returning negative errno else zero on success.
  *  */
-static int update_oversampling(const struct ms5611_osr *array,
-		const struct ms5611_osr **osr, unsigned long data)
+static int ms5611_read_adc(struct ms5611_data *data, u32 *value)
 {
-	switch (data) {
-	case 256:
-		*osr = &array[0];
-		break;
-	case 512:
-		*osr = &array[1];
-		break;
-	case 1024:
-		*osr = &array[2];
-		break;
-	case 2048:
-		*osr = &array[3];
-		break;
-	case 4096:
-		*osr = &array[4];
-		break;
-	default:
-		return -EINVAL;
+	unsigned char tmp[3] = {0};
+	ktime_t start;
+	s64 nsec;
+	u32 val;
+	int status;
+
+	start = ktime_get();
+	status = data->tf->read(data, CMD_ADC_READ, tmp, 3);
+	nsec = ms5611_bus_done(data, start, status);
+	val = (tmp[0] << 16) | (tmp[1] << 8) | tmp[2];
+	trace_ms5611_adc_read(data->sensor_id, val, 0, 0, nsec, status);
+	if (status < 0) {
+                printk(KERN_ERR "ERROR: read adc\n");
+		return status;
 	}
 
+	*value = val;
 	return 0;
 }
 
 /*
- * Displays the value of pressure sensitivity.
+ * Read the finished conversion and, if @next is not NULL, start the next
+ * one in the same transaction. The convert command follows the ADC read
+ * with a repeated start on I2C, or right after chip select toggles on
+ * SPI, so the sensor starts converting as soon as the result was latched
+ * instead of after another bus transaction.
+ * @data: The device.
+ * @value: Stores the read data value.
+ * @next: Conversion to start, NULL for a plain read.
+ *
+ * Needs 'can_pipeline' when @next is set. Neither part is retried, the
+ * read would return a zero result once the conversion was read.
+ * Returning negative errno else zero on success.
  *  */
-static ssize_t ms5611_sens_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static int ms5611_read_adc_start(struct ms5611_data *data, u32 *value,
+		const struct ms5611_osr *next)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	u8 tmp[3] = {0};
+	ktime_t start;
+	s64 nsec;
+	u32 val;
+	int status;
 
-	return sprintf(buf, "%u", data->calibration[1]);
+	if (!next)
+		return ms5611_read_adc(data, value);
+
+	start = ktime_get();
+	status = data->tf->read_command(data, CMD_ADC_READ, tmp, 3, next->cmd);
+	nsec = ms5611_bus_done(data, start, status);
+	val = (tmp[0] << 16) | (tmp[1] << 8) | tmp[2];
+	trace_ms5611_adc_read(data->sensor_id, val, next->cmd, next->rate,
+			nsec, status);
+	if (status < 0) {
+		dev_err(data->dev, "Error while reading adc.\n");
+		return status;
+	}
+
+	atomic64_inc(&data->conversions);
+	*value = val;
+	return 0;
 }
 
 /*
- * Displays the vaule of pressure offset.
+ * Close the rate and load windows of the sensor and of its bus once they
+ * are MS5611_WINDOW_NSEC old.
  *  */
-static ssize_t ms5611_off_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static void ms5611_window_roll(struct ms5611_data *data, ktime_t now)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	struct ms5611_bus *bus = data->bus;
+	s64 elapsed;
+
+	elapsed = ktime_to_ns(ktime_sub(now, data->window_start));
+	if (elapsed >= MS5611_WINDOW_NSEC) {
+		data->rate_mhz = div64_s64((s64)data->window_samples *
+				NSEC_PER_SEC * 1000, elapsed);
+		data->load = div64_s64(data->window_busy_nsec * 1000, elapsed);
+		data->window_start = now;
+		data->window_busy_nsec = 0;
+		data->window_samples = 0;
+	}
 
-	return sprintf(buf, "%u", data->calibration[2]);
+	elapsed = ktime_to_ns(ktime_sub(now, bus->window_start));
+	if (elapsed >= MS5611_WINDOW_NSEC) {
+		bus->load = div64_s64(bus->window_busy_nsec * 1000, elapsed);
+		bus->window_start = now;
+		bus->window_busy_nsec = 0;
+	}
 }
 
 /*
- * Displays the vaule of temperature coefficient of pressure sensitivity.
+ * Append a record to the sample stream. There is one producer, the step
+ * work, so the ring needs no lock. Readers copy a slot and then check the
+ * head to see whether the slot was reused under them, which requires the
+ * head update to be ordered against the slot writes on both sides. The
+ * header 'seq' brackets the update for readers of the mapping.
  *  */
-static ssize_t ms5611_tcs_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static void ms5611_ring_push(struct ms5611_data *data,
+		const struct ms5611_record *rec)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
-
-	return sprintf(buf, "%u", data->calibration[3]);
+	struct ms5611_ring_header *hdr = data->ring_hdr;
+	unsigned long head = data->ring_head;
+
+	hdr->seq++;
+	smp_wmb();
+	data->ring[head & (MS5611_RING_SIZE - 1)] = *rec;
+	smp_wmb();
+	ACCESS_ONCE(data->ring_head) = head + 1;
+	hdr->head = head + 1;
+	hdr->pressure_osr = data->pressure_osr->rate;
+	hdr->temp_osr = data->temp_osr->rate;
+	smp_wmb();
+	hdr->seq++;
 }
 
 /*
- * Displays the value of temperature coefficient of pressure offset.
+ * Refresh the OSRs in the ring header after a change, so that readers of
+ * the mapping need not wait for the next record. Called under 'lock' like
+ * ms5611_ring_push(), the only other writer of the header.
  *  */
-static ssize_t ms5611_tco_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static void ms5611_ring_set_osr(struct ms5611_data *data)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	struct ms5611_ring_header *hdr = data->ring_hdr;
+
+	hdr->seq++;
+	smp_wmb();
+	hdr->pressure_osr = data->pressure_osr->rate;
+	hdr->temp_osr = data->temp_osr->rate;
+	smp_wmb();
+	hdr->seq++;
+}
 
-	return sprintf(buf, "%u", data->calibration[4]);
+/*
+ * Allocate the ring with its header page in front, zeroed and suitable
+ * for remap_vmalloc_range(). Returning negative errno else zero.
+ *  */
+static int ms5611_ring_alloc(struct ms5611_data *data)
+{
+	struct ms5611_ring_header *hdr;
+	size_t offset = PAGE_ALIGN(sizeof(struct ms5611_ring_header));
+
+	data->ring_area = vmalloc_user(offset +
+			MS5611_RING_SIZE * sizeof(struct ms5611_record));
+	if (!data->ring_area)
+		return -ENOMEM;
+
+	hdr = data->ring_area;
+	hdr->magic = MS5611_RING_MAGIC;
+	hdr->version = MS5611_RING_VERSION;
+	hdr->size = MS5611_RING_SIZE;
+	hdr->record_size = sizeof(struct ms5611_record);
+	hdr->data_offset = offset;
+	memcpy(hdr->calibration, data->calibration, sizeof(hdr->calibration));
+	hdr->pressure_osr = data->pressure_osr->rate;
+	hdr->temp_osr = data->temp_osr->rate;
+
+	data->ring_hdr = hdr;
+	data->ring = data->ring_area + offset;
+	return 0;
 }
 
 /*
- * Displays the value of reference temperature.
+ * Index of the pressure OSR in 'ms5611_avail_pressure_osr'.
  *  */
-static ssize_t ms5611_tref_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static int ms5611_osr_index(const struct ms5611_osr *osr)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	return osr - ms5611_avail_pressure_osr;
+}
 
-	return sprintf(buf, "%u", data->calibration[5]);
+/*
+ * Estimated RMS noise of the pressure in 0.001 mbar. For white noise the
+ * difference of two consecutive samples has twice the variance of one,
+ * and it does not follow real pressure changes like a climb does.
+ *  */
+static unsigned int ms5611_noise(struct ms5611_data *data)
+{
+	return int_sqrt(min_t(s64, (data->noise_ewma * 50) >> 8, ULONG_MAX));
 }
 
 /*
- * Displays the value of temperature coefficient of the temperature.
+ * Pick the pressure OSR for the next cycle. Called with the bus lock held
+ * for every published sample, the new OSR applies from the next D1 on so
+ * no sample is lost.
+ *
+ * In rate mode the highest OSR whose cycle fits in the continuous period
+ * is taken. In noise mode the OSR steps up while the estimated noise is
+ * above 'target_noise', and down when one step less, roughly 1.5 times
+ * the noise, would still be well below it.
  *  */
-static ssize_t ms5611_tempsens_show(struct device *dev,
-			     struct device_attribute *attr, char *buf)
+static void ms5611_adapt_osr(struct ms5611_data *data, s32 pressure)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	const struct ms5611_osr *osr = data->pressure_osr;
+	unsigned long budget, temp_usec;
+	s64 target, noise;
+	s64 diff;
+	int i;
+
+	diff = pressure - data->last_pressure;
+	data->last_pressure = pressure;
+	if (data->noise_samples++ == 0)
+		data->noise_ewma = 0;
+	else if (data->noise_samples == 2)
+		data->noise_ewma = (diff * diff) << 8;
+	else
+		data->noise_ewma += (((diff * diff) << 8) -
+				data->noise_ewma) >> MS5611_NOISE_SHIFT;
+
+	switch (data->osr_mode) {
+	case MS5611_OSR_RATE:
+		temp_usec = data->temp_osr->conv_usec / data->temp_decimation;
+		budget = data->period_usec;
+		for (i = ARRAY_SIZE(ms5611_avail_pressure_osr) - 1; i > 0; i--)
+			if (ms5611_avail_pressure_osr[i].conv_usec + temp_usec +
+					MS5611_BUS_OVERHEAD_USEC <= budget)
+				break;
+		osr = &ms5611_avail_pressure_osr[i];
+		break;
 
-	return sprintf(buf, "%u", data->calibration[6]);
+	case MS5611_OSR_NOISE:
+		if (data->noise_samples < MS5611_NOISE_SETTLE)
+			return;
+
+		i = ms5611_osr_index(osr);
+		target = (s64)data->target_noise * data->target_noise;
+		noise = (data->noise_ewma * 50) >> 8;
+		if (noise > target &&
+				i < ARRAY_SIZE(ms5611_avail_pressure_osr) - 1)
+			osr++;
+		else if (noise * 3 < target && i > 0)
+			osr--;
+		break;
+
+	default:
+		return;
+	}
+
+	if (osr != data->pressure_osr) {
+		data->pressure_osr = osr;
+		data->noise_samples = 0;
+		ms5611_ring_set_osr(data);
+	}
 }
 
 /*
- * Dispalys the value of temperature oversampling. The value of the sampling
- * rate defined in the 's5611_avail_temp_osr' of array, please direct the use
- * of assignment.
+ * Release the merged records no sensor can still go before. A sensor with
+ * a cycle in flight will publish it with the cycle start as timestamp, an
+ * idle one starts its next cycle later than anything already inserted.
+ * Called with the merge lock held.
  *  */
-static int ms5611_oversampling_temp_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
+static void ms5611_merge_release(void)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	struct ms5611_merge *merge = &ms5611_merge;
+	struct ms5611_data *data;
+	unsigned long stable = merge->stable;
+	s64 bound = LLONG_MAX;
+
+	list_for_each_entry(data, &merge->sensors, sensors)
+		if (data->merge_bound && data->merge_bound < bound)
+			bound = data->merge_bound;
+
+	/* A stuck sensor must not hold the others for a whole ring */
+	while (merge->stable != merge->head &&
+			((s64)merge->ring[merge->stable &
+			 (MS5611_MERGE_SIZE - 1)].rec.timestamp_ns < bound ||
+			 merge->head - merge->stable >= MS5611_MERGE_SIZE / 2))
+		merge->stable++;
+
+	if (merge->stable != stable)
+		wake_up_interruptible(&merge->wait);
+}
 
-	return sprintf(buf, "%u", data->temp_osr->rate);
+/*
+ * Set the start of the cycle in flight of @data, 0 if there is none.
+ *  */
+static void ms5611_merge_bound(struct ms5611_data *data, ktime_t start)
+{
+	spin_lock(&ms5611_merge.lock);
+	data->merge_bound = ktime_to_ns(start);
+	ms5611_merge_release();
+	spin_unlock(&ms5611_merge.lock);
 }
 
 /*
- * Set the value of temperature oversampling. The value entered must be a
- * pre-specified valid value. Valid values are predefined in the
- * 's5611_avail_temp_osr' array.
+ * Insert a record into the merged stream, sorted among the records not
+ * released yet, and move the bound of its sensor to @next, the start of
+ * the next cycle if that already runs. Both happen under the lock, so
+ * nothing newer can be released before the record is in.
  *  */
-static int ms5611_oversampling_temp_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t count)
+static void ms5611_merge_push(struct ms5611_data *data,
+		const struct ms5611_record *rec, ktime_t next)
 {
-	int err;
-	unsigned long data;
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *ms5611 = i2c_get_clientdata(client);
+	struct ms5611_merge *merge = &ms5611_merge;
+	struct ms5611_merged_record *slot;
+	unsigned long i;
+
+	spin_lock(&merge->lock);
+	for (i = merge->head; i != merge->stable; i--) {
+		slot = &merge->ring[(i - 1) & (MS5611_MERGE_SIZE - 1)];
+		if (slot->rec.timestamp_ns <= rec->timestamp_ns)
+			break;
+		merge->ring[i & (MS5611_MERGE_SIZE - 1)] = *slot;
+	}
 
-	err = strict_strtoul(buf, 10, &data);
-	if (err)
-		return err;
+	slot = &merge->ring[i & (MS5611_MERGE_SIZE - 1)];
+	slot->rec = *rec;
+	slot->sensor = data->sensor_id;
+	slot->reserved = 0;
+	merge->head++;
 
-	update_oversampling(ms5611_avail_temp_osr, &ms5611->temp_osr, data);
-	return count;
+	data->merge_bound = ktime_to_ns(next);
+	ms5611_merge_release();
+	spin_unlock(&merge->lock);
 }
 
 /*
- * Dispalys the value of pressure oversampling. The value of the sampling
- * rate defined in the 's5611_avail_pressure_osr' of array, please direct
- * the use of assignment.
- *   */
-static int ms5611_oversampling_pres_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
+ * A D1 conversion of @osr was started by the transaction that just ended.
+ * The sensor integrates over the whole conversion, so the sample is dated
+ * at its middle rather than at the start of the cycle.
+ *  */
+static void ms5611_d1_started(struct ms5611_data *data,
+		const struct ms5611_osr *osr)
 {
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *data = i2c_get_clientdata(client);
+	data->d1_mid = ktime_add_ns(data->bus_end,
+			(u64)osr->conv_usec * NSEC_PER_USEC / 2);
+}
 
-	return sprintf(buf, "%u", data->pressure_osr->rate);
+/*
+ * Publish a finished sample to the cache and the sample streams. @next
+ * is the start of the cycle that was chained to this one, zero if none.
+ * Readers are woken up when the cycle is done.
+ *  */
+static void ms5611_publish(struct ms5611_data *data, u32 pressure,
+		u32 temperature, ktime_t timestamp, ktime_t next)
+{
+	struct ms5611_record rec;
+	s64 temp_age = ktime_us_delta(timestamp, data->temp_timestamp);
+	ktime_t now = ktime_get();
+	s64 latency = ktime_to_ns(ktime_sub(now, timestamp));
+	ktime_t boot = ktime_sub(ktime_get_boottime(), now);
+
+	write_seqlock(&data->cache_lock);
+	data->raw_pressure = pressure;
+	data->raw_temperature = temperature;
+	data->timestamp = data->d1_mid;
+	data->samples++;
+	write_sequnlock(&data->cache_lock);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.timestamp_ns = ktime_to_ns(data->d1_mid);
+	rec.boottime_ns = ktime_to_ns(ktime_add(data->d1_mid, boot));
+	rec.seq = (u32)data->samples;
+	rec.raw_pressure = pressure;
+	rec.raw_temperature = temperature;
+	rec.temp_age_usec = temp_age > 0 ? min_t(s64, temp_age, UINT_MAX) : 0;
+	ms5611_compensate(&data->coeffs, pressure, temperature,
+			&rec.pressure, &rec.temperature);
+	ms5611_ring_push(data, &rec);
+	ms5611_merge_push(data, &rec, next);
+	if (next.tv64)
+		data->cycle_start = next;
+	data->temp_uses++;
+
+	ms5611_hist_add(data->sample_hist, latency);
+	trace_ms5611_sample(data->sensor_id, rec.seq, pressure, temperature,
+			rec.pressure, rec.temperature, data->pressure_osr->rate,
+			data->temp_osr->rate, latency, data->bus_nsec);
+
+	data->bus_last_nsec = data->bus_nsec;
+	data->bus_avg_nsec += (data->bus_nsec - data->bus_avg_nsec) >>
+		MS5611_BUS_SHIFT;
+	if (data->bus_nsec > data->bus_max_nsec)
+		data->bus_max_nsec = data->bus_nsec;
+	data->bus_nsec = 0;
+	data->window_samples++;
+	ms5611_window_roll(data, now);
+
+	ms5611_adapt_osr(data, rec.pressure);
 }
 
 /*
- * Set the value of pressure oversampling. The value entered must be a
- * pre-specified valid value. Valid values are predefined in the
- * 's5611_avail_pressure_osr' array.
+ * Copy the latest published sample out of the cache.
  *  */
-static int ms5611_oversampling_pres_store(struct device *dev,
-		struct device_attribute *attr, const char *buf, size_t count)
+static void ms5611_read_cache(struct ms5611_data *data, u32 *pressure,
+		u32 *temperature, ktime_t *timestamp)
 {
-	int err;
-	unsigned long data;
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *ms5611 = i2c_get_clientdata(client);
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&data->cache_lock);
+		*pressure = data->raw_pressure;
+		*temperature = data->raw_temperature;
+		if (timestamp)
+			*timestamp = data->timestamp;
+	} while (read_seqretry(&data->cache_lock, seq));
+}
 
-	err = strict_strtoul(buf, 10, &data);
-	if (err)
-		return err;
+/*
+ * Request an acquisition cycle. Does nothing if one is already in flight,
+ * its result is shared by everybody waiting on it.
+ *  */
+static void ms5611_kick(struct ms5611_data *data)
+{
+	unsigned long flags;
 
-	update_oversampling(ms5611_avail_pressure_osr,
-			&ms5611->pressure_osr, data);
-	return count;
+	spin_lock_irqsave(&data->state_lock, flags);
+	if (data->state == MS5611_STATE_IDLE && !data->stopping) {
+		data->state = MS5611_STATE_START;
+		queue_work(data->wq, &data->step);
+	}
+	spin_unlock_irqrestore(&data->state_lock, flags);
 }
 
 /*
- * Read temperature and atmospheric pressure values.
+ * Request 'count' cycles back to back, ignoring the continuous period.
+ * The cycle in flight, or the one waiting for its period, is the first.
+ * Returning how many cycles were added to 'burst' for the others.
+ *  */
+static unsigned int ms5611_kick_burst(struct ms5611_data *data,
+		unsigned int count)
+{
+	unsigned long flags;
+	unsigned int added = 0;
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	if (data->stopping)
+		goto unlock;
+
+	added = count - 1;
+	data->burst += added;
+	if (data->state == MS5611_STATE_IDLE) {
+		data->state = MS5611_STATE_START;
+		queue_work(data->wq, &data->step);
+	} else if (data->state == MS5611_STATE_START &&
+			hrtimer_try_to_cancel(&data->timer) == 1) {
+		queue_work(data->wq, &data->step);
+	}
+unlock:
+	spin_unlock_irqrestore(&data->state_lock, flags);
+	return added;
+}
+
+/*
+ * Take back up to 'count' cycles of a burst nobody waits for any more,
+ * those already run are gone.
+ *  */
+static void ms5611_release_burst(struct ms5611_data *data,
+		unsigned int count)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	data->burst -= min(data->burst, count);
+	spin_unlock_irqrestore(&data->state_lock, flags);
+}
+
+/*
+ * Move to the next state and arm the timer for it. A zero delay runs
+ * the next step immediately.
+ *  */
+static void ms5611_next_state(struct ms5611_data *data, unsigned int state,
+		s64 delay_nsec)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	data->state = state;
+	if (state != MS5611_STATE_IDLE && !data->stopping) {
+		if (delay_nsec > 0)
+			hrtimer_start(&data->timer, ns_to_ktime(delay_nsec),
+					HRTIMER_MODE_REL);
+		else
+			queue_work(data->wq, &data->step);
+	}
+	spin_unlock_irqrestore(&data->state_lock, flags);
+}
+
+/*
+ * With pipelining, whether the next cycle starts in the transfer that ends
+ * this one: a burst is pending or the continuous period has already run
+ * out. Returns the OSR of its D1 conversion, NULL if it does not.
+ *  */
+static const struct ms5611_osr *ms5611_chain(struct ms5611_data *data)
+{
+	unsigned long flags;
+	int chain = 0;
+
+	if (!data->pipelined)
+		return NULL;
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	data->chain_burst = 0;
+	if (data->stopping) {
+		chain = 0;
+	} else if (data->burst) {
+		data->burst--;
+		data->chain_burst = 1;
+		chain = 1;
+	} else if (data->mode == MS5611_MODE_CONTINUOUS) {
+		chain = ktime_us_delta(ktime_get(), data->cycle_start) >=
+			data->period_usec;
+	}
+	spin_unlock_irqrestore(&data->state_lock, flags);
+
+	return chain ? data->pressure_osr : NULL;
+}
+
+/*
+ * End of a cycle. If @chained is set the next cycle was started along
+ * with the last read of this one and only has to be waited for. A pending
+ * burst starts the next cycle right away. In continuous mode the next
+ * cycle is scheduled one period after the start of this one, otherwise
+ * the machine goes idle.
+ *  */
+static void ms5611_cycle_done(struct ms5611_data *data, int status,
+		const struct ms5611_osr *chained)
+{
+	unsigned long flags;
+	unsigned int burst;
+	s64 delay_nsec;
+
+	data->error = status;
+	data->cycles++;
+	wake_up_all(&data->wait);
+	if (status == 0) {
+		ms5611_iio_notify(data);
+	} else {
+		atomic64_inc(&data->dropped);
+		ms5611_merge_bound(data, ktime_set(0, 0));
+	}
+
+	if (chained && status == 0) {
+		ms5611_next_state(data, MS5611_STATE_CONV_PRESSURE,
+				(s64)chained->conv_usec * NSEC_PER_USEC);
+		return;
+	}
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	/* The convert may not have gone out, give the cycle back */
+	if (chained && data->chain_burst)
+		data->burst++;
+	burst = data->burst;
+	if (burst)
+		data->burst--;
+	spin_unlock_irqrestore(&data->state_lock, flags);
+
+	if (burst) {
+		ms5611_next_state(data, MS5611_STATE_START, 0);
+		return;
+	}
+
+	if (ACCESS_ONCE(data->mode) != MS5611_MODE_CONTINUOUS) {
+		ms5611_next_state(data, MS5611_STATE_IDLE, 0);
+		return;
+	}
+
+	delay_nsec = (s64)data->period_usec * NSEC_PER_USEC -
+		ktime_to_ns(ktime_sub(ktime_get(), data->cycle_start));
+	ms5611_next_state(data, MS5611_STATE_START, delay_nsec);
+}
+
+/*
+ * Whether the sample in progress needs a new D2. Die temperature changes
+ * slowly, so one D2 can serve 'temp_decimation' samples as long as it is
+ * not older than 'temp_max_age_usec'.
+ *  */
+static int ms5611_temp_due(struct ms5611_data *data)
+{
+	if (!data->temp_valid || data->temp_uses >= data->temp_decimation)
+		return 1;
+
+	return data->temp_max_age_usec &&
+		ktime_us_delta(data->cycle_start, data->temp_timestamp) >=
+		data->temp_max_age_usec;
+}
+
+/*
+ * Acquisition state machine, one bus transaction per step.
+ *
+ * START issues the D1 conversion, CONV_PRESSURE reads it back and issues
+ * the D2 conversion, CONV_TEMP reads that back and publishes the sample.
+ * When the cached D2 is still good CONV_PRESSURE publishes right away.
+ * Between steps nothing sleeps: the hrtimer fires at the exact conversion
+ * time from the OSR table and queues the next step.
+ *
+ * With 'pipelined' each read and the convert command after it are one
+ * i2c_transfer(). When the next cycle is due by the time a sample is
+ * finished, its D1 conversion is started by the same transfer and the
+ * machine goes straight back to CONV_PRESSURE, so back to back cycles run
+ * at the conversion time plus one transfer per conversion. The D1 OSR of
+ * such a cycle is picked before the sample that ends the previous one is
+ * published, so the adaptive OSR takes effect one cycle later.
+ *  */
+static void ms5611_step(struct work_struct *work)
+{
+	struct ms5611_data *data = container_of(work, struct ms5611_data, step);
+	const struct ms5611_osr *osr, *chained = NULL;
+	u32 temperature = 0;
+	int status;
+
+	mutex_lock(&data->lock);
+	switch (data->state) {
+	case MS5611_STATE_START:
+		osr = data->pressure_osr;
+		data->cycle_start = ktime_get();
+		data->bus_nsec = 0;
+		ms5611_merge_bound(data, data->cycle_start);
+		status = ms5611_start_conversion(data, osr);
+		if (status != 0)
+			break;
+		ms5611_d1_started(data, osr);
+		mutex_unlock(&data->lock);
+		ms5611_next_state(data, MS5611_STATE_CONV_PRESSURE,
+				(s64)osr->conv_usec * NSEC_PER_USEC);
+		return;
+
+	case MS5611_STATE_CONV_PRESSURE:
+		if (ms5611_temp_due(data)) {
+			osr = data->temp_osr;
+			data->temp_timestamp = ktime_get();
+			if (data->pipelined) {
+				status = ms5611_read_adc_start(data,
+						&data->pending_pressure, osr);
+			} else {
+				status = ms5611_read_adc(data,
+						&data->pending_pressure);
+				if (status == 0)
+					status = ms5611_start_conversion(data,
+							osr);
+			}
+			if (status != 0)
+				break;
+			mutex_unlock(&data->lock);
+			ms5611_next_state(data, MS5611_STATE_CONV_TEMP,
+					(s64)osr->conv_usec * NSEC_PER_USEC);
+			return;
+		}
+
+		chained = ms5611_chain(data);
+		status = ms5611_read_adc_start(data, &data->pending_pressure,
+				chained);
+		if (status != 0)
+			break;
+
+		ms5611_publish(data, data->pending_pressure, data->cached_temp,
+				data->cycle_start, chained ? data->bus_end :
+				ktime_set(0, 0));
+		if (chained)
+			ms5611_d1_started(data, chained);
+		break;
+
+	case MS5611_STATE_CONV_TEMP:
+		chained = ms5611_chain(data);
+		status = ms5611_read_adc_start(data, &temperature, chained);
+		if (status != 0) {
+			data->temp_valid = 0;
+			break;
+		}
+
+		data->cached_temp = temperature;
+		data->temp_uses = 0;
+		data->temp_valid = 1;
+		ms5611_publish(data, data->pending_pressure, temperature,
+				data->cycle_start, chained ? data->bus_end :
+				ktime_set(0, 0));
+		if (chained)
+			ms5611_d1_started(data, chained);
+		break;
+
+	default:
+		mutex_unlock(&data->lock);
+		return;
+	}
+	mutex_unlock(&data->lock);
+
+	ms5611_cycle_done(data, status, chained);
+}
+
+/*
+ * Conversion or period deadline. Runs in interrupt context, so the bus
+ * transaction is handed to the workqueue.
+ *  */
+static enum hrtimer_restart ms5611_timer(struct hrtimer *timer)
+{
+	struct ms5611_data *data = container_of(timer, struct ms5611_data,
+			timer);
+
+	queue_work(data->wq, &data->step);
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Wait for the result of the next acquisition cycle.
+ *
+ * Returning negative errno else zero on success.
+ *  */
+static int ms5611_wait_sample(struct ms5611_data *data)
+{
+	unsigned long cycles = ACCESS_ONCE(data->cycles);
+	long ret;
+
+	ms5611_kick(data);
+
+	ret = wait_event_interruptible_timeout(data->wait,
+			ACCESS_ONCE(data->cycles) != cycles,
+			msecs_to_jiffies(MS5611_CYCLE_TIMEOUT_MSEC));
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		return -ETIMEDOUT;
+
+	return ACCESS_ONCE(data->error);
+}
+
+/*
+ * Get a sample for a reader: the cached one in continuous mode, otherwise
+ * the result of the next acquisition cycle.
+ *
+ * Returning negative errno else zero on success.
+ *  */
+static int ms5611_get_sample(struct ms5611_data *data, u32 *pressure,
+		u32 *temperature)
+{
+	int status;
+
+	if (ACCESS_ONCE(data->mode) != MS5611_MODE_CONTINUOUS ||
+			!ACCESS_ONCE(data->samples)) {
+		status = ms5611_wait_sample(data);
+		if (status != 0)
+			return status;
+	}
+
+	ms5611_read_cache(data, pressure, temperature, NULL);
+	return 0;
+}
+
+/*
+ * Stop the state machine. The timer and the step work re-arm each other,
+ * so both are cancelled after 'stopping' blocks any further re-arming.
+ *  */
+static void ms5611_stop(struct ms5611_data *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->state_lock, flags);
+	data->stopping = 1;
+	spin_unlock_irqrestore(&data->state_lock, flags);
+
+	hrtimer_cancel(&data->timer);
+	cancel_work_sync(&data->step);
+	hrtimer_cancel(&data->timer);
+
+	wake_up_all(&data->wait);
+}
+
+/*
+ * Free the device data once the driver and the last open file let go.
+ *  */
+static void ms5611_free_data(struct kref *kref)
+{
+	struct ms5611_data *data = container_of(kref, struct ms5611_data,
+			kref);
+
+	vfree(data->ring_area);
+	kfree(data);
+}
+
+/*
+ * Find bus @nr, the sensor id without the address byte, or set it up for
+ * its first sensor. Returning NULL on failure.
+ *  */
+static struct ms5611_bus *ms5611_bus_get(u32 nr)
+{
+	struct ms5611_bus *bus;
+
+	mutex_lock(&ms5611_bus_lock);
+	list_for_each_entry(bus, &ms5611_buses, list)
+		if (bus->nr == nr)
+			goto found;
+
+	bus = kzalloc(sizeof(struct ms5611_bus), GFP_KERNEL);
+	if (!bus)
+		goto unlock;
+
+	bus->nr = nr;
+	if (nr & (MS5611_SENSOR_SPI >> 8))
+		snprintf(bus->name, sizeof(bus->name), "ms5611-spi%u",
+				nr & ~(MS5611_SENSOR_SPI >> 8));
+	else
+		snprintf(bus->name, sizeof(bus->name), "ms5611-%u", nr);
+	bus->wq = alloc_ordered_workqueue(bus->name, WQ_HIGHPRI);
+	if (!bus->wq) {
+		kfree(bus);
+		bus = NULL;
+		goto unlock;
+	}
+	list_add(&bus->list, &ms5611_buses);
+
+found:
+	bus->users++;
+unlock:
+	mutex_unlock(&ms5611_bus_lock);
+	return bus;
+}
+
+/*
+ * Drop a sensor from its bus. Its state machine must be stopped, the
+ * workqueue goes with the last sensor.
+ *  */
+static void ms5611_bus_put(struct ms5611_bus *bus)
+{
+	mutex_lock(&ms5611_bus_lock);
+	if (--bus->users == 0) {
+		list_del(&bus->list);
+		destroy_workqueue(bus->wq);
+		kfree(bus);
+	}
+	mutex_unlock(&ms5611_bus_lock);
+}
+
+static void ms5611_merge_add(struct ms5611_data *data)
+{
+	spin_lock(&ms5611_merge.lock);
+	list_add_tail(&data->sensors, &ms5611_merge.sensors);
+	spin_unlock(&ms5611_merge.lock);
+}
+
+/* A removed sensor no longer holds back the merged stream */
+static void ms5611_merge_del(struct ms5611_data *data)
+{
+	spin_lock(&ms5611_merge.lock);
+	list_del_init(&data->sensors);
+	ms5611_merge_release();
+	spin_unlock(&ms5611_merge.lock);
+}
+
+/*
+ * Update the value of the sample rate.
+ * @array: An array of pre-defined sample rate information.
+ * @osr:   Save the array offset for the new specified sample rate.
+ * @data:  The value of the stored sample rate.
+ *
+ * Because the temperature and atmospheric pressure sampling rate range
+ * of the same value, so a common function. Returning negative errno
+ * else zero on success.
+ *  */
+static int update_oversampling(const struct ms5611_osr *array,
+		const struct ms5611_osr **osr, unsigned long data)
+{
+	switch (data) {
+	case 256:
+		*osr = &array[0];
+		break;
+	case 512:
+		*osr = &array[1];
+		break;
+	case 1024:
+		*osr = &array[2];
+		break;
+	case 2048:
+		*osr = &array[3];
+		break;
+	case 4096:
+		*osr = &array[4];
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Displays the value of pressure sensitivity.
+ *  */
+static ssize_t ms5611_sens_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[1]);
+}
+
+/*
+ * Displays the vaule of pressure offset.
+ *  */
+static ssize_t ms5611_off_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[2]);
+}
+
+/*
+ * Displays the vaule of temperature coefficient of pressure sensitivity.
+ *  */
+static ssize_t ms5611_tcs_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[3]);
+}
+
+/*
+ * Displays the value of temperature coefficient of pressure offset.
+ *  */
+static ssize_t ms5611_tco_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[4]);
+}
+
+/*
+ * Displays the value of reference temperature.
+ *  */
+static ssize_t ms5611_tref_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[5]);
+}
+
+/*
+ * Displays the value of temperature coefficient of the temperature.
+ *  */
+static ssize_t ms5611_tempsens_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->calibration[6]);
+}
+
+/*
+ * Dispalys the value of temperature oversampling. The value of the sampling
+ * rate defined in the 's5611_avail_temp_osr' of array, please direct the use
+ * of assignment.
+ *  */
+static int ms5611_oversampling_temp_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->temp_osr->rate);
+}
+
+/*
+ * Set the value of temperature oversampling. The value entered must be a
+ * pre-specified valid value. Valid values are predefined in the
+ * 's5611_avail_temp_osr' array.
+ *  */
+static int ms5611_oversampling_temp_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	mutex_lock(&ms5611->lock);
+	update_oversampling(ms5611_avail_temp_osr, &ms5611->temp_osr, data);
+	ms5611_ring_set_osr(ms5611);
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Dispalys the value of pressure oversampling. The value of the sampling
+ * rate defined in the 's5611_avail_pressure_osr' of array, please direct
+ * the use of assignment.
+ *   */
+static int ms5611_oversampling_pres_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->pressure_osr->rate);
+}
+
+/*
+ * Set the value of pressure oversampling. The value entered must be a
+ * pre-specified valid value. Valid values are predefined in the
+ * 's5611_avail_pressure_osr' array.
+ *  */
+static int ms5611_oversampling_pres_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	mutex_lock(&ms5611->lock);
+	update_oversampling(ms5611_avail_pressure_osr,
+			&ms5611->pressure_osr, data);
+	ms5611_ring_set_osr(ms5611);
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Read temperature and atmospheric pressure values. In continuous mode the
+ * latest sample is returned from the cache without touching the bus.
  *  */
 static int ms5611_read_temp_and_pressure(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
-	u32 pressure = 0, temperature = 0;
-	s32 status;
-	struct i2c_client *client = to_i2c_client(dev);
-	struct ms5611_data *ms5611 = i2c_get_clientdata(client);
+	u32 pressure = 0, temperature = 0;
+	s32 status;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	status = ms5611_get_sample(ms5611, &pressure, &temperature);
+	if (status != 0)
+		return status;
+
+	return sprintf(buf, "%u %u", temperature, pressure);
+}
+
+/*
+ * Displays the CLOCK_MONOTONIC midpoint of the D1 conversion of the latest
+ * sample in ns, 0 before the first one. Read right after temp_and_pressure
+ * it dates the sample that returned, unless continuous mode published
+ * another in between.
+ *  */
+static ssize_t ms5611_sample_timestamp_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u32 pressure, temperature;
+	ktime_t timestamp;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	ms5611_read_cache(ms5611, &pressure, &temperature, &timestamp);
+	return sprintf(buf, "%lld", ktime_to_ns(timestamp));
+}
+
+/*
+ * Read compensated temperature and pressure, in 0.01 degC and 0.01 mbar.
+ *  */
+static ssize_t ms5611_compensated_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	u32 pressure = 0, temperature = 0;
+	s32 p, t;
+	int status;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	status = ms5611_get_sample(ms5611, &pressure, &temperature);
+	if (status != 0)
+		return status;
+
+	ms5611_compensate(&ms5611->coeffs, pressure, temperature, &p, &t);
+	return sprintf(buf, "%d %d", t, p);
+}
+
+/*
+ * Displays the acquisition mode, 0 for on-demand and 1 for continuous.
+ *  */
+static ssize_t ms5611_mode_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->mode);
+}
+
+/*
+ * Switch between on-demand and continuous acquisition. Entering continuous
+ * mode starts a cycle right away, leaving it lets the cycle in flight
+ * finish and the state machine go idle.
+ *  */
+static ssize_t ms5611_mode_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	switch (data) {
+	case MS5611_MODE_CONTINUOUS:
+		ms5611->mode = MS5611_MODE_CONTINUOUS;
+		ms5611_kick(ms5611);
+		break;
+	case MS5611_MODE_ON_DEMAND:
+		ms5611->mode = MS5611_MODE_ON_DEMAND;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+/*
+ * Displays the continuous sampling period in microseconds.
+ *  */
+static ssize_t ms5611_period_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->period_usec);
+}
+
+/*
+ * Set the continuous sampling period in microseconds. Takes effect when
+ * the next cycle is scheduled. A period shorter than both conversions
+ * makes the cycles run back to back.
+ *  */
+static ssize_t ms5611_period_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data == 0 || data > UINT_MAX)
+		return -EINVAL;
+
+	ms5611->period_usec = data;
+	return count;
+}
+
+/*
+ * Displays the number of samples that share one temperature conversion.
+ *  */
+static ssize_t ms5611_temp_decimation_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->temp_decimation);
+}
+
+/*
+ * Set the number of samples that share one temperature conversion, 1
+ * converts D2 for every sample.
+ *  */
+static ssize_t ms5611_temp_decimation_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data == 0 || data > MS5611_TEMP_DECIMATION_MAX)
+		return -EINVAL;
+
+	mutex_lock(&ms5611->lock);
+	ms5611->temp_decimation = data;
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Displays the age in microseconds after which the temperature is
+ * converted again regardless of the decimation, 0 if disabled.
+ *  */
+static ssize_t ms5611_temp_max_age_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->temp_max_age_usec);
+}
+
+static ssize_t ms5611_temp_max_age_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data > UINT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&ms5611->lock);
+	ms5611->temp_max_age_usec = data;
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Displays the oversampling mode, 0 manual, 1 follow the continuous period,
+ * 2 follow the target noise.
+ *  */
+static ssize_t ms5611_osr_mode_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->osr_mode);
+}
+
+/*
+ * Set the oversampling mode. In the automatic modes the pressure OSR is
+ * picked per conversion and writes to 'oversampling_pres' only set the
+ * starting point.
+ *  */
+static ssize_t ms5611_osr_mode_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data > MS5611_OSR_NOISE)
+		return -EINVAL;
+
+	mutex_lock(&ms5611->lock);
+	ms5611->osr_mode = data;
+	ms5611->noise_samples = 0;
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Displays the target RMS noise of the pressure in 0.001 mbar.
+ *  */
+static ssize_t ms5611_target_noise_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u", data->target_noise);
+}
+
+static ssize_t ms5611_target_noise_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data == 0 || data > USHRT_MAX)
+		return -EINVAL;
+
+	ms5611->target_noise = data;
+	return count;
+}
+
+/*
+ * Displays the estimated RMS noise of the pressure in 0.001 mbar.
+ *  */
+static ssize_t ms5611_noise_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+	unsigned int noise;
+
+	mutex_lock(&data->lock);
+	noise = ms5611_noise(data);
+	mutex_unlock(&data->lock);
+
+	return sprintf(buf, "%u", noise);
+}
+
+/*
+ * Displays 1 if ADC reads and convert commands are folded into one
+ * transfer, see ms5611_step().
+ *  */
+static ssize_t ms5611_pipelined_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d", data->pipelined);
+}
+
+/*
+ * Switch pipelining on or off. It needs plain I2C transfers, an SMBus
+ * only adapter can not have it.
+ *  */
+static ssize_t ms5611_pipelined_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int err;
+	unsigned long data;
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	err = strict_strtoul(buf, 10, &data);
+	if (err)
+		return err;
+
+	if (data > 1)
+		return -EINVAL;
+
+	if (data && !ms5611->can_pipeline)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&ms5611->lock);
+	ms5611->pipelined = data;
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Displays the bus time per sample in nanoseconds: latest, average and
+ * maximum. It covers every transaction of the sample, including the
+ * convert command of the next one when that was folded in. Writing
+ * anything resets the maximum.
+ *  */
+static ssize_t ms5611_bus_nsec_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+	s64 last, avg, max;
+
+	mutex_lock(&data->lock);
+	last = data->bus_last_nsec;
+	avg = data->bus_avg_nsec;
+	max = data->bus_max_nsec;
+	mutex_unlock(&data->lock);
+
+	return sprintf(buf, "%lld %lld %lld", last, avg, max);
+}
+
+static ssize_t ms5611_bus_nsec_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct ms5611_data *ms5611 = dev_get_drvdata(dev);
+
+	mutex_lock(&ms5611->lock);
+	ms5611->bus_max_nsec = 0;
+	mutex_unlock(&ms5611->lock);
+	return count;
+}
+
+/*
+ * Displays the achieved sample rate of the last second of acquisition in
+ * mHz, 0 when the sensor has been idle since.
+ *  */
+static ssize_t ms5611_rate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+	unsigned int rate = 0;
+
+	mutex_lock(&data->lock);
+	if (ktime_to_ns(ktime_sub(ktime_get(), data->window_start)) <
+			2 * MS5611_WINDOW_NSEC)
+		rate = data->rate_mhz;
+	mutex_unlock(&data->lock);
+
+	return sprintf(buf, "%u", rate);
+}
+
+/*
+ * Displays the bus time of the last second of acquisition in permille,
+ * of this sensor and of all sensors on its adapter.
+ *  */
+static ssize_t ms5611_bus_load_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = dev_get_drvdata(dev);
+	unsigned int load = 0, bus_load = 0;
+	ktime_t now = ktime_get();
+
+	mutex_lock(&data->lock);
+	if (ktime_to_ns(ktime_sub(now, data->window_start)) <
+			2 * MS5611_WINDOW_NSEC)
+		load = data->load;
+	if (ktime_to_ns(ktime_sub(now, data->bus->window_start)) <
+			2 * MS5611_WINDOW_NSEC)
+		bus_load = data->bus->load;
+	mutex_unlock(&data->lock);
+
+	return sprintf(buf, "%u %u", load, bus_load);
+}
+
+static DEVICE_ATTR(sens, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_sens_show, NULL);
+static DEVICE_ATTR(off, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_off_show, NULL);
+static DEVICE_ATTR(tcs, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_tcs_show, NULL);
+static DEVICE_ATTR(tco, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_tco_show, NULL);
+static DEVICE_ATTR(tref, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_tref_show, NULL);
+static DEVICE_ATTR(tempsens, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_tempsens_show, NULL);
+static DEVICE_ATTR(oversampling_temp, S_IRUGO|S_IWUSR|S_IWGRP,
+                ms5611_oversampling_temp_show, ms5611_oversampling_temp_store);
+static DEVICE_ATTR(oversampling_pres, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_oversampling_pres_show, ms5611_oversampling_pres_store);
+static DEVICE_ATTR(temp_decimation, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_temp_decimation_show, ms5611_temp_decimation_store);
+static DEVICE_ATTR(temp_max_age_usec, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_temp_max_age_show, ms5611_temp_max_age_store);
+static DEVICE_ATTR(osr_mode, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_osr_mode_show, ms5611_osr_mode_store);
+static DEVICE_ATTR(target_noise, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_target_noise_show, ms5611_target_noise_store);
+static DEVICE_ATTR(noise, S_IRUGO,
+		ms5611_noise_show, NULL);
+static DEVICE_ATTR(temp_and_pressure, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_read_temp_and_pressure, NULL);
+static DEVICE_ATTR(sample_timestamp_ns, S_IRUGO,
+		ms5611_sample_timestamp_show, NULL);
+static DEVICE_ATTR(compensated, S_IRUGO,
+		ms5611_compensated_show, NULL);
+static DEVICE_ATTR(mode, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_mode_show, ms5611_mode_store);
+static DEVICE_ATTR(period_usec, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_period_show, ms5611_period_store);
+static DEVICE_ATTR(pipelined, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_pipelined_show, ms5611_pipelined_store);
+static DEVICE_ATTR(bus_nsec, S_IRUGO|S_IWUSR|S_IWGRP,
+		ms5611_bus_nsec_show, ms5611_bus_nsec_store);
+static DEVICE_ATTR(rate_mhz, S_IRUGO,
+		ms5611_rate_show, NULL);
+static DEVICE_ATTR(bus_load, S_IRUGO,
+		ms5611_bus_load_show, NULL);
+
+static struct attribute *ms5611_attributes[] = {
+	&dev_attr_sens.attr,
+	&dev_attr_off.attr,
+	&dev_attr_tcs.attr,
+	&dev_attr_tco.attr,
+	&dev_attr_tref.attr,
+	&dev_attr_tempsens.attr,
+	&dev_attr_oversampling_temp.attr,
+	&dev_attr_oversampling_pres.attr,
+	&dev_attr_temp_decimation.attr,
+	&dev_attr_temp_max_age_usec.attr,
+	&dev_attr_osr_mode.attr,
+	&dev_attr_target_noise.attr,
+	&dev_attr_noise.attr,
+	&dev_attr_temp_and_pressure.attr,
+	&dev_attr_sample_timestamp_ns.attr,
+	&dev_attr_compensated.attr,
+	&dev_attr_mode.attr,
+	&dev_attr_period_usec.attr,
+	&dev_attr_pipelined.attr,
+	&dev_attr_bus_nsec.attr,
+	&dev_attr_rate_mhz.attr,
+	&dev_attr_bus_load.attr,
+	NULL
+};
+
+static struct attribute_group ms5611_attr_group = {
+	.attrs = ms5611_attributes,
+};
+
+/*
+ * Size of a record of @format, of a merged record with @merged. Returning
+ * zero if the format is unknown.
+ *  */
+static size_t ms5611_format_size(u32 format, int merged)
+{
+	switch (format) {
+	case MS5611_FORMAT_V1:
+		return merged ? MS5611_MERGED_RECORD_V1_SIZE :
+			MS5611_RECORD_V1_SIZE;
+	case MS5611_FORMAT_V2:
+		return merged ? sizeof(struct ms5611_merged_record) :
+			sizeof(struct ms5611_record);
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Bring a reader that fell more than a ring behind back into the ring,
+ * counting what it lost. Readers of different files do this at the same
+ * time, so the device total is atomic. Returning the current head.
+ *  */
+static unsigned long ms5611_ring_sync(struct ms5611_reader *reader)
+{
+	unsigned long head = ACCESS_ONCE(reader->data->ring_head);
+	unsigned long lost;
+
+	if (head - reader->tail >= MS5611_RING_SIZE) {
+		lost = head - reader->tail - (MS5611_RING_SIZE - 1);
+		reader->overruns += lost;
+		atomic64_add(lost, &reader->data->overruns);
+		reader->tail = head - (MS5611_RING_SIZE - 1);
+	}
+
+	return head;
+}
+
+static int ms5611_fop_open(struct inode *inode, struct file *file)
+{
+	struct ms5611_data *data = container_of(file->private_data,
+			struct ms5611_data, miscdev);
+	struct ms5611_reader *reader;
+
+	reader = kzalloc(sizeof(struct ms5611_reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->data = data;
+	reader->tail = ACCESS_ONCE(data->ring_head);
+	reader->watermark = 1;
+	reader->record_size = ms5611_format_size(MS5611_FORMAT_V1, 0);
+	mutex_init(&reader->lock);
+	kref_get(&data->kref);
+
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+}
+
+static int ms5611_fop_release(struct inode *inode, struct file *file)
+{
+	struct ms5611_reader *reader = file->private_data;
+
+	kref_put(&reader->data->kref, ms5611_free_data);
+	kfree(reader);
+	return 0;
+}
+
+/*
+ * Wait until the reader has 'need' records, or anything changed once in
+ * on-demand mode where each wait asks the state machine for one sample.
+ * Called with the reader lock held. Returning negative errno else zero.
+ *  */
+static int ms5611_ring_wait(struct ms5611_reader *reader, struct file *file,
+		size_t need)
+{
+	struct ms5611_data *data = reader->data;
+	unsigned long head, cycles;
+	int ret;
+
+	for (;;) {
+		cycles = ACCESS_ONCE(data->cycles);
+		head = ms5611_ring_sync(reader);
+		if (data->stopping)
+			return -ENODEV;
+		if (head - reader->tail >= need)
+			return 0;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		if (ACCESS_ONCE(data->mode) != MS5611_MODE_CONTINUOUS)
+			ms5611_kick(data);
+
+		ret = wait_event_interruptible(data->wait,
+				ACCESS_ONCE(data->ring_head) != head ||
+				ACCESS_ONCE(data->cycles) != cycles ||
+				data->stopping);
+		if (ret)
+			return ret;
+	}
+}
+
+/*
+ * Read whole records, in the format set with MS5611_IOC_SET_FORMAT.
+ * Blocks until the watermark, or the number of records asked for if that
+ * is smaller, is available.
+ *  */
+static ssize_t ms5611_fop_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct ms5611_reader *reader = file->private_data;
+	struct ms5611_data *data = reader->data;
+	struct ms5611_record rec;
+	size_t size = ACCESS_ONCE(reader->record_size);
+	size_t want = count / size, done = 0;
+	int ret;
+
+	if (want == 0)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&reader->lock))
+		return -ERESTARTSYS;
+
+	ret = ms5611_ring_wait(reader, file, min_t(size_t, want,
+				reader->watermark));
+	if (ret)
+		goto exit;
+
+	while (done < want) {
+		if (ms5611_ring_sync(reader) == reader->tail)
+			break;
+
+		smp_rmb();
+		rec = data->ring[reader->tail & (MS5611_RING_SIZE - 1)];
+		smp_rmb();
+
+		/* Overwritten while we copied it, the next sync drops it */
+		if (ACCESS_ONCE(data->ring_head) - reader->tail >=
+				MS5611_RING_SIZE)
+			continue;
+
+		if (copy_to_user(buf + done * size, &rec, size)) {
+			ret = -EFAULT;
+			break;
+		}
+
+		reader->tail++;
+		done++;
+	}
+
+exit:
+	mutex_unlock(&reader->lock);
+	return done ? done * size : ret;
+}
+
+static unsigned int ms5611_fop_poll(struct file *file, poll_table *wait)
+{
+	struct ms5611_reader *reader = file->private_data;
+	struct ms5611_data *data = reader->data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &data->wait, wait);
+
+	if (ACCESS_ONCE(data->ring_head) - reader->tail >= reader->watermark)
+		mask |= POLLIN | POLLRDNORM;
+	if (data->stopping)
+		mask |= POLLHUP;
+
+	return mask;
+}
+
+/*
+ * Collect the next 'batch->count' published samples after starting a
+ * burst of that many cycles, as records of 'batch->record_size' bytes.
+ * The file's own read position is not used. Stops early on a bus error
+ * once some samples were collected, with 'batch->done' telling how many.
+ * The cycles of the burst a caller leaving early did not use are taken
+ * back. Returning negative errno else zero.
+ *  */
+static int ms5611_read_batch(struct ms5611_data *data,
+		struct ms5611_batch *batch)
+{
+	char __user *out = (char __user *)(unsigned long)batch->records;
+	size_t size = batch->record_size;
+	struct ms5611_record rec;
+	unsigned long tail, head, cycles;
+	unsigned int added;
+	long ret = 0;
+
+	batch->done = 0;
+	if (batch->count == 0)
+		return 0;
+
+	tail = ACCESS_ONCE(data->ring_head);
+	added = ms5611_kick_burst(data, batch->count);
+
+	while (batch->done < batch->count) {
+		cycles = ACCESS_ONCE(data->cycles);
+		head = ACCESS_ONCE(data->ring_head);
+
+		if (head == tail) {
+			ret = wait_event_interruptible_timeout(data->wait,
+					ACCESS_ONCE(data->ring_head) != head ||
+					ACCESS_ONCE(data->cycles) != cycles ||
+					data->stopping, msecs_to_jiffies(
+						MS5611_CYCLE_TIMEOUT_MSEC));
+			if (ret < 0)
+				goto release;
+			if (ret == 0) {
+				ret = -ETIMEDOUT;
+				goto release;
+			}
+			if (data->stopping) {
+				ret = -ENODEV;
+				goto release;
+			}
+			if (ACCESS_ONCE(data->ring_head) == head &&
+					ACCESS_ONCE(data->error)) {
+				ret = ACCESS_ONCE(data->error);
+				goto release;
+			}
+			continue;
+		}
+
+		/* Fell a ring behind, the lost samples need new cycles */
+		if (head - tail >= MS5611_RING_SIZE) {
+			added += ms5611_kick_burst(data, head - tail -
+					(MS5611_RING_SIZE - 1));
+			tail = head - (MS5611_RING_SIZE - 1);
+		}
+
+		smp_rmb();
+		rec = data->ring[tail & (MS5611_RING_SIZE - 1)];
+		smp_rmb();
+		if (ACCESS_ONCE(data->ring_head) - tail >= MS5611_RING_SIZE)
+			continue;
+
+		if (copy_to_user(out + batch->done * size, &rec, size)) {
+			ret = -EFAULT;
+			goto release;
+		}
+
+		tail++;
+		batch->done++;
+	}
+
+	return 0;
+
+release:
+	ms5611_release_burst(data, min(added, batch->count - batch->done));
+	if (ret == -ENODEV || ret == -EFAULT)
+		return ret;
+	return batch->done ? 0 : ret;
+}
+
+static long ms5611_fop_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct ms5611_reader *reader = file->private_data;
+	struct ms5611_stats stats;
+	struct ms5611_batch batch;
+	struct ms5611_batch_v1 batch_v1;
+	u32 watermark, format;
+	size_t size;
+	int ret;
+
+	switch (cmd) {
+	case MS5611_IOC_SET_WATERMARK:
+		if (get_user(watermark, (u32 __user *)arg))
+			return -EFAULT;
+		if (watermark == 0 || watermark >= MS5611_RING_SIZE)
+			return -EINVAL;
+		reader->watermark = watermark;
+		return 0;
+
+	case MS5611_IOC_GET_STATS:
+		mutex_lock(&reader->lock);
+		ms5611_ring_sync(reader);
+		stats.overruns = reader->overruns;
+		stats.samples = ACCESS_ONCE(reader->data->samples);
+		mutex_unlock(&reader->lock);
+
+		if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+
+	case MS5611_IOC_SET_FORMAT:
+		if (get_user(format, (u32 __user *)arg))
+			return -EFAULT;
+		size = ms5611_format_size(format, 0);
+		if (!size)
+			return -EINVAL;
+		mutex_lock(&reader->lock);
+		reader->record_size = size;
+		mutex_unlock(&reader->lock);
+		return 0;
+
+	case MS5611_IOC_READ_BATCH:
+		if (copy_from_user(&batch, (void __user *)arg, sizeof(batch)))
+			return -EFAULT;
+		if (batch.count > MS5611_BATCH_MAX)
+			return -EINVAL;
+		size = batch.record_size;
+		if (size != MS5611_RECORD_V1_SIZE &&
+				size != sizeof(struct ms5611_record))
+			return -EINVAL;
+
+		ret = ms5611_read_batch(reader->data, &batch);
+		if (copy_to_user((void __user *)arg, &batch, sizeof(batch)))
+			return -EFAULT;
+		return ret;
+
+	case MS5611_IOC_READ_BATCH_V1:
+		if (copy_from_user(&batch_v1, (void __user *)arg,
+					sizeof(batch_v1)))
+			return -EFAULT;
+		if (batch_v1.count > MS5611_BATCH_MAX)
+			return -EINVAL;
+
+		batch.records = batch_v1.records;
+		batch.count = batch_v1.count;
+		batch.record_size = MS5611_RECORD_V1_SIZE;
+		ret = ms5611_read_batch(reader->data, &batch);
+		batch_v1.done = batch.done;
+		if (copy_to_user((void __user *)arg, &batch_v1,
+					sizeof(batch_v1)))
+			return -EFAULT;
+		return ret;
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+/*
+ * Map the ring read-only. Mapped readers follow the protocol described
+ * with 'struct ms5611_ring_header' and never enter the driver.
+ *  */
+static int ms5611_fop_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ms5611_reader *reader = file->private_data;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, reader->data->ring_area,
+			vma->vm_pgoff);
+}
+
+static const struct file_operations ms5611_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ms5611_fop_open,
+	.release	= ms5611_fop_release,
+	.read		= ms5611_fop_read,
+	.poll		= ms5611_fop_poll,
+	.unlocked_ioctl	= ms5611_fop_ioctl,
+	.mmap		= ms5611_fop_mmap,
+	.llseek		= no_llseek,
+};
+
+/*
+ * Bring a merged reader that fell more than a ring behind back into the
+ * ring. Called with the merge lock held.
+ *  */
+static void ms5611_merge_sync(struct ms5611_merge_reader *reader)
+{
+	unsigned long head = ms5611_merge.head;
+
+	if (head - reader->tail > MS5611_MERGE_SIZE) {
+		reader->overruns += head - reader->tail - MS5611_MERGE_SIZE;
+		reader->tail = head - MS5611_MERGE_SIZE;
+	}
+}
+
+static int ms5611_merge_open(struct inode *inode, struct file *file)
+{
+	struct ms5611_merge_reader *reader;
+
+	reader = kzalloc(sizeof(struct ms5611_merge_reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	mutex_init(&reader->lock);
+	reader->record_size = ms5611_format_size(MS5611_FORMAT_V1, 1);
+	spin_lock(&ms5611_merge.lock);
+	reader->tail = ms5611_merge.stable;
+	spin_unlock(&ms5611_merge.lock);
+
+	file->private_data = reader;
+	return nonseekable_open(inode, file);
+}
+
+static int ms5611_merge_release_file(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+/*
+ * Copy @n merged records to @buf in the format of @size. In format 1 the
+ * record is cut short before 'boottime_ns' and the sensor follows it.
+ *  */
+static int ms5611_merge_copy(char __user *buf,
+		const struct ms5611_merged_record *recs, size_t n, size_t size)
+{
+	size_t i;
+
+	if (size == sizeof(*recs))
+		return copy_to_user(buf, recs, n * size) ? -EFAULT : 0;
+
+	for (i = 0; i < n; i++, buf += size)
+		if (copy_to_user(buf, &recs[i].rec, MS5611_RECORD_V1_SIZE) ||
+				copy_to_user(buf + MS5611_RECORD_V1_SIZE,
+					&recs[i].sensor, size -
+					MS5611_RECORD_V1_SIZE))
+			return -EFAULT;
+	return 0;
+}
+
+/*
+ * Read whole merged records, in the format set with MS5611_IOC_SET_FORMAT.
+ * Blocks until at least one is released, the sensors are not kicked, so
+ * on-demand sensors only show up here when somebody reads them.
+ *  */
+static ssize_t ms5611_merge_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct ms5611_merge *merge = &ms5611_merge;
+	struct ms5611_merge_reader *reader = file->private_data;
+	struct ms5611_merged_record recs[8];
+	size_t size = ACCESS_ONCE(reader->record_size);
+	size_t want = count / size, done = 0, n;
+	int ret = 0;
+
+	if (want == 0)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&reader->lock))
+		return -ERESTARTSYS;
+
+	while (done < want) {
+		spin_lock(&merge->lock);
+		ms5611_merge_sync(reader);
+		for (n = 0; n < ARRAY_SIZE(recs) && done + n < want &&
+				reader->tail != merge->stable; n++)
+			recs[n] = merge->ring[reader->tail++ &
+				(MS5611_MERGE_SIZE - 1)];
+		spin_unlock(&merge->lock);
+
+		if (n == 0) {
+			if (done)
+				break;
+			if (file->f_flags & O_NONBLOCK) {
+				ret = -EAGAIN;
+				break;
+			}
+			ret = wait_event_interruptible(merge->wait,
+					ACCESS_ONCE(merge->stable) !=
+					reader->tail);
+			if (ret)
+				break;
+			continue;
+		}
+
+		ret = ms5611_merge_copy(buf + done * size, recs, n, size);
+		if (ret)
+			break;
+		done += n;
+	}
+
+	mutex_unlock(&reader->lock);
+	return done ? done * size : ret;
+}
+
+static unsigned int ms5611_merge_poll(struct file *file, poll_table *wait)
+{
+	struct ms5611_merge_reader *reader = file->private_data;
+
+	poll_wait(file, &ms5611_merge.wait, wait);
+
+	if (ACCESS_ONCE(ms5611_merge.stable) != reader->tail)
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static long ms5611_merge_ioctl(struct file *file, unsigned int cmd,
+		unsigned long arg)
+{
+	struct ms5611_merge_reader *reader = file->private_data;
+	struct ms5611_stats stats;
+	u32 format;
+	size_t size;
+
+	if (cmd == MS5611_IOC_SET_FORMAT) {
+		if (get_user(format, (u32 __user *)arg))
+			return -EFAULT;
+		size = ms5611_format_size(format, 1);
+		if (!size)
+			return -EINVAL;
+		mutex_lock(&reader->lock);
+		reader->record_size = size;
+		mutex_unlock(&reader->lock);
+		return 0;
+	}
+
+	if (cmd != MS5611_IOC_GET_STATS)
+		return -ENOTTY;
+
+	mutex_lock(&reader->lock);
+	spin_lock(&ms5611_merge.lock);
+	ms5611_merge_sync(reader);
+	stats.overruns = reader->overruns;
+	stats.samples = ms5611_merge.head;
+	spin_unlock(&ms5611_merge.lock);
+	mutex_unlock(&reader->lock);
+
+	if (copy_to_user((void __user *)arg, &stats, sizeof(stats)))
+		return -EFAULT;
+	return 0;
+}
+
+static const struct file_operations ms5611_merge_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ms5611_merge_open,
+	.release	= ms5611_merge_release_file,
+	.read		= ms5611_merge_read,
+	.poll		= ms5611_merge_poll,
+	.unlocked_ioctl	= ms5611_merge_ioctl,
+	.llseek		= no_llseek,
+};
+
+#ifdef MS5611_IIO
+/*
+ * IIO front end, on the staging IIO core of this kernel. The channels
+ * carry the compensated values, 0.01 mbar and 0.01 degC, which the scale
+ * turns into kPa and milli degC, in sysfs and in the buffer alike. This
+ * IIO has no pressure channel type, so pressure is a voltage channel
+ * named "pressure". The ADC codes stay in 'temp_and_pressure'.
+ *
+ * The buffer is a software ring filled by the trigger handler. Any
+ * trigger can drive it, the device's own trigger fires on every sample of
+ * continuous mode. The handler only copies the cached sample, it runs in
+ * the step work for the own trigger and must never wait for a cycle, so
+ * acquisition is held continuous while the buffer or the trigger is in
+ * use, see ms5611_iio_hold().
+ *  */
+enum { MS5611_SCAN_PRESSURE, MS5611_SCAN_TEMP, MS5611_SCAN_TIMESTAMP };
+
+#define MS5611_IIO_CHANNEL(_type, _name, _index) {			\
+	.type = _type,							\
+	.extend_name = _name,						\
+	.info_mask = IIO_CHAN_INFO_RAW_SEPARATE_BIT |			\
+		IIO_CHAN_INFO_SCALE_SEPARATE_BIT,			\
+	.address = _index,						\
+	.scan_index = _index,						\
+	.scan_type = IIO_ST('s', 32, 32, 0),				\
+}
+
+static const struct iio_chan_spec ms5611_iio_channels[] = {
+	MS5611_IIO_CHANNEL(IIO_VOLTAGE, "pressure", MS5611_SCAN_PRESSURE),
+	MS5611_IIO_CHANNEL(IIO_TEMP, NULL, MS5611_SCAN_TEMP),
+	IIO_CHAN_SOFT_TIMESTAMP(MS5611_SCAN_TIMESTAMP),
+};
+
+static struct ms5611_data *ms5611_iio_data(struct iio_dev *indio_dev)
+{
+	return *(struct ms5611_data **)iio_priv(indio_dev);
+}
+
+/*
+ * Hold acquisition continuous while @on, for the buffer and the trigger.
+ * The first hold saves the mode and the last release puts it back.
+ *  */
+static void ms5611_iio_hold(struct ms5611_data *data, bool on)
+{
+	mutex_lock(&data->lock);
+	if (on && data->iio_holds++ == 0) {
+		data->iio_mode = data->mode;
+		data->mode = MS5611_MODE_CONTINUOUS;
+		ms5611_kick(data);
+	} else if (!on && data->iio_holds && --data->iio_holds == 0) {
+		data->mode = data->iio_mode;
+	}
+	mutex_unlock(&data->lock);
+}
+
+static int ms5611_iio_read_raw(struct iio_dev *indio_dev,
+		struct iio_chan_spec const *chan, int *val, int *val2,
+		long mask)
+{
+	struct ms5611_data *data = ms5611_iio_data(indio_dev);
+	u32 pressure, temperature;
+	s32 p, t;
+	int status;
+
+	switch (mask) {
+	case IIO_CHAN_INFO_RAW:
+		status = ms5611_get_sample(data, &pressure, &temperature);
+		if (status != 0)
+			return status;
+
+		ms5611_compensate(&data->coeffs, pressure, temperature,
+				&p, &t);
+		*val = chan->address == MS5611_SCAN_PRESSURE ? p : t;
+		return IIO_VAL_INT;
+
+	case IIO_CHAN_INFO_SCALE:
+		if (chan->address == MS5611_SCAN_PRESSURE) {
+			*val = 0;
+			*val2 = 1000;
+			return IIO_VAL_INT_PLUS_MICRO;
+		}
+		*val = 10;
+		return IIO_VAL_INT;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * Displays the oversampling rate of the channel in the attribute address.
+ *  */
+static ssize_t ms5611_iio_osr_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct ms5611_data *data = ms5611_iio_data(dev_get_drvdata(dev));
+	struct iio_dev_attr *this_attr = to_iio_dev_attr(attr);
 
-	status = ms5611_update_raw_data(ms5611->ms5611_client,
-			ms5611->pressure_osr, &pressure);
-	if (status != 0)
-		return status;
+	return sprintf(buf, "%u\n", this_attr->address ==
+			MS5611_SCAN_PRESSURE ? data->pressure_osr->rate :
+			data->temp_osr->rate);
+}
 
-	status = ms5611_update_raw_data(ms5611->ms5611_client,
-			ms5611->temp_osr, &temperature);
-	if (status != 0)
-		return status;
+/*
+ * Set the oversampling rate of the channel in the attribute address, one
+ * of 'oversampling_ratio_available'.
+ *  */
+static ssize_t ms5611_iio_osr_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct ms5611_data *data = ms5611_iio_data(dev_get_drvdata(dev));
+	struct iio_dev_attr *this_attr = to_iio_dev_attr(attr);
+	unsigned long val;
+	int err;
 
-	return sprintf(buf, "%u %u", temperature, pressure);
-}
+	err = strict_strtoul(buf, 10, &val);
+	if (err)
+		return err;
 
-static DEVICE_ATTR(sens, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_sens_show, NULL);
-static DEVICE_ATTR(off, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_off_show, NULL);
-static DEVICE_ATTR(tcs, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_tcs_show, NULL);
-static DEVICE_ATTR(tco, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_tco_show, NULL);
-static DEVICE_ATTR(tref, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_tref_show, NULL);
-static DEVICE_ATTR(tempsens, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_tempsens_show, NULL);
-static DEVICE_ATTR(oversampling_temp, S_IRUGO|S_IWUSR|S_IWGRP,
-                ms5611_oversampling_temp_show, ms5611_oversampling_temp_store);
-static DEVICE_ATTR(oversampling_pres, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_oversampling_pres_show, ms5611_oversampling_pres_store);
-static DEVICE_ATTR(temp_and_pressure, S_IRUGO|S_IWUSR|S_IWGRP,
-		ms5611_read_temp_and_pressure, NULL);
+	mutex_lock(&data->lock);
+	if (this_attr->address == MS5611_SCAN_PRESSURE)
+		err = update_oversampling(ms5611_avail_pressure_osr,
+				&data->pressure_osr, val);
+	else
+		err = update_oversampling(ms5611_avail_temp_osr,
+				&data->temp_osr, val);
+	if (!err)
+		ms5611_ring_set_osr(data);
+	mutex_unlock(&data->lock);
+
+	return err < 0 ? err : count;
+}
 
-static struct attribute *ms5611_attributes[] = {
-	&dev_attr_sens.attr,
-	&dev_attr_off.attr,
-	&dev_attr_tcs.attr,
-	&dev_attr_tco.attr,
-	&dev_attr_tref.attr,
-	&dev_attr_tempsens.attr,
-	&dev_attr_oversampling_temp.attr,
-	&dev_attr_oversampling_pres.attr,
-	&dev_attr_temp_and_pressure.attr,
+static IIO_DEVICE_ATTR(in_voltage_pressure_oversampling_ratio,
+		S_IRUGO | S_IWUSR, ms5611_iio_osr_show, ms5611_iio_osr_store,
+		MS5611_SCAN_PRESSURE);
+static IIO_DEVICE_ATTR(in_temp_oversampling_ratio, S_IRUGO | S_IWUSR,
+		ms5611_iio_osr_show, ms5611_iio_osr_store, MS5611_SCAN_TEMP);
+static IIO_CONST_ATTR(oversampling_ratio_available, "256 512 1024 2048 4096");
+
+static struct attribute *ms5611_iio_attributes[] = {
+	&iio_dev_attr_in_voltage_pressure_oversampling_ratio.dev_attr.attr,
+	&iio_dev_attr_in_temp_oversampling_ratio.dev_attr.attr,
+	&iio_const_attr_oversampling_ratio_available.dev_attr.attr,
 	NULL
 };
 
-static struct attribute_group ms5611_attr_group = {
-	.attrs = ms5611_attributes,
+static const struct attribute_group ms5611_iio_attr_group = {
+	.attrs = ms5611_iio_attributes,
+};
+
+static const struct iio_info ms5611_iio_info = {
+	.attrs = &ms5611_iio_attr_group,
+	.read_raw = &ms5611_iio_read_raw,
+	.driver_module = THIS_MODULE,
+};
+
+/*
+ * Bottom half of the trigger. Pushes the enabled channels of the cached
+ * sample packed in scan order, dated at the middle of its D1 conversion
+ * on the clock of IIO.
+ *  */
+static irqreturn_t ms5611_iio_trigger_handler(int irq, void *p)
+{
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct ms5611_data *data = ms5611_iio_data(indio_dev);
+	struct iio_buffer *buffer = indio_dev->buffer;
+	struct {
+		s32 chan[2];
+		s64 timestamp __aligned(8);
+	} scan;
+	u32 pressure, temperature;
+	ktime_t timestamp;
+	s32 vals[2];
+	int bit, i = 0;
+
+	if (!ACCESS_ONCE(data->samples))
+		goto done;
+
+	ms5611_read_cache(data, &pressure, &temperature, &timestamp);
+	ms5611_compensate(&data->coeffs, pressure, temperature,
+			&vals[MS5611_SCAN_PRESSURE], &vals[MS5611_SCAN_TEMP]);
+
+	memset(&scan, 0, sizeof(scan));
+	for_each_set_bit(bit, indio_dev->active_scan_mask,
+			indio_dev->masklength)
+		if (bit < ARRAY_SIZE(vals))
+			scan.chan[i++] = vals[bit];
+
+	scan.timestamp = ktime_to_ns(ktime_add(timestamp,
+				ktime_sub(ktime_get_real(), ktime_get())));
+	buffer->access->store_to(buffer, (u8 *)&scan, scan.timestamp);
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+	return IRQ_HANDLED;
+}
+
+static int ms5611_iio_postenable(struct iio_dev *indio_dev)
+{
+	ms5611_iio_hold(ms5611_iio_data(indio_dev), true);
+	return iio_triggered_buffer_postenable(indio_dev);
+}
+
+static int ms5611_iio_predisable(struct iio_dev *indio_dev)
+{
+	int err = iio_triggered_buffer_predisable(indio_dev);
+
+	ms5611_iio_hold(ms5611_iio_data(indio_dev), false);
+	return err;
+}
+
+static const struct iio_buffer_setup_ops ms5611_iio_buffer_ops = {
+	.preenable = &iio_sw_buffer_preenable,
+	.postenable = &ms5611_iio_postenable,
+	.predisable = &ms5611_iio_predisable,
+};
+
+/*
+ * The own trigger only fires in continuous mode, so it holds it while a
+ * consumer is attached, whichever device that is.
+ *  */
+static int ms5611_iio_set_trigger_state(struct iio_trigger *trig, bool state)
+{
+	ms5611_iio_hold(trig->private_data, state);
+	return 0;
+}
+
+static const struct iio_trigger_ops ms5611_iio_trigger_ops = {
+	.owner = THIS_MODULE,
+	.set_trigger_state = &ms5611_iio_set_trigger_state,
+};
+
+/* Called by the step work after each published sample */
+static void ms5611_iio_notify(struct ms5611_data *data)
+{
+	if (data->iio_trig)
+		iio_trigger_poll_chained(data->iio_trig, 0);
+}
+
+static int ms5611_iio_register(struct ms5611_data *data)
+{
+	struct iio_dev *indio_dev;
+	int err;
+
+	indio_dev = iio_allocate_device(sizeof(data));
+	if (!indio_dev)
+		return -ENOMEM;
+
+	*(struct ms5611_data **)iio_priv(indio_dev) = data;
+	indio_dev->dev.parent = data->dev;
+	indio_dev->name = SENSOR_NAME;
+	indio_dev->info = &ms5611_iio_info;
+	indio_dev->modes = INDIO_DIRECT_MODE;
+	indio_dev->channels = ms5611_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(ms5611_iio_channels);
+
+	indio_dev->buffer = iio_sw_rb_allocate(indio_dev);
+	if (!indio_dev->buffer) {
+		err = -ENOMEM;
+		goto exit_free;
+	}
+
+	indio_dev->pollfunc = iio_alloc_pollfunc(NULL,
+			&ms5611_iio_trigger_handler, IRQF_ONESHOT, indio_dev,
+			"%s_consumer%d", indio_dev->name, indio_dev->id);
+	if (!indio_dev->pollfunc) {
+		err = -ENOMEM;
+		goto exit_ring;
+	}
+	indio_dev->setup_ops = &ms5611_iio_buffer_ops;
+	indio_dev->modes |= INDIO_BUFFER_TRIGGERED;
+
+	data->iio_trig = iio_allocate_trigger("%s-dev%d", indio_dev->name,
+			indio_dev->id);
+	if (!data->iio_trig) {
+		err = -ENOMEM;
+		goto exit_pollfunc;
+	}
+	data->iio_trig->dev.parent = data->dev;
+	data->iio_trig->ops = &ms5611_iio_trigger_ops;
+	data->iio_trig->private_data = data;
+
+	err = iio_trigger_register(data->iio_trig);
+	if (err < 0)
+		goto exit_trig;
+
+	err = iio_buffer_register(indio_dev, ms5611_iio_channels,
+			ARRAY_SIZE(ms5611_iio_channels));
+	if (err < 0)
+		goto exit_trig_unregister;
+
+	err = iio_device_register(indio_dev);
+	if (err < 0)
+		goto exit_buffer_unregister;
+
+	data->indio_dev = indio_dev;
+	return 0;
+
+exit_buffer_unregister:
+	iio_buffer_unregister(indio_dev);
+exit_trig_unregister:
+	iio_trigger_unregister(data->iio_trig);
+exit_trig:
+	iio_free_trigger(data->iio_trig);
+	data->iio_trig = NULL;
+exit_pollfunc:
+	iio_dealloc_pollfunc(indio_dev->pollfunc);
+exit_ring:
+	iio_sw_rb_free(indio_dev->buffer);
+exit_free:
+	iio_free_device(indio_dev);
+	return err;
+}
+
+/*
+ * The trigger is left registered until after the state machine stopped,
+ * the step work fires it, see ms5611_remove().
+ *  */
+static void ms5611_iio_unregister(struct ms5611_data *data)
+{
+	iio_device_unregister(data->indio_dev);
+	iio_buffer_unregister(data->indio_dev);
+}
+
+static void ms5611_iio_free(struct ms5611_data *data)
+{
+	iio_trigger_unregister(data->iio_trig);
+	iio_free_trigger(data->iio_trig);
+	data->iio_trig = NULL;
+	iio_dealloc_pollfunc(data->indio_dev->pollfunc);
+	iio_sw_rb_free(data->indio_dev->buffer);
+	iio_free_device(data->indio_dev);
+}
+#else
+static void ms5611_iio_notify(struct ms5611_data *data) { }
+static int ms5611_iio_register(struct ms5611_data *data) { return 0; }
+static void ms5611_iio_unregister(struct ms5611_data *data) { }
+static void ms5611_iio_free(struct ms5611_data *data) { }
+#endif
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * debugfs, a directory per device under ms5611/ with the counters and the
+ * two latency histograms. A histogram is a line per non-empty bucket, the
+ * lower bound in ns and the count; a bucket spans a power of two.
+ *  */
+static struct dentry *ms5611_debugfs_root;
+
+static void ms5611_hist_show(struct seq_file *s, const u64 *hist)
+{
+	int i;
+
+	for (i = 0; i < MS5611_HIST_SIZE; i++)
+		if (hist[i])
+			seq_printf(s, "%llu %llu\n", 1ULL << i,
+					(unsigned long long)hist[i]);
+}
+
+static int ms5611_bus_hist_show(struct seq_file *s, void *unused)
+{
+	struct ms5611_data *data = s->private;
+
+	ms5611_hist_show(s, data->bus_hist);
+	return 0;
+}
+
+static int ms5611_sample_hist_show(struct seq_file *s, void *unused)
+{
+	struct ms5611_data *data = s->private;
+
+	ms5611_hist_show(s, data->sample_hist);
+	return 0;
+}
+
+/* Open files hold the device like those of the sample stream */
+static int ms5611_hist_open(struct inode *inode, struct file *file,
+		int (*show)(struct seq_file *, void *))
+{
+	struct ms5611_data *data = inode->i_private;
+	int err;
+
+	kref_get(&data->kref);
+	err = single_open(file, show, data);
+	if (err < 0)
+		kref_put(&data->kref, ms5611_free_data);
+
+	return err;
+}
+
+static int ms5611_bus_hist_open(struct inode *inode, struct file *file)
+{
+	return ms5611_hist_open(inode, file, ms5611_bus_hist_show);
+}
+
+static int ms5611_sample_hist_open(struct inode *inode, struct file *file)
+{
+	return ms5611_hist_open(inode, file, ms5611_sample_hist_show);
+}
+
+static int ms5611_hist_release(struct inode *inode, struct file *file)
+{
+	struct ms5611_data *data = inode->i_private;
+
+	single_release(inode, file);
+	kref_put(&data->kref, ms5611_free_data);
+	return 0;
+}
+
+static const struct file_operations ms5611_bus_hist_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ms5611_bus_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= ms5611_hist_release,
+};
+
+static const struct file_operations ms5611_sample_hist_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ms5611_sample_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= ms5611_hist_release,
 };
 
+/*
+ * The counters are atomic64_t, a plain u64 read on a 32-bit CPU can tear
+ * while the step work updates it.
+ *  */
+static int ms5611_counter_get(void *arg, u64 *val)
+{
+	*val = atomic64_read(arg);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(ms5611_counter_fops, ms5611_counter_get, NULL,
+		"%llu\n");
+
+/*
+ * Failing to create the directory is not fatal, the device just has no
+ * debugfs entries.
+ *  */
+static void ms5611_debugfs_init(struct ms5611_data *data)
+{
+	struct dentry *dir;
+
+	if (IS_ERR_OR_NULL(ms5611_debugfs_root))
+		return;
+
+	dir = debugfs_create_dir(data->name, ms5611_debugfs_root);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_file("conversions", S_IRUGO, dir, &data->conversions,
+			&ms5611_counter_fops);
+	debugfs_create_file("bus_errors", S_IRUGO, dir, &data->bus_errors,
+			&ms5611_counter_fops);
+	debugfs_create_file("retries", S_IRUGO, dir, &data->retries,
+			&ms5611_counter_fops);
+	debugfs_create_file("overruns", S_IRUGO, dir, &data->overruns,
+			&ms5611_counter_fops);
+	debugfs_create_file("dropped", S_IRUGO, dir, &data->dropped,
+			&ms5611_counter_fops);
+	debugfs_create_file("bus_latency_hist", S_IRUGO, dir, data,
+			&ms5611_bus_hist_fops);
+	debugfs_create_file("sample_latency_hist", S_IRUGO, dir, data,
+			&ms5611_sample_hist_fops);
+	data->debugfs = dir;
+}
+
+static void ms5611_debugfs_exit(struct ms5611_data *data)
+{
+	debugfs_remove_recursive(data->debugfs);
+}
+
+static void ms5611_debugfs_register(void)
+{
+	ms5611_debugfs_root = debugfs_create_dir("ms5611", NULL);
+}
+
+static void ms5611_debugfs_unregister(void)
+{
+	debugfs_remove_recursive(ms5611_debugfs_root);
+}
+#else
+static void ms5611_debugfs_init(struct ms5611_data *data) { }
+static void ms5611_debugfs_exit(struct ms5611_data *data) { }
+static void ms5611_debugfs_register(void) { }
+static void ms5611_debugfs_unregister(void) { }
+#endif
+
 /*
  * ms5611 initialization.
- * @client: Handle to slave device.
+ * @data: The device.
  *
  * The CMD_RST command is sent first. And then reads the check value.
  * Set the temperature and atmospheric pressure sampling rate to 4096.
  * Returning negative errno else zero on success.
  *   */
-static int ms5611_init_client(struct i2c_client *client)
+static int ms5611_init_client(struct ms5611_data *data)
 {
 	int status;
-	struct ms5611_data *data = i2c_get_clientdata(client);
 
-	status = i2c_smbus_write_byte(client, CMD_RST);
+	status = data->tf->command(data, CMD_RST);
 	if (status < 0) {
 		printk(KERN_INFO "Error: ms561101ba reset\n");
 		goto exit;
 	}
 	usleep_range(3000, 4000);
 
-	status = ms5611_read_calibration_data(client);
+	status = ms5611_read_calibration_data(data);
 	if (status < 0)
 		goto exit;
 
 	data->temp_osr = &ms5611_avail_temp_osr[4];
 	data->pressure_osr = &ms5611_avail_pressure_osr[4];
+	data->mode = MS5611_MODE_ON_DEMAND;
+	data->period_usec = MS5611_DEFAULT_PERIOD_USEC;
+	data->temp_decimation = 1;
+	data->osr_mode = MS5611_OSR_MANUAL;
+	data->target_noise = 12;	/* Datasheet RMS noise at OSR 4096 */
+	data->pipelined = data->can_pipeline;
 
 exit:
 	return status;
 }
 
-static int __devinit ms5611_probe(struct i2c_client *client,
-			 const struct i2c_device_id *id)
+/*
+ * Set up a sensor found on any bus.
+ * @dev: The I2C client or SPI device, its driver data is set to the sensor.
+ * @tf: How to talk to it.
+ * @sensor_id: See struct ms5611_merged_record.
+ * @can_pipeline: Whether the bus can do 'tf->read_command'.
+ *
+ * Returning negative errno else zero on success.
+ *  */
+static int __devinit ms5611_probe(struct device *dev,
+		const struct ms5611_transport *tf, u32 sensor_id,
+		int can_pipeline)
 {
 	int err = 0;
 	struct ms5611_data *data;
-	struct input_dev *dev;
-
-	/* Check whether the client's adapter supports the I2C interface */
-	if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_BYTE
-					| I2C_FUNC_SMBUS_READ_WORD_DATA
-					| I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
-		printk(KERN_INFO "i2c_check_functionality error\n");
-		err = -EOPNOTSUPP;
-		goto exit;
-	}
+	struct input_dev *input;
 
 	data = kzalloc(sizeof(struct ms5611_data), GFP_KERNEL);
 	if (!data) {
@@ -462,60 +3213,142 @@ static int __devinit ms5611_probe(struct i2c_client *client,
 		goto exit;
 	}
 
-	i2c_set_clientdata(client, data);
-	data->ms5611_client = client;
+	dev_set_drvdata(dev, data);
+	data->dev = dev;
+	data->tf = tf;
+	data->sensor_id = sensor_id;
+	data->can_pipeline = can_pipeline;
+	kref_init(&data->kref);
+	atomic64_set(&data->conversions, 0);
+	atomic64_set(&data->bus_errors, 0);
+	atomic64_set(&data->retries, 0);
+	atomic64_set(&data->overruns, 0);
+	atomic64_set(&data->dropped, 0);
 	mutex_init(&data->lock);
+	seqlock_init(&data->cache_lock);
+	spin_lock_init(&data->state_lock);
+	init_waitqueue_head(&data->wait);
+	INIT_LIST_HEAD(&data->sensors);
+	INIT_WORK(&data->step, ms5611_step);
+	hrtimer_init(&data->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	data->timer.function = ms5611_timer;
+
+	err = ms5611_init_client(data);
+	if (err != 0)
+		goto exit_free;
 
-	err = ms5611_init_client(data->ms5611_client);
+	err = ms5611_ring_alloc(data);
 	if (err != 0)
 		goto exit_free;
 
-	dev = input_allocate_device();
-	if (!dev) {
-		printk(KERN_ERR "ms5611 input_allocate_device fail\n");
+	data->bus = ms5611_bus_get(sensor_id >> 8);
+	if (!data->bus) {
 		err = -ENOMEM;
 		goto exit_free;
 	}
-	dev->name = SENSOR_NAME;
-	dev->id.bustype = BUS_I2C;
+	data->wq = data->bus->wq;
+	ms5611_merge_add(data);
+
+	input = input_allocate_device();
+	if (!input) {
+		printk(KERN_ERR "ms5611 input_allocate_device fail\n");
+		err = -ENOMEM;
+		goto exit_wq;
+	}
+	input->name = SENSOR_NAME;
+	input->id.bustype = tf->bustype;
 
-	input_set_drvdata(dev, data);
+	input_set_drvdata(input, data);
 
-	err = input_register_device(dev);
+	err = input_register_device(input);
 	if (err < 0) {
 		printk(KERN_INFO "ms5611 input_register_device fail\n");
-		input_free_device(dev);
-		goto exit_free;
+		input_free_device(input);
+		goto exit_wq;
 	}
 
-	data->input = dev;
+	data->input = input;
 	err = sysfs_create_group(&data->input->dev.kobj, &ms5611_attr_group);
 	if (err < 0)
 		goto error_sysfs;
 
-	dev_info(&data->ms5611_client->dev,
-			"Successfully initialized ms561101ba!\n");
+	if (sensor_id & MS5611_SENSOR_SPI)
+		snprintf(data->name, sizeof(data->name), "ms5611-spi%u.%u",
+				(sensor_id & ~MS5611_SENSOR_SPI) >> 8,
+				sensor_id & 0xff);
+	else
+		snprintf(data->name, sizeof(data->name), "ms5611-%u-%02x",
+				sensor_id >> 8, sensor_id & 0xff);
+	data->miscdev.minor = MISC_DYNAMIC_MINOR;
+	data->miscdev.name = data->name;
+	data->miscdev.fops = &ms5611_fops;
+	data->miscdev.parent = dev;
+	err = misc_register(&data->miscdev);
+	if (err < 0)
+		goto error_misc;
+
+	err = ms5611_iio_register(data);
+	if (err < 0)
+		goto error_iio;
+
+	ms5611_debugfs_init(data);
+	dev_info(dev, "Successfully initialized ms561101ba!\n");
 	return 0;
 
+error_iio:
+	misc_deregister(&data->miscdev);
+error_misc:
+	sysfs_remove_group(&data->input->dev.kobj, &ms5611_attr_group);
 error_sysfs:
 	input_unregister_device(data->input);
+exit_wq:
+	ms5611_merge_del(data);
+	ms5611_bus_put(data->bus);
 exit_free:
-	kfree(data);
+	kref_put(&data->kref, ms5611_free_data);
 exit:
 	return err;
 }
 
-static int __devexit ms5611_remove(struct i2c_client *client)
+static int __devexit ms5611_remove(struct device *dev)
 {
-	struct ms5611_data *data = i2c_get_clientdata(client);
-
-	sysfs_remove_group(&client->dev.kobj, &ms5611_attr_group);
+	struct ms5611_data *data = dev_get_drvdata(dev);
+
+	ms5611_debugfs_exit(data);
+	ms5611_iio_unregister(data);
+	misc_deregister(&data->miscdev);
+	sysfs_remove_group(&data->input->dev.kobj, &ms5611_attr_group);
+	ms5611_stop(data);
+	ms5611_merge_del(data);
+	ms5611_bus_put(data->bus);
+	ms5611_iio_free(data);
 	input_unregister_device(data->input);
-	kfree(data);
+	kref_put(&data->kref, ms5611_free_data);
 
 	return 0;
 }
 
+static int __devinit ms5611_i2c_probe(struct i2c_client *client,
+			 const struct i2c_device_id *id)
+{
+	/* Check whether the client's adapter supports the I2C interface */
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_WRITE_BYTE
+					| I2C_FUNC_SMBUS_READ_I2C_BLOCK)) {
+		printk(KERN_INFO "i2c_check_functionality error\n");
+		return -EOPNOTSUPP;
+	}
+
+	return ms5611_probe(&client->dev, &ms5611_i2c_transport,
+			i2c_adapter_id(client->adapter) << 8 | client->addr,
+			i2c_check_functionality(client->adapter,
+				I2C_FUNC_I2C));
+}
+
+static int __devexit ms5611_i2c_remove(struct i2c_client *client)
+{
+	return ms5611_remove(&client->dev);
+}
+
 static const struct i2c_device_id ms5611_id[] = {
 	{SENSOR_NAME, 0},
 	{}
@@ -529,18 +3362,120 @@ static struct i2c_driver ms561101ba_driver = {
 	},
 	.class		= I2C_CLASS_HWMON,
 	.id_table	= ms5611_id,
-	.probe		= ms5611_probe,
-	.remove		= __devexit_p(ms5611_remove),
+	.probe		= ms5611_i2c_probe,
+	.remove		= __devexit_p(ms5611_i2c_remove),
+};
+
+#ifdef CONFIG_SPI_MASTER
+static int __devinit ms5611_spi_probe(struct spi_device *spi)
+{
+	int err;
+
+	spi->mode = SPI_MODE_0;
+	spi->bits_per_word = 8;
+	if (!spi->max_speed_hz || spi->max_speed_hz > 20000000)
+		spi->max_speed_hz = 20000000;
+	err = spi_setup(spi);
+	if (err < 0)
+		return err;
+
+	return ms5611_probe(&spi->dev, &ms5611_spi_transport,
+			MS5611_SENSOR_SPI | spi->master->bus_num << 8 |
+			spi->chip_select, 1);
+}
+
+static int __devexit ms5611_spi_remove(struct spi_device *spi)
+{
+	return ms5611_remove(&spi->dev);
+}
+
+static const struct spi_device_id ms5611_spi_id[] = {
+	{SENSOR_NAME, 0},
+	{}
+};
+MODULE_DEVICE_TABLE(spi, ms5611_spi_id);
+
+static struct spi_driver ms561101ba_spi_driver = {
+	.driver = {
+		.owner	= THIS_MODULE,
+		.name	= SENSOR_NAME
+	},
+	.id_table	= ms5611_spi_id,
+	.probe		= ms5611_spi_probe,
+	.remove		= __devexit_p(ms5611_spi_remove),
 };
 
+static int ms5611_spi_register(void)
+{
+	return spi_register_driver(&ms561101ba_spi_driver);
+}
+
+static void ms5611_spi_unregister(void)
+{
+	spi_unregister_driver(&ms561101ba_spi_driver);
+}
+#else
+static int ms5611_spi_register(void) { return 0; }
+static void ms5611_spi_unregister(void) { }
+#endif
+
 static int __init ms561101ba_init(void)
 {
-	return i2c_add_driver(&ms561101ba_driver);
+	int err;
+
+	/* Format 1 is a prefix of the record, see ms5611_merge_copy() */
+	BUILD_BUG_ON(offsetof(struct ms5611_record, boottime_ns) !=
+			MS5611_RECORD_V1_SIZE);
+	BUILD_BUG_ON(offsetof(struct ms5611_merged_record, sensor) + 8 !=
+			sizeof(struct ms5611_merged_record));
+
+	err = ms5611_compensate_selftest();
+	if (err)
+		return err;
+
+	spin_lock_init(&ms5611_merge.lock);
+	INIT_LIST_HEAD(&ms5611_merge.sensors);
+	init_waitqueue_head(&ms5611_merge.wait);
+	ms5611_merge.ring = vmalloc(MS5611_MERGE_SIZE *
+			sizeof(struct ms5611_merged_record));
+	if (!ms5611_merge.ring)
+		return -ENOMEM;
+
+	ms5611_merge.miscdev.minor = MISC_DYNAMIC_MINOR;
+	ms5611_merge.miscdev.name = "ms5611";
+	ms5611_merge.miscdev.fops = &ms5611_merge_fops;
+	err = misc_register(&ms5611_merge.miscdev);
+	if (err < 0)
+		goto exit_ring;
+
+	ms5611_debugfs_register();
+	err = i2c_add_driver(&ms561101ba_driver);
+	if (err < 0)
+		goto exit_debugfs;
+
+	err = ms5611_spi_register();
+	if (err < 0)
+		goto exit_i2c;
+
+	return 0;
+
+exit_i2c:
+	i2c_del_driver(&ms561101ba_driver);
+exit_debugfs:
+	ms5611_debugfs_unregister();
+	misc_deregister(&ms5611_merge.miscdev);
+exit_ring:
+	vfree(ms5611_merge.ring);
+	return err;
 }
 
 static void __exit ms561101ba_exit(void)
 {
+	ms5611_spi_unregister();
 	i2c_del_driver(&ms561101ba_driver);
+	ms5611_debugfs_unregister();
+	misc_deregister(&ms5611_merge.miscdev);
+	vfree(ms5611_merge.ring);
 }
 
 MODULE_AUTHOR("Sarlor <kinsleer@outlook.com>");
@@ -0,0 +1,133 @@
+/*
+ * @file ms561101ba.h
+ * Interface between the MS5611-01BA03 driver and userspace, shared by
+ * ms561101ba.c and the library in test/
+ *
+ *  */
+#ifndef _MS561101BA_H
+#define _MS561101BA_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * One sample of the stream read from /dev/ms5611-<bus>-<addr>.
+ *
+ * Pressure is compensated to 0.01 mbar, temperature to 0.01 degC.
+ * 'seq' counts every published sample of the device, a gap between two
+ * records read by the same file means records were overwritten before
+ * they could be read. With temperature decimation D2 is reused across
+ * several samples, 'temp_age_usec' tells how old it was.
+ *
+ * Both timestamps are the midpoint of the D1 conversion window: the end
+ * of the transfer that issued the convert command plus half the
+ * conversion time of its OSR. 'boottime_ns' is the same instant on
+ * CLOCK_BOOTTIME, which keeps counting through suspend.
+ *
+ * The layout is format MS5611_FORMAT_V2. Format 1, the first
+ * MS5611_RECORD_V1_SIZE bytes without 'boottime_ns', is what read() and
+ * MS5611_IOC_READ_BATCH_V1 return to programs that do not ask for more.
+ *  */
+struct ms5611_record {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC, middle of D1 */
+	__u32 seq;		/* Sequence number of the sample */
+	__u32 raw_pressure;	/* D1 */
+	__u32 raw_temperature;	/* D2 */
+	__s32 pressure;		/* Compensated pressure */
+	__s32 temperature;	/* Compensated temperature */
+	__u32 temp_age_usec;	/* Age of D2 at the D1 conversion, 0 fresh */
+	__u64 boottime_ns;	/* CLOCK_BOOTTIME, middle of D1, format 2 */
+};
+
+#define MS5611_FORMAT_V1		1
+#define MS5611_FORMAT_V2		2
+#define MS5611_FORMAT			MS5611_FORMAT_V2
+#define MS5611_RECORD_V1_SIZE		32
+
+/*
+ * One record of the merged stream read from /dev/ms5611: the samples of
+ * every sensor, in timestamp order. 'sensor' is the adapter number shifted
+ * left by 8 or'ed with the slave address, 0x177 for /dev/ms5611-1-77. For
+ * SPI it is MS5611_SENSOR_SPI, the bus number shifted left by 8 and the
+ * chip select, for /dev/ms5611-spi<bus>.<cs>.
+ *
+ * In format 1 'rec' is the format 1 record, MS5611_MERGED_RECORD_V1_SIZE
+ * bytes in all.
+ *  */
+struct ms5611_merged_record {
+	struct ms5611_record rec;
+	__u32 sensor;
+	__u32 reserved;
+};
+
+#define MS5611_MERGED_RECORD_V1_SIZE	(MS5611_RECORD_V1_SIZE + 8)
+
+/* Per-file statistics of the sample stream */
+struct ms5611_stats {
+	__u64 overruns;		/* Records lost before this file read them */
+	__u64 samples;		/* Samples published by the device */
+};
+
+/*
+ * Acquire 'count' samples back to back at the configured oversampling,
+ * regardless of the continuous period, and store them at 'records'.
+ * 'record_size' selects the format of the records: MS5611_RECORD_V1_SIZE
+ * or sizeof(struct ms5611_record), anything else is refused.
+ *  */
+struct ms5611_batch {
+	__u64 records;		/* User pointer to 'count' records */
+	__u32 count;		/* Samples to acquire */
+	__u32 done;		/* Samples stored, set by the driver */
+	__u32 record_size;	/* Size of one record, set by the caller */
+	__u32 reserved;
+};
+
+/* MS5611_IOC_READ_BATCH_V1, always format 1 records */
+struct ms5611_batch_v1 {
+	__u64 records;
+	__u32 count;
+	__u32 done;
+};
+
+/*
+ * The stream can also be mapped read-only with mmap(). The mapping starts
+ * with this header, the records follow at 'data_offset' as a ring of
+ * 'size' slots, record n lives in slot n % size.
+ *
+ * 'seq' is odd while the driver updates a slot and the header, so the
+ * latest record is read as: wait for an even 'seq', read 'head', copy slot
+ * head - 1, and retry if 'seq' changed. An older record n is valid when,
+ * after copying it, a stable 'head' is still less than n + size.
+ *  */
+struct ms5611_ring_header {
+	__u32 magic;		/* MS5611_RING_MAGIC */
+	__u32 version;		/* MS5611_RING_VERSION */
+	__u32 size;		/* Number of slots, power of two */
+	__u32 record_size;	/* sizeof(struct ms5611_record) */
+	__u32 data_offset;	/* Offset of slot 0 in the mapping */
+	__u32 seq;		/* Update sequence count */
+	__u64 head;		/* Records ever written */
+	__u16 calibration[8];	/* PROM, calibration[1..6] are C1 to C6 */
+	__u16 pressure_osr;	/* Oversampling of the latest record, */
+	__u16 temp_osr;		/* the one at probe before any */
+	__u32 reserved;
+};
+
+#define MS5611_SENSOR_SPI		0x80000000
+
+#define MS5611_RING_MAGIC		0x35363131	/* "5611" */
+#define MS5611_RING_VERSION		2
+
+#define MS5611_IOC_MAGIC		'M'
+/* Records needed before poll() reports the file readable, default 1 */
+#define MS5611_IOC_SET_WATERMARK	_IOW(MS5611_IOC_MAGIC, 0, __u32)
+#define MS5611_IOC_GET_STATS		\
+	_IOR(MS5611_IOC_MAGIC, 1, struct ms5611_stats)
+#define MS5611_IOC_READ_BATCH_V1	\
+	_IOWR(MS5611_IOC_MAGIC, 2, struct ms5611_batch_v1)
+/* Format of the records read() returns on this file, default 1 */
+#define MS5611_IOC_SET_FORMAT		_IOW(MS5611_IOC_MAGIC, 3, __u32)
+#define MS5611_IOC_READ_BATCH		\
+	_IOWR(MS5611_IOC_MAGIC, 4, struct ms5611_batch)
+
+#endif	/* _MS561101BA_H */
@@ -0,0 +1,126 @@
+/*
+ * @file ms561101ba_trace.h
+ * Tracepoints of the MS5611 driver. A disabled tracepoint is a patched out
+ * branch, the arguments are not even evaluated.
+ *
+ * 'sensor' is the id of struct ms5611_merged_record, durations are the
+ * bus time of the transaction in ns, 'status' is zero or negative errno.
+ *  */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ms5611
+
+#if !defined(_MS561101BA_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MS561101BA_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A convert command went out, 'osr' is the oversampling rate */
+TRACE_EVENT(ms5611_convert,
+	TP_PROTO(u32 sensor, u8 cmd, unsigned short osr, s64 duration_ns,
+		int status),
+	TP_ARGS(sensor, cmd, osr, duration_ns, status),
+
+	TP_STRUCT__entry(
+		__field(u32, sensor)
+		__field(u8, cmd)
+		__field(unsigned short, osr)
+		__field(s64, duration_ns)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		__entry->sensor = sensor;
+		__entry->cmd = cmd;
+		__entry->osr = osr;
+		__entry->duration_ns = duration_ns;
+		__entry->status = status;
+	),
+
+	TP_printk("sensor=%08x cmd=0x%02x osr=%u duration_ns=%lld status=%d",
+		__entry->sensor, __entry->cmd, __entry->osr,
+		__entry->duration_ns, __entry->status)
+);
+
+/* A conversion was read back, 'next_cmd' was sent in the same transfer */
+TRACE_EVENT(ms5611_adc_read,
+	TP_PROTO(u32 sensor, u32 value, u8 next_cmd, unsigned short next_osr,
+		s64 duration_ns, int status),
+	TP_ARGS(sensor, value, next_cmd, next_osr, duration_ns, status),
+
+	TP_STRUCT__entry(
+		__field(u32, sensor)
+		__field(u32, value)
+		__field(u8, next_cmd)
+		__field(unsigned short, next_osr)
+		__field(s64, duration_ns)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		__entry->sensor = sensor;
+		__entry->value = value;
+		__entry->next_cmd = next_cmd;
+		__entry->next_osr = next_osr;
+		__entry->duration_ns = duration_ns;
+		__entry->status = status;
+	),
+
+	TP_printk("sensor=%08x value=%u next_cmd=0x%02x next_osr=%u "
+		"duration_ns=%lld status=%d",
+		__entry->sensor, __entry->value, __entry->next_cmd,
+		__entry->next_osr, __entry->duration_ns, __entry->status)
+);
+
+/*
+ * A sample was compensated and published. 'latency_ns' is from the start
+ * of its D1 conversion to publishing, 'bus_ns' the bus time it took.
+ *  */
+TRACE_EVENT(ms5611_sample,
+	TP_PROTO(u32 sensor, u32 seq, u32 d1, u32 d2, s32 pressure,
+		s32 temperature, unsigned short pressure_osr,
+		unsigned short temp_osr, s64 latency_ns, s64 bus_ns),
+	TP_ARGS(sensor, seq, d1, d2, pressure, temperature, pressure_osr,
+		temp_osr, latency_ns, bus_ns),
+
+	TP_STRUCT__entry(
+		__field(u32, sensor)
+		__field(u32, seq)
+		__field(u32, d1)
+		__field(u32, d2)
+		__field(s32, pressure)
+		__field(s32, temperature)
+		__field(unsigned short, pressure_osr)
+		__field(unsigned short, temp_osr)
+		__field(s64, latency_ns)
+		__field(s64, bus_ns)
+	),
+
+	TP_fast_assign(
+		__entry->sensor = sensor;
+		__entry->seq = seq;
+		__entry->d1 = d1;
+		__entry->d2 = d2;
+		__entry->pressure = pressure;
+		__entry->temperature = temperature;
+		__entry->pressure_osr = pressure_osr;
+		__entry->temp_osr = temp_osr;
+		__entry->latency_ns = latency_ns;
+		__entry->bus_ns = bus_ns;
+	),
+
+	TP_printk("sensor=%08x seq=%u d1=%u d2=%u pressure=%d temperature=%d "
+		"osr=%u/%u latency_ns=%lld bus_ns=%lld",
+		__entry->sensor, __entry->seq, __entry->d1, __entry->d2,
+		__entry->pressure, __entry->temperature,
+		__entry->pressure_osr, __entry->temp_osr,
+		__entry->latency_ns, __entry->bus_ns)
+);
+
+#endif /* _MS561101BA_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ms561101ba_trace
+#include <trace/define_trace.h>
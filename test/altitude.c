@@ -0,0 +1,120 @@
+#include <math.h>
+#include <stdint.h>
+#include "ms5611.h"
+#include "altitude_table.h"
+
+/*
+ * Pressure altitude without pow(), see gen_altitude.c for the tables.
+ *
+ * A pressure of 2^k * m Pa, 1 <= m < 2, is (2^k)^e * m^e to the power of
+ * the barometric formula. The first factor is fixed per octave, so it is
+ * folded into the reference together with the QNH and T0 / L, and the
+ * second is interpolated from 257 entries. A sample is a table lookup, a
+ * multiply for the interpolation and one for the altitude.
+ *
+ * Against the exact formula with T0 / L = 44330.769 m and e = 0.190263,
+ * checked by bench_altitude every 0.25 Pa from 10 to 1200 mbar for QNHs of
+ * 950 to 1050 mbar, the largest error is 11 mm for the integer variant
+ * and 16 mm for the float one, below the 0.012 mbar resolution of the
+ * sensor at OSR 4096, about 10 cm. Most of it is the interpolation near
+ * the low end of an octave, where m^e bends most; the QNH goes through the
+ * same table. Outside 10 to 1200 mbar the pressure is clamped.
+ *  */
+#define ALT_MIN_PA		1000
+#define ALT_MAX_PA		120000
+#define ALT_MIN_SHIFT		9		/* 2^9 <= ALT_MIN_PA */
+#define ALT_SCALE_MM		44330769LL	/* T0 / L */
+
+/* m^e of @p in Q30, its octave in @k */
+static uint32_t alt_pow(int32_t p, unsigned int *k)
+{
+	unsigned int shift, i;
+	uint32_t t, frac;
+
+	if (p < ALT_MIN_PA)
+		p = ALT_MIN_PA;
+	else if (p > ALT_MAX_PA)
+		p = ALT_MAX_PA;
+
+	shift = 31 - __builtin_clz(p);
+	t = (uint32_t)p << (31 - shift);
+	i = (t >> (31 - ALT_TABLE_BITS)) & ((1 << ALT_TABLE_BITS) - 1);
+	frac = (t >> (15 - ALT_TABLE_BITS)) & 0xFFFF;
+
+	*k = shift - ALT_MIN_SHIFT;
+	return alt_mantissa[i] + (uint32_t)(((uint64_t)(alt_mantissa[i + 1] -
+					alt_mantissa[i]) * frac) >> 16);
+}
+
+/*
+ * Set the reference pressure @qnh in Pa, 0.01 mbar, 101325 for the
+ * standard atmosphere. The table of ms5611_altitude_mm() is worked out in
+ * integers; the float table of ms5611_altitude_m() is converted from it,
+ * so the two agree to float rounding.
+ *  */
+void ms5611_altitude_ref_init(struct ms5611_altitude_ref *ref, int32_t qnh)
+{
+	unsigned int k, kq;
+	uint64_t scale;
+	uint32_t gq;
+
+	gq = alt_pow(qnh, &kq);
+	ref->qnh = qnh;
+	for (k = 0; k < MS5611_ALT_OCTAVES; k++) {
+		/* (2^k / 2^kq)^e / mq^e in Q30 */
+		scale = ((uint64_t)alt_octave[k - kq + MS5611_ALT_OCTAVES - 1]
+				<< 30) / gq;
+		ref->mm[k] = (ALT_SCALE_MM * scale + (1 << 29)) >> 30;
+		ref->m[k] = (float)ref->mm[k] * (1.0f / 1000.0f / (1 << 30));
+	}
+}
+
+/* Altitude in mm of @pressure in Pa, 0.01 mbar, integer only */
+int32_t ms5611_altitude_mm(const struct ms5611_altitude_ref *ref,
+		int32_t pressure)
+{
+	unsigned int k;
+	uint32_t g = alt_pow(pressure, &k);
+
+	return ALT_SCALE_MM - ((ref->mm[k] * g + (1 << 29)) >> 30);
+}
+
+/* Altitude in m of @pressure in Pa */
+float ms5611_altitude_m(const struct ms5611_altitude_ref *ref, float pressure)
+{
+	unsigned int i;
+	float m, x;
+	int e;
+
+	if (!(pressure >= ALT_MIN_PA))
+		pressure = ALT_MIN_PA;
+	else if (pressure > ALT_MAX_PA)
+		pressure = ALT_MAX_PA;
+
+	/* 0.5 <= m < 1, so 2m is the mantissa of alt_pow() */
+	m = frexpf(pressure, &e);
+	x = m * (2 << ALT_TABLE_BITS) - (1 << ALT_TABLE_BITS);
+	i = (unsigned int)x;
+
+	return ALT_SCALE_MM / 1000.0f - ref->m[e - 1 - ALT_MIN_SHIFT] *
+		((float)alt_mantissa[i] + (float)((int32_t)(alt_mantissa[i + 1] -
+				alt_mantissa[i])) * (x - i));
+}
+
+void ms5611_altitude_mm_batch(const struct ms5611_altitude_ref *ref,
+		const int32_t *pressure, int32_t *altitude, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		altitude[i] = ms5611_altitude_mm(ref, pressure[i]);
+}
+
+void ms5611_altitude_m_batch(const struct ms5611_altitude_ref *ref,
+		const float *pressure, float *altitude, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		altitude[i] = ms5611_altitude_m(ref, pressure[i]);
+}
@@ -0,0 +1,57 @@
+/* Generated by gen_altitude, do not edit */
+#define ALT_EXPONENT		0.190263
+#define ALT_TABLE_BITS		8
+
+/* m^e in Q30 for m = 1 + i / 256 */
+static const uint32_t alt_mantissa[257] = {
+	1073741824, 1074538586, 1075332841, 1076124607, 1076913902, 1077700743,
+	1078485146, 1079267129, 1080046708, 1080823899, 1081598719, 1082371184,
+	1083141310, 1083909113, 1084674607, 1085437810, 1086198735, 1086957399,
+	1087713816, 1088468000, 1089219967, 1089969731, 1090717307, 1091462708,
+	1092205950, 1092947044, 1093686007, 1094422850, 1095157588, 1095890235,
+	1096620802, 1097349304, 1098075754, 1098800164, 1099522547, 1100242916,
+	1100961284, 1101677662, 1102392062, 1103104498, 1103814982, 1104523524,
+	1105230137, 1105934832, 1106637622, 1107338517, 1108037530, 1108734670,
+	1109429950, 1110123381, 1110814973, 1111504738, 1112192685, 1112878826,
+	1113563172, 1114245732, 1114926518, 1115605539, 1116282805, 1116958327,
+	1117632115, 1118304179, 1118974528, 1119643172, 1120310122, 1120975385,
+	1121638973, 1122300894, 1122961158, 1123619773, 1124276750, 1124932097,
+	1125585823, 1126237938, 1126888449, 1127537366, 1128184697, 1128830452,
+	1129474638, 1130117264, 1130758339, 1131397871, 1132035868, 1132672339,
+	1133307291, 1133940732, 1134572671, 1135203116, 1135832074, 1136459554,
+	1137085562, 1137710107, 1138333196, 1138954838, 1139575038, 1140193806,
+	1140811147, 1141427070, 1142041582, 1142654690, 1143266401, 1143876722,
+	1144485661, 1145093223, 1145699417, 1146304249, 1146907726, 1147509854,
+	1148110641, 1148710092, 1149308216, 1149905017, 1150500503, 1151094680,
+	1151687555, 1152279134, 1152869423, 1153458429, 1154046157, 1154632614,
+	1155217806, 1155801739, 1156384420, 1156965853, 1157546046, 1158125004,
+	1158702732, 1159279237, 1159854525, 1160428601, 1161001470, 1161573139,
+	1162143614, 1162712899, 1163281000, 1163847923, 1164413673, 1164978255,
+	1165541676, 1166103940, 1166665052, 1167225018, 1167783843, 1168341533,
+	1168898091, 1169453525, 1170007837, 1170561035, 1171113122, 1171664103,
+	1172213984, 1172762770, 1173310464, 1173857073, 1174402601, 1174947052,
+	1175490432, 1176032745, 1176573995, 1177114188, 1177653328, 1178191420,
+	1178728467, 1179264476, 1179799449, 1180333392, 1180866310, 1181398205,
+	1181929083, 1182458949, 1182987806, 1183515658, 1184042511, 1184568368,
+	1185093233, 1185617110, 1186140005, 1186661920, 1187182860, 1187702829,
+	1188221831, 1188739870, 1189256950, 1189773075, 1190288249, 1190802475,
+	1191315759, 1191828102, 1192339511, 1192849987, 1193359535, 1193868159,
+	1194375863, 1194882650, 1195388523, 1195893487, 1196397546, 1196900702,
+	1197402959, 1197904322, 1198404793, 1198904376, 1199403075, 1199900893,
+	1200397833, 1200893899, 1201389095, 1201883424, 1202376889, 1202869493,
+	1203361241, 1203852134, 1204342178, 1204831374, 1205319726, 1205807237,
+	1206293912, 1206779752, 1207264761, 1207748942, 1208232298, 1208714833,
+	1209196550, 1209677451, 1210157540, 1210636819, 1211115293, 1211592963,
+	1212069833, 1212545907, 1213021185, 1213495673, 1213969373, 1214442287,
+	1214914418, 1215385770, 1215856346, 1216326147, 1216795178, 1217263440,
+	1217730937, 1218197671, 1218663646, 1219128863, 1219593327, 1220057038,
+	1220520001, 1220982218, 1221443691, 1221904423, 1222364417, 1222823676,
+	1223282202, 1223739997, 1224197065, 1224653407, 1225109027,
+};
+
+/* 2^(j * e) in Q30 for j = -7 .. 7 */
+static const uint32_t alt_octave[15] = {
+	 426555729,  486688013,  555297246,  633578439,  722895065,  824802806,
+	 941076654, 1073741824, 1225109027, 1397814721, 1594867030, 1819698136,
+	2076224064, 2368912886, 2702862547,
+};
@@ -0,0 +1,882 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/i2c-dev.h>
+#include <linux/io_uring.h>
+#include "backend.h"
+
+/*
+ * Asynchronous reads over io_uring, without liburing.
+ *
+ * Every sensor has a queue of requests and runs one at a time, so many
+ * sensors, each with several requests queued, are in flight from one
+ * thread and nothing blocks it:
+ *
+ * - sysfs, one READ of temp_and_pressure at offset 0. It sleeps through
+ *   the two conversions in the driver, in an io_uring worker. A READ of
+ *   sample_timestamp_ns linked to it dates the sample.
+ * - i2c, the conversions as three linked chains of plain write()s and
+ *   read()s on /dev/i2c-N, with TIMEOUTs for the conversion times:
+ *   convert D1, wait | ADC read, convert D2, wait | ADC read.
+ *
+ * A request times out with a TIMEOUT of its own, armed at submit, and is
+ * cancelled with ASYNC_CANCEL. Its callback runs once, from
+ * ms5611_async_run() or from ms5611_async_cancel(), with 0 and the sample,
+ * -ETIMEDOUT, -ECANCELED or the error of the read. The ring fd polls
+ * readable when there is something for ms5611_async_run() to do.
+ *  */
+#define MAX_CHAIN			4
+#define MAX_REQS			65536
+
+/* Low bits of the user_data of a CQE, the rest is the request */
+#define UD_IGNORE			0	/* Cancel and remove ops */
+#define UD_IO				1
+#define UD_READ				2	/* The ADC or sysfs read */
+#define UD_DEADLINE			3
+
+enum { REQ_FREE, REQ_QUEUED, REQ_RUNNING, REQ_DONE };
+enum { SENSOR_SYSFS, SENSOR_I2C };
+
+struct ms5611_async_req {
+	struct ms5611_async *ctx;
+	struct ms5611_async_sensor *sensor;
+	struct ms5611_async_req *next;	/* Sensor queue or free list */
+	unsigned int index;
+	unsigned int gen;
+	int state;
+	int step;			/* i2c chain, -1 to let a conversion end */
+	int ops;			/* CQEs due for the current step */
+	int timer;			/* Deadline armed */
+	int status;
+	int len;			/* Of the read of the step */
+	int stamp;			/* See uring_stamp() */
+	ms5611_async_cb cb;
+	void *arg;
+	struct __kernel_timespec deadline;
+	struct __kernel_timespec delay[2];
+	unsigned char cmd[3];
+	char buf[64];
+	char ts_buf[24];		/* sample_timestamp_ns */
+	struct ms5611_sample sample;
+};
+
+struct ms5611_async_sensor {
+	struct ms5611_dev *dev;
+	int type;
+	int fd;
+	int ts_fd;			/* sysfs sample_timestamp_ns or -1 */
+	const struct ms5611_osr_info *pressure_osr;
+	const struct ms5611_osr_info *temp_osr;
+	struct ms5611_async_req *active;
+	struct ms5611_async_req *head, *tail;
+	int settle;			/* A cancelled conversion may run */
+};
+
+struct ms5611_async {
+	int fd;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned int sq_entries;
+	unsigned int tail;		/* Local SQ tail, published on flush */
+	void *sq_ring, *cq_ring;
+	size_t sq_len, cq_len;
+
+	struct ms5611_async_sensor **sensors;
+	int n_sensors;
+	struct ms5611_async_req *reqs, *free;
+	unsigned int n_reqs;
+	unsigned int depth;
+	unsigned int pending;		/* Submitted, callback not run yet */
+	int completed;			/* Callbacks of this run */
+};
+
+static int uring_enter(struct ms5611_async *ctx, unsigned int submit,
+		unsigned int wait, int timeout_ms)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg = { 0 };
+	unsigned int flags = 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+
+	if (wait) {
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout_ms >= 0) {
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+			arg.ts = (unsigned long long)(uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof(arg);
+		}
+	}
+
+	return syscall(__NR_io_uring_enter, ctx->fd, submit, wait, flags,
+			argp, argsz);
+}
+
+static int uring_setup(struct ms5611_async *ctx, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	ctx->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ctx->fd < 0) {
+		printf("Error: io_uring_setup\n");
+		return -1;
+	}
+
+	if (!(p.features & IORING_FEAT_EXT_ARG)) {
+		printf("Error: io_uring without EXT_ARG\n");
+		return -1;
+	}
+
+	ctx->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ctx->cq_len = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ctx->cq_len > ctx->sq_len)
+			ctx->sq_len = ctx->cq_len;
+		ctx->cq_len = 0;
+	}
+
+	ctx->sq_ring = mmap(NULL, ctx->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ctx->fd, IORING_OFF_SQ_RING);
+	if (ctx->sq_ring == MAP_FAILED)
+		return -1;
+
+	ctx->cq_ring = ctx->sq_ring;
+	if (ctx->cq_len) {
+		ctx->cq_ring = mmap(NULL, ctx->cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, ctx->fd,
+				IORING_OFF_CQ_RING);
+		if (ctx->cq_ring == MAP_FAILED)
+			return -1;
+	}
+
+	ctx->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			ctx->fd, IORING_OFF_SQES);
+	if (ctx->sqes == MAP_FAILED)
+		return -1;
+
+	ctx->sq_head = (void *)((char *)ctx->sq_ring + p.sq_off.head);
+	ctx->sq_tail = (void *)((char *)ctx->sq_ring + p.sq_off.tail);
+	ctx->sq_mask = (void *)((char *)ctx->sq_ring + p.sq_off.ring_mask);
+	ctx->sq_array = (void *)((char *)ctx->sq_ring + p.sq_off.array);
+	ctx->cq_head = (void *)((char *)ctx->cq_ring + p.cq_off.head);
+	ctx->cq_tail = (void *)((char *)ctx->cq_ring + p.cq_off.tail);
+	ctx->cq_mask = (void *)((char *)ctx->cq_ring + p.cq_off.ring_mask);
+	ctx->cqes = (void *)((char *)ctx->cq_ring + p.cq_off.cqes);
+	ctx->sq_entries = p.sq_entries;
+	ctx->tail = *ctx->sq_tail;
+
+	return 0;
+}
+
+/*
+ * Date the samples whose D1 write is about to be submitted at the middle
+ * of the conversion. Called right before the io_uring_enter() that hands
+ * the write to the kernel, the conversion starts then and not when
+ * req_step() queued it, which may be a whole run earlier.
+ *  */
+static void uring_stamp(struct ms5611_async *ctx)
+{
+	struct ms5611_async_req *req;
+	unsigned long long now = 0;
+	int i;
+
+	for (i = 0; i < ctx->n_sensors; i++) {
+		req = ctx->sensors[i]->active;
+		if (!req || !req->stamp)
+			continue;
+		if (!now)
+			now = ms5611_now_ns();
+		req->sample.timestamp_ns = now +
+			req->sensor->pressure_osr->conv_usec * 500ULL;
+		req->stamp = 0;
+	}
+}
+
+/* Hand the queued SQEs to the kernel */
+static int uring_flush(struct ms5611_async *ctx)
+{
+	unsigned int pending;
+	int ret;
+
+	__atomic_store_n(ctx->sq_tail, ctx->tail, __ATOMIC_RELEASE);
+	pending = ctx->tail - __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+	if (!pending)
+		return 0;
+
+	uring_stamp(ctx);
+	do {
+		ret = uring_enter(ctx, pending, 0, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -1 : 0;
+}
+
+/*
+ * @n free SQEs in a row, so a linked chain is never split by a flush.
+ * Returning the first one, zeroed, the caller takes all @n.
+ *  */
+static struct io_uring_sqe *uring_get(struct ms5611_async *ctx, unsigned int n)
+{
+	unsigned int head, i, idx;
+
+	head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+	if (ctx->tail + n - head > ctx->sq_entries) {
+		if (uring_flush(ctx) < 0)
+			return NULL;
+		head = __atomic_load_n(ctx->sq_head, __ATOMIC_ACQUIRE);
+		if (ctx->tail + n - head > ctx->sq_entries)
+			return NULL;
+	}
+
+	idx = ctx->tail & *ctx->sq_mask;
+	for (i = 0; i < n; i++) {
+		ctx->sq_array[(ctx->tail + i) & *ctx->sq_mask] =
+			(ctx->tail + i) & *ctx->sq_mask;
+		memset(&ctx->sqes[(ctx->tail + i) & *ctx->sq_mask], 0,
+				sizeof(struct io_uring_sqe));
+	}
+
+	return &ctx->sqes[idx];
+}
+
+/* The i-th SQE after one from uring_get(), which may wrap */
+static struct io_uring_sqe *uring_at(struct ms5611_async *ctx, unsigned int i)
+{
+	return &ctx->sqes[(ctx->tail + i) & *ctx->sq_mask];
+}
+
+static unsigned long long req_ud(struct ms5611_async_req *req, int kind)
+{
+	return (unsigned long long)(uintptr_t)req | kind;
+}
+
+/* sysfs is read at offset 0, i2c-dev at the file position */
+static void prep_rw(struct io_uring_sqe *sqe, int op, void *buf,
+		unsigned int len, struct ms5611_async_req *req)
+{
+	sqe->opcode = op;
+	sqe->fd = req->sensor->fd;
+	sqe->addr = (unsigned long long)(uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = req->sensor->type == SENSOR_SYSFS ? 0 : -1ULL;
+	sqe->user_data = req_ud(req, op == IORING_OP_READ ? UD_READ : UD_IO);
+}
+
+static void prep_delay(struct io_uring_sqe *sqe, struct __kernel_timespec *ts,
+		unsigned int usec, struct ms5611_async_req *req)
+{
+	ts->tv_sec = usec / 1000000;
+	ts->tv_nsec = (usec % 1000000) * 1000LL;
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (unsigned long long)(uintptr_t)ts;
+	sqe->len = 1;
+	sqe->user_data = req_ud(req, UD_IO);
+}
+
+/*
+ * Queue the ops of the current step of @req. Every i2c chain ends in the
+ * conversion wait or in the ADC read, the ops before it are linked so a
+ * failure cancels the rest.
+ *  */
+static int req_step(struct ms5611_async_req *req)
+{
+	struct ms5611_async *ctx = req->ctx;
+	struct ms5611_async_sensor *s = req->sensor;
+	unsigned int n, i;
+
+	if (s->type == SENSOR_SYSFS) {
+		n = s->ts_fd >= 0 ? 2 : 1;
+		if (!uring_get(ctx, n))
+			return -1;
+		prep_rw(uring_at(ctx, 0), IORING_OP_READ, req->buf,
+				sizeof(req->buf) - 1, req);
+		if (n == 2) {
+			memset(req->ts_buf, 0, sizeof(req->ts_buf));
+			prep_rw(uring_at(ctx, 1), IORING_OP_READ, req->ts_buf,
+					sizeof(req->ts_buf) - 1, req);
+			uring_at(ctx, 1)->fd = s->ts_fd;
+			uring_at(ctx, 1)->user_data = req_ud(req, UD_IO);
+		}
+	} else if (req->step < 0) {
+		if (!uring_get(ctx, 1))
+			return -1;
+		prep_delay(uring_at(ctx, 0), &req->delay[0],
+				s->pressure_osr->conv_usec >
+				s->temp_osr->conv_usec ?
+				s->pressure_osr->conv_usec :
+				s->temp_osr->conv_usec, req);
+		n = 1;
+	} else if (req->step == 0) {
+		if (!uring_get(ctx, 2))
+			return -1;
+		prep_rw(uring_at(ctx, 0), IORING_OP_WRITE, &req->cmd[0],
+				1, req);
+		prep_delay(uring_at(ctx, 1), &req->delay[0],
+				s->pressure_osr->conv_usec, req);
+		n = 2;
+		req->stamp = 1;
+	} else if (req->step == 1) {
+		if (!uring_get(ctx, 4))
+			return -1;
+		prep_rw(uring_at(ctx, 0), IORING_OP_WRITE, &req->cmd[1],
+				1, req);
+		prep_rw(uring_at(ctx, 1), IORING_OP_READ, req->buf, 3,
+				req);
+		prep_rw(uring_at(ctx, 2), IORING_OP_WRITE, &req->cmd[2],
+				1, req);
+		prep_delay(uring_at(ctx, 3), &req->delay[1],
+				s->temp_osr->conv_usec, req);
+		n = 4;
+	} else {
+		if (!uring_get(ctx, 2))
+			return -1;
+		prep_rw(uring_at(ctx, 0), IORING_OP_WRITE, &req->cmd[1],
+				1, req);
+		prep_rw(uring_at(ctx, 1), IORING_OP_READ, req->buf, 3,
+				req);
+		n = 2;
+	}
+
+	/* A sysfs read is short, which would sever a plain link */
+	for (i = 0; i + 1 < n; i++)
+		uring_at(ctx, i)->flags |= s->type == SENSOR_SYSFS ?
+			IOSQE_IO_HARDLINK : IOSQE_IO_LINK;
+
+	ctx->tail += n;
+	req->ops = n;
+	return 0;
+}
+
+static void req_start(struct ms5611_async_req *req);
+
+/* Put @req back on the free list once the kernel is done with it */
+static void req_put(struct ms5611_async_req *req)
+{
+	struct ms5611_async *ctx = req->ctx;
+	struct ms5611_async_sensor *s = req->sensor;
+	struct ms5611_async_req *next;
+
+	if (req->state != REQ_DONE || req->ops)
+		return;
+
+	if (s->active == req) {
+		s->active = NULL;
+		next = s->head;
+		if (next) {
+			s->head = next->next;
+			if (!s->head)
+				s->tail = NULL;
+			req_start(next);
+		}
+	}
+
+	if (req->timer)
+		return;
+
+	req->state = REQ_FREE;
+	req->gen++;
+	req->next = ctx->free;
+	ctx->free = req;
+}
+
+/* Complete @req with @status, the ops in flight are left to drain */
+static void req_finish(struct ms5611_async_req *req, int status)
+{
+	struct ms5611_async *ctx = req->ctx;
+	struct io_uring_sqe *sqe;
+
+	req->state = REQ_DONE;
+	ctx->pending--;
+	if (req->timer) {
+		sqe = uring_get(ctx, 1);
+		if (sqe) {
+			sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = req_ud(req, UD_DEADLINE);
+			sqe->user_data = UD_IGNORE;
+			ctx->tail++;
+		}
+	}
+
+	ctx->completed++;
+	req->cb(req->arg, status, status < 0 ? NULL : &req->sample);
+	req_put(req);
+}
+
+static void req_start(struct ms5611_async_req *req)
+{
+	struct ms5611_async_sensor *s = req->sensor;
+
+	req->state = REQ_RUNNING;
+	req->status = 0;
+	req->stamp = 0;
+	req->step = s->settle ? -1 : 0;
+	s->settle = 0;
+	s->active = req;
+	req->sample.temp_age_usec = 0;
+
+	if (req_step(req) < 0)
+		req_finish(req, -EBUSY);
+}
+
+/* Returning 0 when the sample is complete, 1 for another step */
+static int req_parse(struct ms5611_async_req *req, int res)
+{
+	struct ms5611_async_sensor *s = req->sensor;
+	unsigned int adc;
+	char *end;
+
+	if (s->type == SENSOR_SYSFS) {
+		req->buf[res] = '\0';
+		req->sample.raw_temperature = strtoul(req->buf, &end, 10);
+		if (end == req->buf)
+			return -EIO;
+		req->sample.raw_pressure = strtoul(end, &end, 10);
+		/* Drivers before the D1 midpoint do not have it */
+		req->sample.timestamp_ns = strtoull(req->ts_buf, NULL, 10);
+		if (!req->sample.timestamp_ns)
+			req->sample.timestamp_ns = ms5611_now_ns();
+		return 0;
+	}
+
+	if (req->step++ <= 0)
+		return 1;
+
+	if (res != 3)
+		return -EIO;
+	adc = ((unsigned char)req->buf[0] << 16) |
+		((unsigned char)req->buf[1] << 8) | (unsigned char)req->buf[2];
+
+	if (req->step == 2) {
+		req->sample.raw_pressure = adc;
+		return 1;
+	}
+
+	req->sample.raw_temperature = adc;
+	return 0;
+}
+
+static void req_io_done(struct ms5611_async_req *req, int kind, int res)
+{
+	struct ms5611_async_sensor *s = req->sensor;
+	int ret;
+
+	/* A conversion wait ends with -ETIME, the others with a length */
+	if (res < 0 && res != -ETIME && !req->status)
+		req->status = res;
+	else if (kind == UD_READ)
+		req->len = res;
+
+	if (--req->ops)
+		return;
+
+	if (req->state == REQ_DONE) {
+		req_put(req);
+		return;
+	}
+
+	if (req->status) {
+		if (s->type == SENSOR_I2C)
+			s->settle = 1;
+		req_finish(req, req->status);
+		return;
+	}
+
+	ret = req_parse(req, req->len);
+	if (ret < 0) {
+		req_finish(req, ret);
+	} else if (ret > 0) {
+		if (req_step(req) < 0)
+			req_finish(req, -EBUSY);
+	} else {
+		req->sample.boottime_ns =
+			ms5611_boottime_ns(req->sample.timestamp_ns);
+		ms5611_compensate(ms5611_dev_calibration(s->dev),
+				req->sample.raw_pressure,
+				req->sample.raw_temperature,
+				&req->sample.pressure,
+				&req->sample.temperature);
+		req_finish(req, 0);
+	}
+}
+
+/* Stop @req with @status wherever it is */
+static void req_abort(struct ms5611_async_req *req, int status)
+{
+	struct ms5611_async *ctx = req->ctx;
+	struct ms5611_async_sensor *s = req->sensor;
+	struct ms5611_async_req **pp;
+	struct io_uring_sqe *sqe;
+	int i;
+
+	if (req->state == REQ_QUEUED) {
+		for (pp = &s->head; *pp != req; pp = &(*pp)->next)
+			;
+		*pp = req->next;
+		if (s->tail == req) {
+			s->tail = NULL;
+			for (pp = &s->head; *pp; pp = &(*pp)->next)
+				s->tail = *pp;
+		}
+	} else if (req->state == REQ_RUNNING) {
+		sqe = uring_get(ctx, 2);
+		if (sqe) {
+			for (i = 0; i < 2; i++) {
+				sqe = uring_at(ctx, i);
+				sqe->opcode = IORING_OP_ASYNC_CANCEL;
+				sqe->fd = -1;
+				sqe->addr = req_ud(req, i ? UD_READ : UD_IO);
+				sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+				sqe->user_data = UD_IGNORE;
+			}
+			ctx->tail += 2;
+		}
+		if (s->type == SENSOR_I2C)
+			s->settle = 1;
+	}
+
+	req_finish(req, status);
+}
+
+static void req_deadline(struct ms5611_async_req *req, int res)
+{
+	req->timer = 0;
+	if (res == -ETIME && req->state != REQ_DONE)
+		req_abort(req, -ETIMEDOUT);
+	else
+		req_put(req);
+}
+
+/*
+ * A context for up to @depth requests in flight or queued at once.
+ * Returning NULL on failure.
+ *  */
+struct ms5611_async *ms5611_async_create(unsigned int depth)
+{
+	struct ms5611_async *ctx;
+	unsigned int entries = 8, i;
+
+	if (!depth || depth > MAX_REQS / 2)
+		return NULL;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	/* A chain, a deadline and its removal per request, or a cancel */
+	while (entries < depth * (MAX_CHAIN + 2) && entries < 4096)
+		entries <<= 1;
+
+	/*
+	 * A completed request stays with the kernel until its deadline is
+	 * removed or its cancelled ops drain, twice as many let a callback
+	 * submit the next one at once.
+	 *  */
+	ctx->fd = -1;
+	ctx->reqs = calloc(depth * 2, sizeof(*ctx->reqs));
+	if (!ctx->reqs || uring_setup(ctx, entries) < 0) {
+		ms5611_async_destroy(ctx);
+		return NULL;
+	}
+
+	ctx->depth = depth;
+	ctx->n_reqs = depth * 2;
+	for (i = ctx->n_reqs; i-- > 0; ) {
+		ctx->reqs[i].ctx = ctx;
+		ctx->reqs[i].index = i;
+		ctx->reqs[i].next = ctx->free;
+		ctx->free = &ctx->reqs[i];
+	}
+
+	return ctx;
+}
+
+/* Requests still in flight are dropped without their callbacks */
+void ms5611_async_destroy(struct ms5611_async *ctx)
+{
+	struct ms5611_async_sensor *s;
+	int i;
+
+	if (!ctx)
+		return;
+
+	/* Closing the ring waits for what the kernel still has */
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+
+	for (i = 0; i < ctx->n_sensors; i++) {
+		s = ctx->sensors[i];
+		close(s->fd);
+		if (s->ts_fd >= 0)
+			close(s->ts_fd);
+		ms5611_close(s->dev);
+		free(s);
+	}
+
+	if (ctx->sqes && ctx->sqes != MAP_FAILED)
+		munmap(ctx->sqes, ctx->sq_entries *
+				sizeof(struct io_uring_sqe));
+	if (ctx->cq_ring && ctx->cq_ring != MAP_FAILED &&
+			ctx->cq_ring != ctx->sq_ring)
+		munmap(ctx->cq_ring, ctx->cq_len);
+	if (ctx->sq_ring && ctx->sq_ring != MAP_FAILED)
+		munmap(ctx->sq_ring, ctx->sq_len);
+
+	free(ctx->sensors);
+	free(ctx->reqs);
+	free(ctx);
+}
+
+/* For poll(), readable when ms5611_async_run() has completions */
+int ms5611_async_fd(struct ms5611_async *ctx)
+{
+	return ctx->fd;
+}
+
+static int async_open_fd(struct ms5611_async_sensor *s, const char *spec)
+{
+	unsigned int bus = 1, addr = 0x77;
+	const char *arg = strchr(spec, ':');
+	char path[256];
+
+	if (!strncmp(spec, "sysfs", 5) && (!spec[5] || spec[5] == ':')) {
+		snprintf(path, sizeof(path), "%s/temp_and_pressure",
+				arg ? arg + 1 : MS561101BA_PATH_BASE);
+		s->type = SENSOR_SYSFS;
+		s->fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (s->fd < 0)
+			return -1;
+
+		snprintf(path, sizeof(path), "%s/sample_timestamp_ns",
+				arg ? arg + 1 : MS561101BA_PATH_BASE);
+		s->ts_fd = open(path, O_RDONLY | O_CLOEXEC);
+		return 0;
+	}
+
+	if (!strncmp(spec, "i2c", 3) && (!spec[3] || spec[3] == ':')) {
+		if (arg && sscanf(arg + 1, "%u:%i", &bus, &addr) < 1)
+			return -1;
+		snprintf(path, sizeof(path), "/dev/i2c-%u", bus);
+		s->type = SENSOR_I2C;
+		s->fd = open(path, O_RDWR | O_CLOEXEC);
+		if (s->fd < 0 || ioctl(s->fd, I2C_SLAVE, addr) < 0)
+			return -1;
+		return 0;
+	}
+
+	printf("Error: No async path for %s\n", spec);
+	return -1;
+}
+
+/*
+ * Add the sensor of @spec, "sysfs[:<dir>]" or "i2c[:<bus>[:<addr>]]", at
+ * the given oversampling rates. The setup, PROM and rates, is done with
+ * the blocking backend of ms5611_open(). Returning the sensor number for
+ * ms5611_async_submit() or -1.
+ *  */
+int ms5611_async_open(struct ms5611_async *ctx, const char *spec,
+		unsigned short pressure_osr, unsigned short temp_osr)
+{
+	struct ms5611_async_sensor *s, **sensors;
+
+	if (!spec)
+		spec = "sysfs";
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return -1;
+	s->fd = -1;
+	s->ts_fd = -1;
+
+	s->pressure_osr = ms5611_osr_info(pressure_osr);
+	s->temp_osr = ms5611_osr_info(temp_osr);
+	if (!s->pressure_osr || !s->temp_osr) {
+		printf("Error: OSR %u:%u\n", pressure_osr, temp_osr);
+		goto exit_free;
+	}
+
+	s->dev = ms5611_open(spec);
+	if (!s->dev)
+		goto exit_free;
+
+	if (ms5611_dev_set_oversampling(s->dev, pressure_osr, temp_osr) < 0) {
+		printf("Error: Set oversampling %u:%u\n", pressure_osr,
+				temp_osr);
+		goto exit_close;
+	}
+
+	if (async_open_fd(s, spec) < 0) {
+		printf("Error: Open %s for async reads\n", spec);
+		goto exit_close;
+	}
+
+	sensors = realloc(ctx->sensors, (ctx->n_sensors + 1) *
+			sizeof(*sensors));
+	if (!sensors)
+		goto exit_close;
+
+	ctx->sensors = sensors;
+	ctx->sensors[ctx->n_sensors] = s;
+	return ctx->n_sensors++;
+
+exit_close:
+	if (s->fd >= 0)
+		close(s->fd);
+	if (s->ts_fd >= 0)
+		close(s->ts_fd);
+	ms5611_close(s->dev);
+exit_free:
+	free(s);
+	return -1;
+}
+
+struct ms5611_dev *ms5611_async_dev(struct ms5611_async *ctx, int sensor)
+{
+	return ctx->sensors[sensor]->dev;
+}
+
+/*
+ * Queue a read of @sensor, failing with -ETIMEDOUT if it has not completed
+ * @timeout_ns after now, 0 to wait forever. Nothing reaches the kernel
+ * before the next ms5611_async_run(). Returning the id of the request for
+ * ms5611_async_cancel(), or -1 if @depth requests are already pending.
+ *  */
+long long ms5611_async_submit(struct ms5611_async *ctx, int sensor,
+		unsigned long long timeout_ns, ms5611_async_cb cb, void *arg)
+{
+	struct ms5611_async_sensor *s;
+	struct ms5611_async_req *req = ctx->free;
+	struct io_uring_sqe *sqe;
+
+	if (!req || ctx->pending >= ctx->depth || sensor < 0 ||
+			sensor >= ctx->n_sensors)
+		return -1;
+
+	s = ctx->sensors[sensor];
+	ctx->free = req->next;
+	req->sensor = s;
+	req->next = NULL;
+	req->cb = cb;
+	req->arg = arg;
+	req->ops = 0;
+	req->timer = 0;
+	req->cmd[0] = s->pressure_osr->pressure_cmd;
+	req->cmd[1] = CMD_ADC_READ;
+	req->cmd[2] = s->temp_osr->temp_cmd;
+
+	if (timeout_ns) {
+		sqe = uring_get(ctx, 1);
+		if (!sqe) {
+			req->next = ctx->free;
+			ctx->free = req;
+			return -1;
+		}
+		req->deadline.tv_sec = timeout_ns / 1000000000;
+		req->deadline.tv_nsec = timeout_ns % 1000000000;
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->fd = -1;
+		sqe->addr = (unsigned long long)(uintptr_t)&req->deadline;
+		sqe->len = 1;
+		sqe->user_data = req_ud(req, UD_DEADLINE);
+		ctx->tail++;
+		req->timer = 1;
+	}
+
+	ctx->pending++;
+	if (s->active) {
+		req->state = REQ_QUEUED;
+		if (s->tail)
+			s->tail->next = req;
+		else
+			s->head = req;
+		s->tail = req;
+	} else {
+		req_start(req);
+	}
+
+	return ((long long)req->gen << 16) | req->index;
+}
+
+/*
+ * Cancel request @id, calling its callback with -ECANCELED before
+ * returning. An i2c sensor waits out a conversion that was running before
+ * its next request. Returning -1 if the request already completed.
+ *  */
+int ms5611_async_cancel(struct ms5611_async *ctx, long long id)
+{
+	struct ms5611_async_req *req;
+
+	if (id < 0 || (id & 0xFFFF) >= ctx->n_reqs)
+		return -1;
+
+	req = &ctx->reqs[id & 0xFFFF];
+	if (req->gen != (unsigned int)(id >> 16) ||
+			(req->state != REQ_QUEUED && req->state != REQ_RUNNING))
+		return -1;
+
+	req_abort(req, -ECANCELED);
+	return 0;
+}
+
+/*
+ * Submit what is queued, wait up to @timeout_ms, -1 forever, for at least
+ * one completion if none is there, and run the callbacks of everything
+ * that completed. Returning the number of callbacks run, or -1.
+ *  */
+int ms5611_async_run(struct ms5611_async *ctx, int timeout_ms)
+{
+	struct io_uring_cqe *cqe;
+	struct ms5611_async_req *req;
+	unsigned int head, tail;
+	int ret;
+
+	ctx->completed = 0;
+	__atomic_store_n(ctx->sq_tail, ctx->tail, __ATOMIC_RELEASE);
+
+	head = *ctx->cq_head;
+	tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+	uring_stamp(ctx);
+	ret = uring_enter(ctx, ctx->tail - __atomic_load_n(ctx->sq_head,
+				__ATOMIC_ACQUIRE), head == tail &&
+			timeout_ms != 0 ? 1 : 0, timeout_ms);
+	if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+		return -1;
+
+	for (;;) {
+		tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+		if (head == tail)
+			break;
+
+		cqe = &ctx->cqes[head & *ctx->cq_mask];
+		req = (void *)(uintptr_t)(cqe->user_data & ~7ULL);
+		ret = cqe->res;
+		if (req && ((cqe->user_data & 7) == UD_IO ||
+					(cqe->user_data & 7) == UD_READ))
+			req_io_done(req, cqe->user_data & 7, ret);
+		else if (req && (cqe->user_data & 7) == UD_DEADLINE)
+			req_deadline(req, ret);
+
+		__atomic_store_n(ctx->cq_head, ++head, __ATOMIC_RELEASE);
+	}
+
+	/* What the callbacks queued goes out now, not on the next run */
+	if (uring_flush(ctx) < 0)
+		return -1;
+
+	return ctx->completed;
+}
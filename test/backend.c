@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include "backend.h"
+
+static const struct ms5611_backend *backends[] = {
+	&ms5611_sysfs_backend,
+	&ms5611_chardev_backend,
+	&ms5611_sim_backend,
+	&ms5611_i2cdev_backend,
+	&ms5611_spidev_backend,
+	&ms5611_capture_backend,
+	&ms5611_daemon_backend,
+};
+
+unsigned long long ms5611_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sleep @usec on CLOCK_MONOTONIC, resumed across signals */
+void ms5611_sleep_usec(unsigned int usec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = (usec % 1000000) * 1000L;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) != 0)
+		;
+}
+
+/*
+ * CLOCK_BOOTTIME of the CLOCK_MONOTONIC time @mono_ns, with the offset
+ * between the two as of now. It only moves across a suspend.
+ *  */
+unsigned long long ms5611_boottime_ns(unsigned long long mono_ns)
+{
+	struct timespec boot, mono;
+
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	return mono_ns + (boot.tv_sec - mono.tv_sec) * 1000000000LL +
+		boot.tv_nsec - mono.tv_nsec;
+}
+
+/*
+ * Open a device, see ms5611.h for the spec. The calibration data is read
+ * and checked once here. The kernel backends take the OSRs the driver has,
+ * i2c and spi start the sensor at 4096 and the others, which can not tell,
+ * assume it. Returning NULL on failure.
+ *  */
+struct ms5611_dev *ms5611_open(const char *spec)
+{
+	const struct ms5611_backend *ops = NULL;
+	const char *arg = NULL;
+	struct ms5611_dev *dev;
+	size_t len;
+	unsigned int i;
+
+	if (!spec)
+		spec = "sysfs";
+
+	len = strcspn(spec, ":");
+	if (spec[len] == ':')
+		arg = spec + len + 1;
+
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+		if (strlen(backends[i]->name) == len &&
+				!strncmp(backends[i]->name, spec, len))
+			ops = backends[i];
+
+	if (!ops) {
+		printf("Error: Unknown backend %s\n", spec);
+		return NULL;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if (!dev)
+		return NULL;
+
+	dev->ops = ops;
+	dev->pressure_osr = ms5611_osr_info(4096);
+	dev->temp_osr = ms5611_osr_info(4096);
+	if (ops->open(dev, arg) < 0) {
+		free(dev);
+		return NULL;
+	}
+
+	if (ops->read_prom(dev, dev->prom) < 0) {
+		printf("Error: Read calibration from %s\n", spec);
+		ms5611_close(dev);
+		return NULL;
+	}
+	ms5611_calibration_from_prom(&dev->cali, dev->prom);
+
+	return dev;
+}
+
+void ms5611_close(struct ms5611_dev *dev)
+{
+	if (!dev)
+		return;
+
+	dev->ops->close(dev);
+	free(dev);
+}
+
+const struct ms5611_calibration *ms5611_dev_calibration(struct ms5611_dev *dev)
+{
+	return &dev->cali;
+}
+
+/*
+ * The PROM words the calibration came from, those the backend can not
+ * read are 0.
+ *  */
+const unsigned short *ms5611_dev_prom(struct ms5611_dev *dev)
+{
+	return dev->prom;
+}
+
+/*
+ * Read one compensated sample.
+ *  */
+int ms5611_dev_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	sample->timestamp_ns = 0;
+	sample->boottime_ns = 0;
+	sample->temp_age_usec = 0;
+
+	if (dev->ops->read(dev, sample) < 0)
+		return -1;
+
+	if (!sample->timestamp_ns)
+		sample->timestamp_ns = ms5611_now_ns();
+	if (!sample->boottime_ns)
+		sample->boottime_ns = ms5611_boottime_ns(sample->timestamp_ns);
+
+	return ms5611_compensate(&dev->cali, sample->raw_pressure,
+			sample->raw_temperature, &sample->pressure,
+			&sample->temperature);
+}
+
+int ms5611_dev_set_oversampling(struct ms5611_dev *dev,
+		unsigned short pressure, unsigned short temperature)
+{
+	const struct ms5611_osr_info *p = ms5611_osr_info(pressure);
+	const struct ms5611_osr_info *t = ms5611_osr_info(temperature);
+
+	if (!p || !t || !dev->ops->set_oversampling)
+		return -1;
+
+	if (dev->ops->set_oversampling(dev, p, t) < 0)
+		return -1;
+
+	dev->pressure_osr = p;
+	dev->temp_osr = t;
+	return 0;
+}
+
+/*
+ * sysfs backend, the attributes of the kernel driver.
+ *
+ * The directory is opened once and attributes are opened relative to it.
+ * The sample attribute stays open and is re-read with pread() at offset 0,
+ * which makes sysfs call the show function again, into a buffer of the
+ * handle. So in the steady state a sample is one syscall and no heap
+ * traffic, two with the sample_timestamp_ns read right after it that
+ * dates the sample at its D1 midpoint.
+ *  */
+struct sysfs {
+	int dir_fd;
+	int sample_fd;			/* temp_and_pressure */
+	int timestamp_fd;		/* sample_timestamp_ns, may be -1 */
+	int pres_osr_fd;		/* Opened on first use, may be -1 */
+	int temp_osr_fd;
+	char buf[64];
+};
+
+/*
+ * Parse an unsigned decimal at *p, skipping blanks before it, and move *p
+ * past it. Returning -1 if there is no digit.
+ *  */
+static int parse_uint(const char **p, unsigned int *val)
+{
+	const char *s = *p;
+	unsigned int v = 0;
+
+	while (*s == ' ' || *s == '\t' || *s == '\n')
+		s++;
+	if (*s < '0' || *s > '9')
+		return -1;
+
+	while (*s >= '0' && *s <= '9')
+		v = v * 10 + (*s++ - '0');
+
+	*val = v;
+	*p = s;
+	return 0;
+}
+
+/* Read an attribute into the handle buffer, NUL terminated */
+static int sysfs_pread(struct sysfs *sys, int fd)
+{
+	ssize_t len;
+
+	len = pread(fd, sys->buf, sizeof(sys->buf) - 1, 0);
+	if (len < 0)
+		return -1;
+
+	sys->buf[len] = '\0';
+	return 0;
+}
+
+/*
+ * The OSR the driver has in attribute @name, NULL if it can not be read.
+ * Only at open, so the attribute is not kept open.
+ *  */
+static const struct ms5611_osr_info *sysfs_read_osr(struct sysfs *sys,
+		const char *name)
+{
+	const char *p = sys->buf;
+	unsigned int val;
+	int fd, ret;
+
+	fd = openat(sys->dir_fd, name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	ret = sysfs_pread(sys, fd);
+	close(fd);
+	if (ret < 0 || parse_uint(&p, &val) < 0)
+		return NULL;
+
+	return ms5611_osr_info(val);
+}
+
+static int sysfs_open(struct ms5611_dev *dev, const char *arg)
+{
+	const struct ms5611_osr_info *pres, *temp;
+	const char *path = arg ? arg : MS561101BA_PATH_BASE;
+	struct sysfs *sys;
+
+	sys = calloc(1, sizeof(*sys));
+	if (!sys)
+		return -1;
+
+	sys->pres_osr_fd = -1;
+	sys->temp_osr_fd = -1;
+	sys->dir_fd = open(path, O_RDONLY | O_DIRECTORY);
+	if (sys->dir_fd < 0) {
+		printf("Error: Open %s\n", path);
+		free(sys);
+		return -1;
+	}
+
+	sys->sample_fd = openat(sys->dir_fd, "temp_and_pressure", O_RDONLY);
+	if (sys->sample_fd < 0) {
+		printf("Error: Open %s/temp_and_pressure\n", path);
+		close(sys->dir_fd);
+		free(sys);
+		return -1;
+	}
+
+	/* Drivers before the D1 midpoint do not have it */
+	sys->timestamp_fd = openat(sys->dir_fd, "sample_timestamp_ns",
+			O_RDONLY);
+
+	pres = sysfs_read_osr(sys, "oversampling_pres");
+	temp = sysfs_read_osr(sys, "oversampling_temp");
+	if (!pres || !temp) {
+		printf("Error: Read oversampling from %s\n", path);
+		if (sys->timestamp_fd >= 0)
+			close(sys->timestamp_fd);
+		close(sys->sample_fd);
+		close(sys->dir_fd);
+		free(sys);
+		return -1;
+	}
+
+	dev->pressure_osr = pres;
+	dev->temp_osr = temp;
+	dev->priv = sys;
+	return 0;
+}
+
+static void sysfs_close(struct ms5611_dev *dev)
+{
+	struct sysfs *sys = dev->priv;
+
+	if (sys->pres_osr_fd >= 0)
+		close(sys->pres_osr_fd);
+	if (sys->temp_osr_fd >= 0)
+		close(sys->temp_osr_fd);
+	if (sys->timestamp_fd >= 0)
+		close(sys->timestamp_fd);
+	close(sys->sample_fd);
+	close(sys->dir_fd);
+	free(sys);
+}
+
+/* Only at open, so the attributes are not kept open */
+static int sysfs_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	static const char *names[] = {
+		"sens", "off", "tcs", "tco", "tref", "tempsens"
+	};
+	struct sysfs *sys = dev->priv;
+	const char *p;
+	unsigned int val;
+	int i, fd, ret;
+
+	memset(prom, 0, 8 * sizeof(*prom));
+	for (i = 0; i < 6; i++) {
+		fd = openat(sys->dir_fd, names[i], O_RDONLY);
+		if (fd < 0)
+			return -1;
+
+		ret = sysfs_pread(sys, fd);
+		close(fd);
+		p = sys->buf;
+		if (ret < 0 || parse_uint(&p, &val) < 0)
+			return -1;
+		prom[i + 1] = val;
+	}
+
+	return 0;
+}
+
+static int sysfs_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	struct sysfs *sys = dev->priv;
+	const char *p = sys->buf;
+
+	if (sysfs_pread(sys, sys->sample_fd) < 0)
+		return -1;
+
+	if (parse_uint(&p, &sample->raw_temperature) < 0 ||
+			parse_uint(&p, &sample->raw_pressure) < 0)
+		return -1;
+
+	/* Without the attribute the core dates the sample now */
+	if (sys->timestamp_fd >= 0) {
+		if (sysfs_pread(sys, sys->timestamp_fd) < 0)
+			return -1;
+		sample->timestamp_ns = strtoull(sys->buf, NULL, 10);
+	}
+	return 0;
+}
+
+static int sysfs_write_uint(struct sysfs *sys, int *fd, const char *name,
+		unsigned int val)
+{
+	char buf[16], *p = buf + sizeof(buf);
+
+	if (*fd < 0) {
+		*fd = openat(sys->dir_fd, name, O_WRONLY);
+		if (*fd < 0) {
+			printf("Error: Open %s\n", name);
+			return -1;
+		}
+	}
+
+	do {
+		*--p = '0' + val % 10;
+		val /= 10;
+	} while (val);
+
+	return pwrite(*fd, p, buf + sizeof(buf) - p, 0) < 0 ? -1 : 0;
+}
+
+static int sysfs_set_oversampling(struct ms5611_dev *dev,
+		const struct ms5611_osr_info *pressure,
+		const struct ms5611_osr_info *temperature)
+{
+	struct sysfs *sys = dev->priv;
+
+	if (sysfs_write_uint(sys, &sys->pres_osr_fd, "oversampling_pres",
+				pressure->rate) < 0)
+		return -1;
+
+	return sysfs_write_uint(sys, &sys->temp_osr_fd, "oversampling_temp",
+			temperature->rate);
+}
+
+const struct ms5611_backend ms5611_sysfs_backend = {
+	.name			= "sysfs",
+	.open			= sysfs_open,
+	.close			= sysfs_close,
+	.read_prom		= sysfs_read_prom,
+	.read			= sysfs_read,
+	.set_oversampling	= sysfs_set_oversampling,
+};
+
+/*
+ * chardev backend, the binary sample stream of the kernel driver. Each
+ * read returns the next sample of the stream, so in continuous mode a slow
+ * caller sees every sample in order rather than only the latest one.
+ *  */
+/* The OSRs are in the header of the mapped ring */
+static int chardev_read_osr(struct ms5611_dev *dev, int fd)
+{
+	const struct ms5611_ring_header *hdr;
+	const struct ms5611_osr_info *pres, *temp;
+	unsigned int seq;
+
+	hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		return -1;
+
+	/* The pair is consistent once 'seq' is even and did not move */
+	for (;;) {
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		pres = ms5611_osr_info(hdr->pressure_osr);
+		temp = ms5611_osr_info(hdr->temp_osr);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+	munmap((void *)hdr, sizeof(*hdr));
+	if (!pres || !temp)
+		return -1;
+
+	dev->pressure_osr = pres;
+	dev->temp_osr = temp;
+	return 0;
+}
+
+static int chardev_open(struct ms5611_dev *dev, const char *arg)
+{
+	const char *path = arg ? arg : MS561101BA_DEV_PATH;
+	unsigned int format;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Open %s\n", path);
+		return -1;
+	}
+
+	/* Records with boottime_ns, the file starts out in format 1 */
+	format = MS5611_FORMAT;
+	if (ioctl(fd, MS5611_IOC_SET_FORMAT, &format) < 0) {
+		printf("Error: Record format of %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	if (chardev_read_osr(dev, fd) < 0) {
+		printf("Error: Read oversampling from %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	dev->priv = (void *)(long)fd;
+	return 0;
+}
+
+static void chardev_close(struct ms5611_dev *dev)
+{
+	close((int)(long)dev->priv);
+}
+
+/* The calibration is in the header of the mapped ring */
+static int chardev_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	const struct ms5611_ring_header *hdr;
+	int fd = (int)(long)dev->priv;
+
+	hdr = mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		return -1;
+
+	memcpy(prom, hdr->calibration, sizeof(hdr->calibration));
+	munmap((void *)hdr, sizeof(*hdr));
+	return 0;
+}
+
+static int chardev_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	struct ms5611_record rec;
+	int fd = (int)(long)dev->priv;
+
+	if (read(fd, &rec, sizeof(rec)) != sizeof(rec))
+		return -1;
+
+	sample->raw_pressure = rec.raw_pressure;
+	sample->raw_temperature = rec.raw_temperature;
+	sample->timestamp_ns = rec.timestamp_ns;
+	sample->boottime_ns = rec.boottime_ns;
+	sample->temp_age_usec = rec.temp_age_usec;
+	return 0;
+}
+
+const struct ms5611_backend ms5611_chardev_backend = {
+	.name		= "chardev",
+	.open		= chardev_open,
+	.close		= chardev_close,
+	.read_prom	= chardev_read_prom,
+	.read		= chardev_read,
+};
@@ -0,0 +1,47 @@
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include "ms5611.h"
+
+/* Sensor commands, for the backends that drive the bus themselves */
+#define CMD_ADC_READ			0x00
+#define CMD_RST				0x1E
+#define CALI_DATA_START			0xA0
+#define CALI_DATA_LEN			8
+
+/*
+ * A way of talking to the sensor. 'open' gets the part of the spec after
+ * the colon, or NULL, and stores its state in 'dev->priv'. 'read' fills in
+ * the raw values and, when the backend knows it, 'timestamp_ns'; the core
+ * compensates. 'set_oversampling' may be NULL.
+ *  */
+struct ms5611_backend {
+	const char *name;
+	int (*open)(struct ms5611_dev *, const char *);
+	void (*close)(struct ms5611_dev *);
+	int (*read_prom)(struct ms5611_dev *, unsigned short *);
+	int (*read)(struct ms5611_dev *, struct ms5611_sample *);
+	int (*set_oversampling)(struct ms5611_dev *, const struct ms5611_osr_info *,
+			const struct ms5611_osr_info *);
+};
+
+struct ms5611_dev {
+	const struct ms5611_backend *ops;
+	void *priv;
+	unsigned short prom[8];
+	struct ms5611_calibration cali;
+	const struct ms5611_osr_info *pressure_osr;	/* As last set, */
+	const struct ms5611_osr_info *temp_osr;		/* see ms5611_open() */
+};
+
+void ms5611_sleep_usec(unsigned int usec);
+
+extern const struct ms5611_backend ms5611_sysfs_backend;
+extern const struct ms5611_backend ms5611_chardev_backend;
+extern const struct ms5611_backend ms5611_sim_backend;
+extern const struct ms5611_backend ms5611_i2cdev_backend;
+extern const struct ms5611_backend ms5611_spidev_backend;
+extern const struct ms5611_backend ms5611_capture_backend;
+extern const struct ms5611_backend ms5611_daemon_backend;
+
+#endif /* _BACKEND_H_ */
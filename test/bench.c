@@ -0,0 +1,514 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ops.h"
+#include "ms5611.h"
+
+/*
+ * Usage: bench [-b spec]... [-o pres:temp|all]... [-r readers]...
+ *              [-d seconds] [-f csv|json]
+ *
+ * Runs every combination of access path, oversampling and reader count
+ * for 'seconds' each and prints one result per run:
+ *   samples/s		all readers together
+ *   p50 .. max		latency of one read call, from a histogram
+ *   cpu/sample		CPU time of the readers per sample
+ *   interval, jitter	mean and standard deviation of the time between
+ *			the timestamps of consecutive samples of a reader
+ *
+ * Besides the ms5611_open() specs, see ms5611.h, two more paths:
+ *   "legacy[:<dir>]"	sysfs text through read_data_block(), as the
+ *			library read samples before the handle API
+ *   "map[:<dev>]"	the mmap()ed ring of the driver, polled
+ *
+ * Without -b the simulator is measured, without -o the oversampling is
+ * left alone, -o all runs the 25 combinations of the driver's OSR tables.
+ * JSON output also has the latency histogram of each run.
+ *  */
+#define MAX_RUNS		64
+#define SUB_BITS		4	/* 16 linear buckets per power of two */
+#define HIST_SIZE		1024
+
+static const unsigned short osr_rates[] = { 256, 512, 1024, 2048, 4096 };
+
+/*
+ * Latency histogram, values below 2^(SUB_BITS + 1) are exact, above that
+ * a bucket is 1/16 of its power of two wide.
+ *  */
+struct hist {
+	unsigned long long count[HIST_SIZE];
+	unsigned long long total;
+	unsigned long long max;
+};
+
+static unsigned int hist_index(unsigned long long v)
+{
+	unsigned int e;
+
+	if (v < 2ULL << SUB_BITS)
+		return v;
+
+	e = 63 - __builtin_clzll(v) - SUB_BITS;
+	return (2 << SUB_BITS) + (e - 1) * (1 << SUB_BITS) +
+		(v >> e) - (1 << SUB_BITS);
+}
+
+/* Largest value that falls into bucket @i */
+static unsigned long long hist_upper(unsigned int i)
+{
+	unsigned int e;
+
+	if (i < 2 << SUB_BITS)
+		return i;
+
+	i -= 2 << SUB_BITS;
+	e = i / (1 << SUB_BITS) + 1;
+	return ((((1ULL << SUB_BITS) + i % (1 << SUB_BITS)) + 1) << e) - 1;
+}
+
+static void hist_add(struct hist *h, unsigned long long v)
+{
+	h->count[hist_index(v)]++;
+	h->total++;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void hist_merge(struct hist *to, const struct hist *from)
+{
+	int i;
+
+	for (i = 0; i < HIST_SIZE; i++)
+		to->count[i] += from->count[i];
+	to->total += from->total;
+	if (from->max > to->max)
+		to->max = from->max;
+}
+
+static unsigned long long hist_percentile(const struct hist *h, double p)
+{
+	unsigned long long want = ceil(h->total * p / 100.0), seen = 0;
+	unsigned long long v;
+	int i;
+
+	if (want == 0)
+		want = 1;
+
+	for (i = 0; i < HIST_SIZE; i++) {
+		seen += h->count[i];
+		if (seen >= want) {
+			v = hist_upper(i);
+			return v < h->max ? v : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+/* One run, and the state of one reader thread of it */
+struct run {
+	const char *spec;
+	unsigned short pres_osr, temp_osr;	/* 0 if left alone */
+	int readers;
+	double seconds;
+	struct hist hist;
+	unsigned long long samples, errors, cpu_ns;
+	unsigned long long intervals;
+	double interval_sum, interval_sq;
+};
+
+struct reader {
+	struct run *run;
+	pthread_t thread;
+	unsigned long long deadline;
+	struct hist hist;
+	unsigned long long samples, errors, cpu_ns;
+	unsigned long long intervals;
+	double interval_sum, interval_sq;
+	int ret;
+};
+
+static unsigned long long cpu_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The argument of a "name:arg" spec, or @def */
+static const char *spec_arg(const char *spec, const char *def)
+{
+	const char *colon = strchr(spec, ':');
+
+	return colon ? colon + 1 : def;
+}
+
+static int spec_is(const char *spec, const char *name)
+{
+	size_t len = strlen(name);
+
+	return !strncmp(spec, name, len) &&
+		(spec[len] == '\0' || spec[len] == ':');
+}
+
+static int legacy_read(const char *dir, unsigned long long *timestamp)
+{
+	unsigned int pressure, temperature;
+	char *buf = NULL, *t, *p;
+
+	if (read_data_block(dir, "temp_and_pressure", &buf) < 0)
+		return -1;
+
+	*timestamp = ms5611_now_ns();
+	t = strtok(buf, " ");
+	p = t ? strtok(NULL, " ") : NULL;
+	if (!t || !p) {
+		free(buf);
+		return -1;
+	}
+	temperature = strtoul(t, NULL, 10);
+	pressure = strtoul(p, NULL, 10);
+	free(buf);
+
+	return pressure && temperature ? 0 : -1;
+}
+
+/* Returning 1 if nothing came before the deadline */
+static int map_read(struct ms5611_map *map, unsigned long long *timestamp,
+		unsigned long long deadline)
+{
+	struct ms5611_record rec;
+
+	while (ms5611_map_read(map, &rec, 1) == 0) {
+		if (ms5611_now_ns() >= deadline)
+			return 1;
+		sched_yield();
+	}
+
+	*timestamp = rec.timestamp_ns;
+	return 0;
+}
+
+static int set_oversampling(struct run *run, struct ms5611_dev *dev)
+{
+	const char *dir;
+
+	if (!run->pres_osr)
+		return 0;
+
+	if (dev)
+		return ms5611_dev_set_oversampling(dev, run->pres_osr,
+				run->temp_osr);
+
+	if (!spec_is(run->spec, "legacy"))
+		return -1;
+
+	dir = spec_arg(run->spec, MS561101BA_PATH_BASE);
+	if (write_data(dir, "oversampling_pres", run->pres_osr) < 0)
+		return -1;
+	return write_data(dir, "oversampling_temp", run->temp_osr);
+}
+
+static void *reader_main(void *arg)
+{
+	struct reader *r = arg;
+	struct run *run = r->run;
+	struct ms5611_dev *dev = NULL;
+	struct ms5611_map map;
+	struct ms5611_sample sample;
+	unsigned long long t0, t1, ts, last_ts = 0, cpu;
+	const char *dir = NULL;
+	int is_map = 0, ret;
+	double d;
+
+	r->ret = -1;
+	if (spec_is(run->spec, "legacy")) {
+		dir = spec_arg(run->spec, MS561101BA_PATH_BASE);
+	} else if (spec_is(run->spec, "map")) {
+		if (ms5611_map_open(&map, spec_arg(run->spec,
+						MS561101BA_DEV_PATH)) < 0)
+			return NULL;
+		is_map = 1;
+	} else {
+		dev = ms5611_open(run->spec);
+		if (!dev)
+			return NULL;
+	}
+
+	if (!is_map && set_oversampling(run, dev) < 0) {
+		fprintf(stderr, "%s: oversampling %u:%u not supported\n",
+				run->spec, run->pres_osr, run->temp_osr);
+		goto out;
+	}
+
+	cpu = cpu_now_ns();
+	for (;;) {
+		t0 = ms5611_now_ns();
+		if (t0 >= r->deadline)
+			break;
+
+		if (dev) {
+			ret = ms5611_dev_read(dev, &sample);
+			ts = sample.timestamp_ns;
+		} else if (is_map) {
+			ret = map_read(&map, &ts, r->deadline);
+		} else {
+			ret = legacy_read(dir, &ts);
+		}
+		t1 = ms5611_now_ns();
+
+		if (ret > 0)
+			break;
+		/* A path that never worked is not worth the whole run */
+		if (ret < 0 && ++r->errors >= 100 && !r->samples) {
+			fprintf(stderr, "%s: no samples\n", run->spec);
+			goto out;
+		}
+		if (ret < 0)
+			continue;
+
+		hist_add(&r->hist, t1 - t0);
+		r->samples++;
+		if (last_ts && ts > last_ts) {
+			d = ts - last_ts;
+			r->interval_sum += d;
+			r->interval_sq += d * d;
+			r->intervals++;
+		}
+		last_ts = ts;
+	}
+	r->cpu_ns = cpu_now_ns() - cpu;
+	r->ret = 0;
+
+out:
+	if (dev)
+		ms5611_close(dev);
+	if (is_map)
+		ms5611_map_close(&map);
+	return NULL;
+}
+
+static int run_one(struct run *run)
+{
+	struct reader *readers;
+	unsigned long long deadline;
+	int i, ret = 0;
+
+	readers = calloc(run->readers, sizeof(*readers));
+	if (!readers)
+		return -1;
+
+	deadline = ms5611_now_ns() + run->seconds * 1e9;
+	for (i = 0; i < run->readers; i++) {
+		readers[i].run = run;
+		readers[i].deadline = deadline;
+		if (pthread_create(&readers[i].thread, NULL, reader_main,
+					&readers[i])) {
+			printf("Error: Start reader %d\n", i);
+			run->readers = i;
+			ret = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < run->readers; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].ret < 0)
+			ret = -1;
+
+		hist_merge(&run->hist, &readers[i].hist);
+		run->samples += readers[i].samples;
+		run->errors += readers[i].errors;
+		run->cpu_ns += readers[i].cpu_ns;
+		run->intervals += readers[i].intervals;
+		run->interval_sum += readers[i].interval_sum;
+		run->interval_sq += readers[i].interval_sq;
+	}
+
+	free(readers);
+	return ret;
+}
+
+static void run_stats(const struct run *run, double *rate, double *cpu,
+		double *interval, double *jitter)
+{
+	double var;
+
+	*rate = run->samples / run->seconds;
+	*cpu = run->samples ? (double)run->cpu_ns / run->samples : 0;
+	*interval = *jitter = 0;
+	if (run->intervals) {
+		*interval = run->interval_sum / run->intervals;
+		var = run->interval_sq / run->intervals - *interval * *interval;
+		*jitter = var > 0 ? sqrt(var) : 0;
+	}
+}
+
+static void print_csv_header(void)
+{
+	printf("backend,pres_osr,temp_osr,readers,seconds,samples,errors,"
+			"samples_per_s,p50_ns,p99_ns,p999_ns,max_ns,"
+			"cpu_ns_per_sample,interval_ns,jitter_ns\n");
+}
+
+static void print_csv(const struct run *run)
+{
+	double rate, cpu, interval, jitter;
+
+	run_stats(run, &rate, &cpu, &interval, &jitter);
+	printf("%s,%u,%u,%d,%.3f,%llu,%llu,%.1f,%llu,%llu,%llu,%llu,"
+			"%.0f,%.0f,%.0f\n", run->spec, run->pres_osr,
+			run->temp_osr, run->readers, run->seconds,
+			run->samples, run->errors, rate,
+			hist_percentile(&run->hist, 50),
+			hist_percentile(&run->hist, 99),
+			hist_percentile(&run->hist, 99.9),
+			run->hist.max, cpu, interval, jitter);
+}
+
+static void print_json(const struct run *run, int first)
+{
+	double rate, cpu, interval, jitter;
+	const char *sep = "";
+	int i;
+
+	run_stats(run, &rate, &cpu, &interval, &jitter);
+	printf("%s  {\"backend\": \"%s\", \"pres_osr\": %u, \"temp_osr\": %u, "
+			"\"readers\": %d, \"seconds\": %.3f, \"samples\": %llu, "
+			"\"errors\": %llu, \"samples_per_s\": %.1f, "
+			"\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+			"\"max_ns\": %llu, \"cpu_ns_per_sample\": %.0f, "
+			"\"interval_ns\": %.0f, \"jitter_ns\": %.0f, "
+			"\"histogram\": [", first ? "" : ",\n", run->spec,
+			run->pres_osr, run->temp_osr, run->readers,
+			run->seconds, run->samples, run->errors, rate,
+			hist_percentile(&run->hist, 50),
+			hist_percentile(&run->hist, 99),
+			hist_percentile(&run->hist, 99.9),
+			run->hist.max, cpu, interval, jitter);
+
+	/* Upper bound of each non-empty bucket and its count */
+	for (i = 0; i < HIST_SIZE; i++) {
+		if (!run->hist.count[i])
+			continue;
+		printf("%s[%llu, %llu]", sep, hist_upper(i),
+				run->hist.count[i]);
+		sep = ", ";
+	}
+	printf("]}");
+}
+
+static void usage(void)
+{
+	printf("Usage: bench [-b spec]... [-o pres:temp|all]... "
+			"[-r readers]... [-d seconds] [-f csv|json]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *specs[MAX_RUNS];
+	unsigned short osrs[MAX_RUNS][2];
+	int readers[MAX_RUNS];
+	int nspecs = 0, nosrs = 0, nreaders = 0, json = 0;
+	double seconds = 1;
+	unsigned int p, t;
+	struct run *runs;
+	int i, j, k, n = 0, opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "b:o:r:d:f:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			if (nspecs < MAX_RUNS)
+				specs[nspecs++] = optarg;
+			break;
+		case 'o':
+			if (!strcmp(optarg, "all")) {
+				for (p = 0; p < 5; p++)
+					for (t = 0; t < 5 && nosrs < MAX_RUNS;
+							t++) {
+						osrs[nosrs][0] = osr_rates[p];
+						osrs[nosrs++][1] = osr_rates[t];
+					}
+				break;
+			}
+			if (sscanf(optarg, "%u:%u", &p, &t) != 2 ||
+					!ms5611_osr_info(p) ||
+					!ms5611_osr_info(t)) {
+				printf("Error: Oversampling %s\n", optarg);
+				return 1;
+			}
+			if (nosrs < MAX_RUNS) {
+				osrs[nosrs][0] = p;
+				osrs[nosrs++][1] = t;
+			}
+			break;
+		case 'r':
+			if (nreaders < MAX_RUNS)
+				readers[nreaders++] = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atof(optarg);
+			break;
+		case 'f':
+			json = !strcmp(optarg, "json");
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (!nspecs)
+		specs[nspecs++] = "sim";
+	if (!nosrs) {
+		osrs[0][0] = osrs[0][1] = 0;
+		nosrs = 1;
+	}
+	if (!nreaders)
+		readers[nreaders++] = 1;
+
+	runs = calloc(nspecs * nosrs * nreaders, sizeof(*runs));
+	if (!runs)
+		return 1;
+
+	if (json)
+		printf("[\n");
+	else
+		print_csv_header();
+
+	for (i = 0; i < nspecs; i++)
+		for (j = 0; j < nosrs; j++)
+			for (k = 0; k < nreaders; k++) {
+				struct run *run = &runs[n];
+
+				memset(run, 0, sizeof(*run));
+				run->spec = specs[i];
+				run->pres_osr = osrs[j][0];
+				run->temp_osr = osrs[j][1];
+				run->readers = readers[k] > 0 ? readers[k] : 1;
+				run->seconds = seconds;
+				if (run_one(run) < 0) {
+					ret = 1;
+					continue;
+				}
+
+				if (json)
+					print_json(run, n == 0);
+				else
+					print_csv(run);
+				fflush(stdout);
+				n++;
+			}
+
+	if (json)
+		printf("\n]\n");
+
+	free(runs);
+	return ret;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ms5611.h"
+
+/*
+ * Usage: bench_altitude [samples [rounds]]
+ *
+ * Measures the largest error of ms5611_altitude_mm() and
+ * ms5611_altitude_m() against the exact barometric formula every 0.25 Pa
+ * from 10 to 1200 mbar for several QNHs, then times them, single and
+ * batch, against pow() and powf() on 'samples' pressures around sea level.
+ * Fails if an error is above the one documented in altitude.c.
+ *  */
+#define ALT_T0_L		44330.769	/* m */
+#define ALT_EXPONENT		0.190263
+#define MAX_ERROR_M		0.020
+
+static const int32_t qnhs[] = { 95000, 98000, 101325, 103000, 105000 };
+
+static double exact(double p, double qnh)
+{
+	return ALT_T0_L * (1.0 - pow(p / qnh, ALT_EXPONENT));
+}
+
+static int check(void)
+{
+	struct ms5611_altitude_ref ref;
+	double err_mm = 0, err_m = 0, e, h, at_mm = 0, at_m = 0;
+	unsigned int i;
+	int32_t p;
+
+	for (i = 0; i < sizeof(qnhs) / sizeof(qnhs[0]); i++) {
+		ms5611_altitude_ref_init(&ref, qnhs[i]);
+		for (p = 4000; p <= 480000; p++) {
+			h = exact(p / 4.0, qnhs[i]);
+			if (!(p & 3)) {
+				e = fabs(ms5611_altitude_mm(&ref, p / 4) /
+						1000.0 - h);
+				if (e > err_mm) {
+					err_mm = e;
+					at_mm = p / 4.0;
+				}
+			}
+			e = fabs(ms5611_altitude_m(&ref, p / 4.0f) - h);
+			if (e > err_m) {
+				err_m = e;
+				at_m = p / 4.0;
+			}
+		}
+	}
+
+	printf("max error: integer %.4f m at %.2f Pa, float %.4f m at %.2f "
+			"Pa\n", err_mm, at_mm, err_m, at_m);
+	return err_mm <= MAX_ERROR_M && err_m <= MAX_ERROR_M ? 0 : -1;
+}
+
+static void report(const char *name, size_t count, unsigned long long ns,
+		double sum)
+{
+	printf("%-12s %8.2f ns/sample (%g)\n", name, (double)ns / count, sum);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t samples = argc > 1 ? strtoul(argv[1], NULL, 0) : 4096;
+	int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+	struct ms5611_altitude_ref ref;
+	unsigned long long start;
+	int32_t *pi, *hi;
+	float *pf, *hf;
+	double sum;
+	size_t i;
+	int r;
+
+	if (check() < 0) {
+		printf("Error: Above %.3f m\n", MAX_ERROR_M);
+		return 1;
+	}
+
+	pi = malloc(samples * sizeof(*pi));
+	hi = malloc(samples * sizeof(*hi));
+	pf = malloc(samples * sizeof(*pf));
+	hf = malloc(samples * sizeof(*hf));
+	if (!pi || !hi || !pf || !hf)
+		return 1;
+
+	for (i = 0; i < samples; i++) {
+		pi[i] = 90000 + rand() % 20000;
+		pf[i] = pi[i] + (rand() % 100) / 100.0f;
+	}
+	ms5611_altitude_ref_init(&ref, 101325);
+
+	/* The sums keep the loops from being optimized away */
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			sum += ALT_T0_L * (1.0 - pow(pf[i] / 101325.0,
+						ALT_EXPONENT));
+	report("pow", samples * rounds, ms5611_now_ns() - start, sum);
+
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			sum += 44330.769f * (1.0f - powf(pf[i] / 101325.0f,
+						0.190263f));
+	report("powf", samples * rounds, ms5611_now_ns() - start, sum);
+
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			sum += ms5611_altitude_mm(&ref, pi[i]);
+	report("integer", samples * rounds, ms5611_now_ns() - start, sum);
+
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < samples; i++)
+			sum += ms5611_altitude_m(&ref, pf[i]);
+	report("float", samples * rounds, ms5611_now_ns() - start, sum);
+
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++) {
+		ms5611_altitude_mm_batch(&ref, pi, hi, samples);
+		sum += hi[r % samples];
+	}
+	report("integer/batch", samples * rounds, ms5611_now_ns() - start, sum);
+
+	sum = 0;
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++) {
+		ms5611_altitude_m_batch(&ref, pf, hf, samples);
+		sum += hf[r % samples];
+	}
+	report("float/batch", samples * rounds, ms5611_now_ns() - start, sum);
+
+	free(pi);
+	free(hi);
+	free(pf);
+	free(hf);
+	return 0;
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "ms5611.h"
+
+/*
+ * Usage: bench_async [-o pres:temp] [-q depth] [-d sec] [-t msec] spec...
+ *
+ * Sample throughput of one thread over the sensors of the specs, "sysfs"
+ * or "i2c" ones, see ms5611.h. First with blocking ms5611_dev_read() calls
+ * in turn, then through ms5611_async with 'depth' requests queued per
+ * sensor, each failing after 'msec' (default 1000), for 'sec' seconds
+ * each (default 5). Prints samples/s and the CPU time per sample; the
+ * async run also prints its timeouts and errors and cancels what is left
+ * at the end.
+ *  */
+#define MAX_SENSORS			16
+
+struct bench {
+	struct ms5611_async *ctx;
+	unsigned long long timeout_ns;
+	int stop;
+	unsigned long long ok, timeouts, cancelled, errors;
+	unsigned long long pending;
+};
+
+struct slot {
+	struct bench *b;
+	int sensor;
+	long long id;
+};
+
+static double cpu_sec(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static void report(const char *name, unsigned long long samples,
+		unsigned long long ns, double cpu)
+{
+	printf("%-10s %8llu samples %10.1f samples/s %8.1f us cpu/sample\n",
+			name, samples, samples * 1e9 / ns,
+			samples ? cpu * 1e6 / samples : 0);
+}
+
+static int run_blocking(char **specs, int n, unsigned short posr,
+		unsigned short tosr, unsigned int sec)
+{
+	struct ms5611_dev *devs[MAX_SENSORS];
+	struct ms5611_sample sample;
+	unsigned long long start, end, samples = 0;
+	double cpu;
+	int i, ret = 0;
+
+	for (i = 0; i < n; i++) {
+		devs[i] = ms5611_open(specs[i]);
+		if (!devs[i] || ms5611_dev_set_oversampling(devs[i], posr,
+					tosr) < 0) {
+			printf("Error: Open %s\n", specs[i]);
+			n = i + !!devs[i];
+			ret = -1;
+			goto exit_close;
+		}
+	}
+
+	cpu = cpu_sec();
+	start = ms5611_now_ns();
+	end = start + sec * 1000000000ULL;
+	while (ms5611_now_ns() < end) {
+		for (i = 0; i < n; i++) {
+			if (ms5611_dev_read(devs[i], &sample) < 0) {
+				printf("Error: Read %s\n", specs[i]);
+				ret = -1;
+				goto exit_close;
+			}
+			samples++;
+		}
+	}
+	report("blocking", samples, ms5611_now_ns() - start, cpu_sec() - cpu);
+
+exit_close:
+	for (i = 0; i < n; i++)
+		ms5611_close(devs[i]);
+	return ret;
+}
+
+static void on_sample(void *arg, int status, const struct ms5611_sample *s)
+{
+	struct slot *slot = arg;
+	struct bench *b = slot->b;
+
+	(void)s;
+	b->pending--;
+	if (status == 0)
+		b->ok++;
+	else if (status == -ETIMEDOUT)
+		b->timeouts++;
+	else if (status == -ECANCELED)
+		b->cancelled++;
+	else
+		b->errors++;
+
+	slot->id = -1;
+	if (b->stop)
+		return;
+
+	slot->id = ms5611_async_submit(b->ctx, slot->sensor, b->timeout_ns,
+			on_sample, slot);
+	if (slot->id >= 0)
+		b->pending++;
+}
+
+static int run_async(char **specs, int n, unsigned short posr,
+		unsigned short tosr, unsigned int sec, unsigned int depth,
+		unsigned int timeout_ms)
+{
+	struct bench b = { .timeout_ns = timeout_ms * 1000000ULL };
+	unsigned long long start, end;
+	struct slot *slots;
+	double cpu;
+	int i, ret = -1;
+
+	slots = calloc(n * depth, sizeof(*slots));
+	b.ctx = ms5611_async_create(n * depth);
+	if (!slots || !b.ctx)
+		goto exit_free;
+
+	for (i = 0; i < n; i++)
+		if (ms5611_async_open(b.ctx, specs[i], posr, tosr) != i)
+			goto exit_free;
+
+	cpu = cpu_sec();
+	start = ms5611_now_ns();
+	end = start + sec * 1000000000ULL;
+	for (i = 0; i < (int)(n * depth); i++) {
+		slots[i].b = &b;
+		slots[i].sensor = i % n;
+		slots[i].id = ms5611_async_submit(b.ctx, i % n, b.timeout_ns,
+				on_sample, &slots[i]);
+		if (slots[i].id < 0)
+			goto exit_free;
+		b.pending++;
+	}
+
+	while (ms5611_now_ns() < end)
+		if (ms5611_async_run(b.ctx, 100) < 0)
+			goto exit_free;
+
+	report("async", b.ok, ms5611_now_ns() - start, cpu_sec() - cpu);
+
+	/* Cancel what is in flight and let the kernel finish with it */
+	b.stop = 1;
+	for (i = 0; i < (int)(n * depth); i++)
+		if (slots[i].id >= 0)
+			ms5611_async_cancel(b.ctx, slots[i].id);
+	while (b.pending)
+		if (ms5611_async_run(b.ctx, 100) < 0)
+			goto exit_free;
+	ms5611_async_run(b.ctx, 0);
+
+	printf("           %llu timeouts, %llu errors, %llu cancelled\n",
+			b.timeouts, b.errors, b.cancelled);
+	ret = 0;
+
+exit_free:
+	ms5611_async_destroy(b.ctx);
+	free(slots);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int pres_osr = 4096, temp_osr = 4096, depth = 4, sec = 5;
+	unsigned int timeout_ms = 1000;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "o:q:d:t:")) != -1) {
+		switch (opt) {
+		case 'o':
+			if (sscanf(optarg, "%u:%u", &pres_osr, &temp_osr) != 2)
+				return 1;
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			sec = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			timeout_ms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	n = argc - optind;
+	if (n < 1 || n > MAX_SENSORS || !depth) {
+		printf("Error: 1 to %d sensors\n", MAX_SENSORS);
+		return 1;
+	}
+
+	if (run_blocking(argv + optind, n, pres_osr, temp_osr, sec) < 0 ||
+			run_async(argv + optind, n, pres_osr, temp_osr, sec,
+				depth, timeout_ms) < 0)
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ms5611.h"
+#include "bench_random.h"
+
+/*
+ * Usage: bench_compensate [samples [rounds]]
+ *
+ * Checks every batch kernel the CPU runs against ms5611_compensate() on
+ * random calibrations and ADC codes over the whole 24-bit range, which
+ * reaches both second order corrections, then times each on 'samples'
+ * samples 'rounds' times and prints the throughput in samples/ns. The
+ * per-sample ms5611_compensate() loop is timed as "reference".
+ *  */
+#define CHECK_CALIBRATIONS		1000
+#define CHECK_SAMPLES			1027	/* Not a multiple of the lanes */
+
+static const char *names[] = { "avx2", "sse4", "neon", "scalar" };
+
+static void random_samples(uint32_t *d1, uint32_t *d2, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		d1[i] = random32() & 0xFFFFFF;
+		d2[i] = random32() & 0xFFFFFF;
+	}
+
+	/* The ends of the range */
+	if (n >= 4) {
+		d1[0] = d2[0] = 0;
+		d1[1] = d2[1] = 0xFFFFFF;
+		d1[2] = 0;
+		d2[2] = 0xFFFFFF;
+		d1[3] = 0xFFFFFF;
+		d2[3] = 0;
+	}
+}
+
+/* Returning the number of samples that differ from the reference */
+static unsigned long check(const char *name)
+{
+	static const struct ms5611_calibration datasheet = {
+		40127, 36924, 23317, 23282, 33464, 28312
+	};
+	uint32_t d1[CHECK_SAMPLES], d2[CHECK_SAMPLES];
+	int32_t p[CHECK_SAMPLES], t[CHECK_SAMPLES];
+	struct ms5611_calibration cali = datasheet;
+	unsigned long bad = 0;
+	int i, j, rp, rt;
+	size_t n;
+
+	for (i = 0; i < CHECK_CALIBRATIONS; i++) {
+		random_samples(d1, d2, CHECK_SAMPLES);
+		for (n = 0; n < 16 && n < CHECK_SAMPLES; n++) {
+			/* Short batches, the tails alone */
+			ms5611_compensate_batch(&cali, d1, d2, p, t, n);
+			for (j = 0; j < (int)n; j++) {
+				ms5611_compensate(&cali, d1[j], d2[j], &rp, &rt);
+				bad += p[j] != rp || t[j] != rt;
+			}
+		}
+
+		ms5611_compensate_batch(&cali, d1, d2, p, t, CHECK_SAMPLES);
+		for (j = 0; j < CHECK_SAMPLES; j++) {
+			ms5611_compensate(&cali, d1[j], d2[j], &rp, &rt);
+			if (p[j] == rp && t[j] == rt)
+				continue;
+			if (!bad)
+				printf("%s: D1 %u D2 %u gives %d %d, not %d %d\n",
+						name, d1[j], d2[j], p[j], t[j],
+						rp, rt);
+			bad++;
+		}
+
+		cali.c1 = random32();
+		cali.c2 = random32();
+		cali.c3 = random32();
+		cali.c4 = random32();
+		cali.c5 = random32();
+		cali.c6 = random32();
+	}
+
+	return bad;
+}
+
+static void report(const char *name, size_t count, unsigned long long ns)
+{
+	printf("%-10s %8.3f samples/ns %8.3f ns/sample\n", name,
+			(double)count / ns, (double)ns / count);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct ms5611_calibration cali = {
+		40127, 36924, 23317, 23282, 33464, 28312
+	};
+	size_t samples = argc > 1 ? strtoul(argv[1], NULL, 0) : 65536;
+	int rounds = argc > 2 ? atoi(argv[2]) : 1000;
+	unsigned long long start;
+	uint32_t *d1, *d2;
+	int32_t *p, *t;
+	unsigned long bad;
+	unsigned int i;
+	int r, ret = 0;
+	size_t j;
+
+	d1 = malloc(samples * sizeof(*d1));
+	d2 = malloc(samples * sizeof(*d2));
+	p = malloc(samples * sizeof(*p));
+	t = malloc(samples * sizeof(*t));
+	if (!d1 || !d2 || !p || !t) {
+		printf("Error: Allocate %zu samples\n", samples);
+		return 1;
+	}
+
+	/* Typical readings, around 20 degC and 1000 mbar */
+	for (j = 0; j < samples; j++) {
+		d1[j] = 9085466 + (random32() & 0xFFFF) - 0x8000;
+		d2[j] = 8569150 + (random32() & 0x3FFFF) - 0x20000;
+	}
+
+	start = ms5611_now_ns();
+	for (r = 0; r < rounds; r++)
+		for (j = 0; j < samples; j++)
+			ms5611_compensate(&cali, d1[j], d2[j], &p[j], &t[j]);
+	report("reference", samples * rounds, ms5611_now_ns() - start);
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (ms5611_compensate_batch_select(names[i]) < 0)
+			continue;
+
+		bad = check(names[i]);
+		if (bad) {
+			printf("%s: %lu samples differ\n", names[i], bad);
+			ret = 1;
+			continue;
+		}
+
+		start = ms5611_now_ns();
+		for (r = 0; r < rounds; r++)
+			ms5611_compensate_batch(&cali, d1, d2, p, t, samples);
+		report(names[i], samples * rounds, ms5611_now_ns() - start);
+	}
+
+	ms5611_compensate_batch_select(NULL);
+	printf("default    %s\n", ms5611_compensate_batch_kernel());
+
+	free(d1);
+	free(d2);
+	free(p);
+	free(t);
+	return ret;
+}
@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstdlib>
+#include "ms5611.hpp"
+#include "bench_random.h"
+
+/*
+ * Usage: bench_cpp [samples [rounds]]
+ *
+ * Checks ms5611.hpp against the C library, at compile time where it can,
+ * then times each C++ path against the C it replaces on the same data:
+ * compensation, the PROM CRC, a sensor<> read against a hand-written read
+ * over the same bus, and device<> against ms5611_dev_read() on "sim". The
+ * ratio is C++ time over C time, best of five runs each, 1.00 or below
+ * means no overhead. Fails only if the results differ.
+ *
+ * Build the C files with gcc and this one with g++ -std=c++17.
+ *  */
+#define TRIALS			5
+
+using namespace ms5611;
+
+/* The datasheet example */
+constexpr ms5611_calibration datasheet = { 40127, 36924, 23317, 23282, 33464,
+	28312 };
+
+static_assert(compensate(datasheet, 9085466, 8569150).pressure ==
+		pascal(100009), "datasheet pressure");
+static_assert(compensate(datasheet, 9085466, 8569150).temperature ==
+		centi_celsius(2007), "datasheet temperature");
+static_assert(compensate(datasheet, 8000000, 6000000).temperature ==
+		centi_celsius(-9731), "second order below -15 degC");
+
+/* The PROM of the simulator, see sim.c */
+constexpr prom sim_prom()
+{
+	prom words = { 0, 40127, 36924, 23317, 23282, 33464, 28312, 0 };
+
+	while ((words[7] = prom_crc4(words)) == 0)
+		words[0]++;
+	return words;
+}
+
+static_assert(prom_is_valid(sim_prom()), "CRC4");
+static_assert(calibration_from_prom(sim_prom()).c5 == 33464, "PROM layout");
+
+static_assert(osr<256>::pressure_cmd == 0x40 && osr<256>::temp_cmd == 0x50,
+		"OSR 256 commands");
+static_assert(osr<4096>::pressure_cmd == 0x48 && osr<4096>::temp_cmd == 0x58,
+		"OSR 4096 commands");
+static_assert(device<4096, 256>::sample_time.count() == 9640, "sample time");
+
+template <unsigned int Rate>
+static int check_osr()
+{
+	const struct ms5611_osr_info *info = ms5611_osr_info(Rate);
+
+	return info && info->pressure_cmd == osr<Rate>::pressure_cmd &&
+		info->temp_cmd == osr<Rate>::temp_cmd &&
+		info->conv_usec == osr<Rate>::conv_time.count() &&
+		info->noise == osr<Rate>::noise ? 0 : -1;
+}
+
+static int check()
+{
+	ms5611_calibration cali;
+	prom words;
+	uint32_t d1, d2;
+	measurement m;
+	int p, t, i, j;
+
+	if (check_osr<256>() + check_osr<512>() + check_osr<1024>() +
+			check_osr<2048>() + check_osr<4096>() < 0) {
+		printf("Error: OSR table differs\n");
+		return -1;
+	}
+
+	for (i = 0; i < 1000; i++) {
+		for (j = 0; j < 8; j++)
+			words[j] = random32();
+		if (prom_crc4(words) != ms5611_prom_crc4(words.data()) ||
+				prom_is_valid(words) !=
+				!!ms5611_prom_is_valid(words.data())) {
+			printf("Error: CRC4 differs\n");
+			return -1;
+		}
+
+		cali = calibration_from_prom(words);
+		for (j = 0; j < 1000; j++) {
+			d1 = random32() & 0xFFFFFF;
+			d2 = random32() & 0xFFFFFF;
+			m = compensate(cali, d1, d2);
+			ms5611_compensate(&cali, d1, d2, &p, &t);
+			if (m.pressure.count() != p ||
+					m.temperature.count() != t) {
+				printf("Error: Compensation differs at %u %u\n",
+						d1, d2);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* A bus that answers at once, so only the code around it is timed */
+struct null_bus {
+	const uint32_t *adc;
+	size_t n, i;
+	unsigned int cmds;
+
+	int command(uint8_t cmd)
+	{
+		cmds += cmd;
+		return 0;
+	}
+
+	int read_adc(uint32_t &data, uint8_t next)
+	{
+		cmds += next;
+		data = adc[i++ & (n - 1)];
+		return 0;
+	}
+
+	int read_prom(prom &words)
+	{
+		words = sim_prom();
+		return 0;
+	}
+
+	void wait(std::chrono::microseconds usec)
+	{
+		cmds += usec.count();
+	}
+};
+
+/* sensor<>::read() as it would be written in C, like i2cdev_read() */
+static int c_read(null_bus *bus, const ms5611_calibration *cali,
+		const struct ms5611_osr_info *posr,
+		const struct ms5611_osr_info *tosr, ms5611_sample *sample)
+{
+	if (bus->command(posr->pressure_cmd) < 0)
+		return -1;
+	sample->timestamp_ns = ms5611_now_ns() + posr->conv_usec * 500ULL;
+	bus->wait(std::chrono::microseconds(posr->conv_usec));
+
+	if (bus->read_adc(sample->raw_pressure, tosr->temp_cmd) < 0)
+		return -1;
+	bus->wait(std::chrono::microseconds(tosr->conv_usec));
+
+	if (bus->read_adc(sample->raw_temperature, 0) < 0)
+		return -1;
+
+	return ms5611_compensate(cali, sample->raw_pressure,
+			sample->raw_temperature, &sample->pressure,
+			&sample->temperature);
+}
+
+/* Best of TRIALS runs, the least disturbed one */
+template <class Fn>
+static unsigned long long best_ns(Fn fn)
+{
+	unsigned long long start, ns, best = ~0ULL;
+	int i;
+
+	for (i = 0; i < TRIALS; i++) {
+		start = ms5611_now_ns();
+		fn();
+		ns = ms5611_now_ns() - start;
+		if (ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+static void report(const char *name, size_t count, unsigned long long c_ns,
+		unsigned long long cpp_ns, long long sum)
+{
+	printf("%-12s C %8.2f ns  C++ %8.2f ns  ratio %.2f (%lld)\n", name,
+			(double)c_ns / count, (double)cpp_ns / count,
+			(double)cpp_ns / c_ns, sum);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t samples = argc > 1 ? strtoul(argv[1], NULL, 0) : 4096;
+	int rounds = argc > 2 ? atoi(argv[2]) : 200;
+	ms5611_calibration cali = calibration_from_prom(sim_prom());
+	unsigned long long c_ns, cpp_ns;
+	uint32_t *adc;
+	prom *proms;
+	long long sum;
+	size_t i;
+	int r;
+
+	if (check() < 0)
+		return 1;
+
+	/* Power of two, null_bus wraps with a mask */
+	samples = samples < 2 ? 2 : samples;
+	while (samples & (samples - 1))
+		samples &= samples - 1;
+
+	adc = (uint32_t *)malloc(samples * 2 * sizeof(*adc));
+	proms = (prom *)malloc(samples * sizeof(*proms));
+	if (!adc || !proms)
+		return 1;
+
+	for (i = 0; i < samples * 2; i++)
+		adc[i] = 8000000 + random32() % 1000000;
+	for (i = 0; i < samples; i++)
+		for (r = 0; r < 8; r++)
+			proms[i][r] = random32();
+
+	/* The sums keep the loops from being optimized away */
+	sum = 0;
+	c_ns = best_ns([&] {
+		int p, t;
+
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++) {
+				ms5611_compensate(&cali, adc[i * 2],
+						adc[i * 2 + 1], &p, &t);
+				sum += p + t;
+			}
+	});
+	cpp_ns = best_ns([&] {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++) {
+				measurement m = compensate(cali, adc[i * 2],
+						adc[i * 2 + 1]);
+				sum -= m.pressure.count() +
+					m.temperature.count();
+			}
+	});
+	report("compensate", samples * rounds, c_ns, cpp_ns, sum);
+
+	sum = 0;
+	c_ns = best_ns([&] {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++)
+				sum += ms5611_prom_crc4(proms[i].data());
+	});
+	cpp_ns = best_ns([&] {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++)
+				sum -= prom_crc4(proms[i]);
+	});
+	report("crc4", samples * rounds, c_ns, cpp_ns, sum);
+
+	null_bus cbus = { adc, samples * 2, 0, 0 };
+	sensor<null_bus, 4096> sen(null_bus{ adc, samples * 2, 0, 0 });
+	sen.bus().cmds = 0;
+	sum = 0;
+	c_ns = best_ns([&] {
+		ms5611_sample cs;
+
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++) {
+				c_read(&cbus, &cali, ms5611_osr_info(4096),
+						ms5611_osr_info(4096), &cs);
+				sum += cs.pressure;
+			}
+	});
+	cpp_ns = best_ns([&] {
+		for (int r = 0; r < rounds; r++)
+			for (size_t i = 0; i < samples; i++)
+				sum -= sen.read()->pressure.count();
+	});
+	report("sensor", samples * rounds, c_ns, cpp_ns,
+			sum + cbus.cmds - sen.bus().cmds);
+
+	ms5611_dev *cdev = ms5611_open("sim");
+	device<4096> dev("sim");
+	if (!cdev || !dev ||
+			ms5611_dev_set_oversampling(cdev, 4096, 4096) < 0)
+		return 1;
+
+	sum = 0;
+	c_ns = best_ns([&] {
+		ms5611_sample cs;
+
+		for (size_t i = 0; i < samples; i++) {
+			ms5611_dev_read(cdev, &cs);
+			sum += cs.pressure;
+		}
+	});
+	cpp_ns = best_ns([&] {
+		for (size_t i = 0; i < samples; i++)
+			sum -= dev.read()->pressure.count();
+	});
+	report("device", samples, c_ns, cpp_ns, sum);
+
+	ms5611_close(cdev);
+	free(adc);
+	free(proms);
+	return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _BENCH_RANDOM_H_
+#define _BENCH_RANDOM_H_
+
+#include <stdint.h>
+
+/*
+ * xorshift64 for the benchmarks, the same sequence in C and C++ so their
+ * inputs can be compared. Not for anything but test data.
+ *  */
+static uint64_t random_seed = 88172645463325252ULL;
+
+static inline uint32_t random32(void)
+{
+	random_seed ^= random_seed << 13;
+	random_seed ^= random_seed >> 7;
+	random_seed ^= random_seed << 17;
+	return (uint32_t)(random_seed >> 16);
+}
+
+#endif /* _BENCH_RANDOM_H_ */
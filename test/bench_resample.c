@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "ms5611.h"
+
+/*
+ * Usage: bench_resample [samples [imu_hz]]
+ *
+ * Reads 'samples' (default 2000) from the noiseless simulator, pressure a
+ * sine of SIM_AMP Pa over SIM_PERIOD s at OSR 4096, and resamples them
+ * onto 'imu_hz' ticks (default 1000) as they come in, eight samples per
+ * push. Prints the RMS and largest error against the sine at the ticks
+ * for the samples dated at the middle of D1, at its start as before, and
+ * for the latest sample held, then the time per tick. Fails if the
+ * midpoint error is not the smallest.
+ *  */
+#define SIM_SPEC		"sim:noise=0,amp=2000,period=2"
+#define SIM_P0			100000.0
+#define SIM_AMP			2000.0
+#define SIM_PERIOD		2.0
+#define PUSH			8
+
+struct error {
+	double sum, max;
+	size_t n;
+};
+
+static void error_add(struct error *e, double d)
+{
+	e->sum += d * d;
+	e->n++;
+	if (fabs(d) > e->max)
+		e->max = fabs(d);
+}
+
+static void report(const char *name, const struct error *e)
+{
+	printf("%-10s rms %8.2f Pa  max %8.2f Pa  (%zu ticks)\n", name,
+			e->n ? sqrt(e->sum / e->n) : 0, e->max, e->n);
+}
+
+/* Pressure of the simulator at @ns, it started at @start_ns */
+static double truth(unsigned long long ns, unsigned long long start_ns)
+{
+	double secs = (ns - start_ns) / 1e9;
+
+	return SIM_P0 + SIM_AMP * sin(2.0 * M_PI * secs / SIM_PERIOD);
+}
+
+/*
+ * Resample @n samples onto @ticks as a reader would, pushing PUSH samples
+ * at a time and resampling the ticks up to the latest one.
+ *  */
+static unsigned long long run(const struct ms5611_sample *samples, size_t n,
+		const unsigned long long *ticks, size_t n_ticks,
+		struct ms5611_resampled *out)
+{
+	struct ms5611_resampler rs;
+	unsigned long long start = ms5611_now_ns();
+	size_t i, done = 0;
+
+	ms5611_resample_init(&rs, 0, 0, 0);
+	for (i = 0; i < n; i += PUSH) {
+		ms5611_resample_push(&rs, samples + i, n - i < PUSH ?
+				n - i : PUSH);
+		done += ms5611_resample(&rs, ticks + done, n_ticks - done,
+				out + done);
+	}
+
+	return done == n_ticks ? ms5611_now_ns() - start : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t n = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000;
+	unsigned int hz = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+	struct ms5611_sample *samples, *start;
+	struct error mid = { 0 }, d1 = { 0 }, held = { 0 };
+	unsigned long long *ticks, half, start_ns, ns;
+	struct ms5611_resampled *out;
+	struct ms5611_dev *dev;
+	size_t i, j, n_ticks;
+	double p;
+
+	if (n < 2 || !hz)
+		return 1;
+
+	dev = ms5611_open(SIM_SPEC);
+	if (!dev || ms5611_dev_set_oversampling(dev, 4096, 4096) < 0) {
+		printf("Error: Open %s\n", SIM_SPEC);
+		return 1;
+	}
+
+	samples = malloc(n * sizeof(*samples));
+	start = malloc(n * sizeof(*start));
+	if (!samples || !start)
+		return 1;
+
+	for (i = 0; i < n; i++)
+		if (ms5611_dev_read(dev, &samples[i]) < 0) {
+			printf("Error: Read %s\n", SIM_SPEC);
+			return 1;
+		}
+	ms5611_close(dev);
+
+	/* The simulator clock starts with the first D1 */
+	half = ms5611_osr_info(4096)->conv_usec * 500ULL;
+	start_ns = samples[0].timestamp_ns - half;
+	for (i = 0; i < n; i++) {
+		start[i] = samples[i];
+		start[i].timestamp_ns -= half;
+	}
+
+	/* Up to the latest sample of both datings, none is extrapolated */
+	n_ticks = (start[n - 1].timestamp_ns - samples[0].timestamp_ns) *
+		hz / 1000000000ULL;
+	ticks = malloc(n_ticks * sizeof(*ticks));
+	out = malloc(n_ticks * sizeof(*out));
+	if (!ticks || !out)
+		return 1;
+	for (i = 0; i < n_ticks; i++)
+		ticks[i] = samples[0].timestamp_ns + 1000000000ULL * i / hz;
+
+	if (!run(start, n, ticks, n_ticks, out)) {
+		printf("Error: Ticks left over\n");
+		return 1;
+	}
+	for (i = 0; i < n_ticks; i++)
+		error_add(&d1, out[i].pressure - truth(ticks[i], start_ns));
+
+	ns = run(samples, n, ticks, n_ticks, out);
+	if (!ns) {
+		printf("Error: Ticks left over\n");
+		return 1;
+	}
+	for (i = j = 0; i < n_ticks; i++) {
+		p = truth(ticks[i], start_ns);
+		error_add(&mid, out[i].pressure - p);
+
+		while (j + 1 < n && samples[j + 1].timestamp_ns <= ticks[i])
+			j++;
+		error_add(&held, samples[j].pressure - p);
+	}
+
+	report("midpoint", &mid);
+	report("d1 start", &d1);
+	report("latest", &held);
+	printf("%.1f ns per tick\n", (double)ns / n_ticks);
+
+	free(samples);
+	free(start);
+	free(ticks);
+	free(out);
+	return mid.sum < d1.sum && mid.sum < held.sum ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "ms5611.h"
+
+/*
+ * Usage: bench_sched [-o pres:temp] [-r hz] [-d sec] [-f prio] [-c cpu]
+ *		      [-m] [-t] [spec]
+ *
+ * Reads the device, see ms5611.h for the spec, through ms5611_sched at
+ * 'hz' samples per second, as fast as the OSRs allow by default, on a
+ * thread of its own for 'sec' seconds (default 10). -f runs it SCHED_FIFO
+ * at 'prio', -c pins it to 'cpu', -m locks memory and -t waits in a
+ * timerfd instead of clock_nanosleep(). Prints the achieved rate, the
+ * misses and overruns, and the wake-up latency and period jitter
+ * histograms. "sim:realtime=1" takes the conversion time like a sensor.
+ *  */
+struct stream {
+	unsigned long long first, last, samples;
+	unsigned long long backwards;	/* Timestamps not increasing */
+};
+
+static int on_sample(void *arg, const struct ms5611_sample *s)
+{
+	struct stream *st = arg;
+
+	if (!st->samples)
+		st->first = s->timestamp_ns;
+	else if (s->timestamp_ns <= st->last)
+		st->backwards++;
+	st->last = s->timestamp_ns;
+	st->samples++;
+	return 0;
+}
+
+static void print_hist(const char *name, const unsigned long long *hist)
+{
+	int i, last = -1;
+
+	for (i = 0; i < MS5611_SCHED_HIST; i++)
+		if (hist[i])
+			last = i;
+
+	printf("%s\n", name);
+	for (i = 0; i <= last; i++)
+		printf("  >= %7llu us %10llu\n", i ? 1ULL << i : 0, hist[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ms5611_sched_config cfg = { .cpu = -1 };
+	unsigned int pres_osr = 0, temp_osr = 0, sec = 10;
+	struct ms5611_sched_stats stats;
+	struct stream st = { 0 };
+	struct ms5611_sched *s;
+	struct ms5611_dev *dev;
+	double rate = 0;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "o:r:d:f:c:mt")) != -1) {
+		switch (opt) {
+		case 'o':
+			if (sscanf(optarg, "%u:%u", &pres_osr, &temp_osr) != 2)
+				return 1;
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'd':
+			sec = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			cfg.priority = atoi(optarg);
+			break;
+		case 'c':
+			cfg.cpu = atoi(optarg);
+			break;
+		case 'm':
+			cfg.lock_memory = 1;
+			break;
+		case 't':
+			cfg.timerfd = 1;
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	dev = ms5611_open(optind < argc ? argv[optind] : NULL);
+	if (!dev)
+		return 1;
+	if (pres_osr && ms5611_dev_set_oversampling(dev, pres_osr,
+				temp_osr) < 0) {
+		printf("Error: Set oversampling %u:%u\n", pres_osr, temp_osr);
+		return 1;
+	}
+
+	if (rate > 0)
+		cfg.period_usec = 1e6 / rate;
+	s = ms5611_sched_create(dev, &cfg);
+	if (!s || ms5611_sched_start(s, on_sample, &st) < 0)
+		return 1;
+
+	sleep(sec);
+	ret = ms5611_sched_join(s);
+	ms5611_sched_stats(s, &stats);
+
+	printf("period %.1f us, %llu samples at %.3f Hz\n",
+			stats.period_ns / 1e3, stats.samples,
+			st.samples > 1 ? (st.samples - 1) * 1e9 /
+			(st.last - st.first) : 0);
+	printf("%llu misses, %llu overruns, %llu errors, %llu out of order\n",
+			stats.misses, stats.overruns, stats.errors,
+			st.backwards);
+	printf("wake-up max %.1f us, jitter rms %.1f us max %.1f us\n",
+			stats.wake_max_ns / 1e3, stats.jitter_rms_ns / 1e3,
+			stats.jitter_max_ns / 1e3);
+	print_hist("wake-up latency", stats.wake_hist);
+	print_hist("period jitter", stats.jitter_hist);
+
+	ms5611_sched_destroy(s);
+	ms5611_close(dev);
+	return ret < 0 ? 1 : 0;
+}
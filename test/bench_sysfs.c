@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ops.h"
+#include "ms5611.h"
+
+/*
+ * Usage: bench_sysfs [dir [count]]
+ *
+ * Reads 'count' samples through the sysfs attributes in 'dir', first with
+ * read_data_block() as the library did before the handle API, then with a
+ * "sysfs:<dir>" handle, and prints the time and heap allocations per
+ * sample of each. Without a directory a copy of the attributes is made in
+ * /tmp, which measures the library overhead alone; against the driver the
+ * show function and the bus add the same cost to both.
+ *  */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t);
+static unsigned long mallocs;
+
+/* Count every allocation of the process */
+void *malloc(size_t size)
+{
+	mallocs++;
+	return __libc_malloc(size);
+}
+#endif
+
+static int make_dir(char *dir)
+{
+	static const char *attrs[][2] = {
+		{ "sens", "40127" }, { "off", "36924" }, { "tcs", "23317" },
+		{ "tco", "23282" }, { "tref", "33464" }, { "tempsens", "28312" },
+		{ "temp_and_pressure", "8569150 9085466" },
+	};
+	char path[64];
+	unsigned int i;
+	FILE *f;
+
+	if (!mkdtemp(dir))
+		return -1;
+
+	for (i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, attrs[i][0]);
+		f = fopen(path, "w");
+		if (!f)
+			return -1;
+		fprintf(f, "%s", attrs[i][1]);
+		fclose(f);
+	}
+
+	return 0;
+}
+
+static void report(const char *name, int count, unsigned long long ns,
+		unsigned long allocs)
+{
+	printf("%-12s %8.0f ns/sample %6.2f mallocs/sample\n", name,
+			(double)ns / count, (double)allocs / count);
+}
+
+int main(int argc, char *argv[])
+{
+	char tmp[] = "/tmp/ms5611-XXXXXX", spec[80], *buf;
+	const char *dir = argc > 1 ? argv[1] : NULL;
+	int count = argc > 2 ? atoi(argv[2]) : 100000;
+	unsigned int pressure, temperature;
+	struct ms5611_sample sample;
+	struct ms5611_dev *dev;
+	unsigned long long start;
+	unsigned long allocs;
+	int i;
+
+	if (!dir) {
+		if (make_dir(tmp) < 0) {
+			printf("Error: Create %s\n", tmp);
+			return 1;
+		}
+		dir = tmp;
+	}
+
+	allocs = mallocs;
+	start = ms5611_now_ns();
+	for (i = 0; i < count; i++) {
+		if (read_data_block(dir, "temp_and_pressure", &buf) < 0)
+			return 1;
+		sscanf(buf, "%u %u", &temperature, &pressure);
+		free(buf);
+	}
+	report("read_data", count, ms5611_now_ns() - start, mallocs - allocs);
+
+	snprintf(spec, sizeof(spec), "sysfs:%s", dir);
+	dev = ms5611_open(spec);
+	if (!dev)
+		return 1;
+
+	allocs = mallocs;
+	start = ms5611_now_ns();
+	for (i = 0; i < count; i++)
+		if (ms5611_dev_read(dev, &sample) < 0)
+			return 1;
+	report("handle", count, ms5611_now_ns() - start, mallocs - allocs);
+
+	ms5611_close(dev);
+	return 0;
+}
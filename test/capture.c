@@ -0,0 +1,726 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "backend.h"
+
+/*
+ * Capture files, raw samples in a compact binary form.
+ *
+ * All fields are little endian. The file is a header, then blocks of up
+ * to 'block_samples' samples, then an index with one entry per block:
+ *
+ *   header	 0 "MS5611CP", 8 u16 version, 10 u16 header size,
+ *		12 u32 block_samples, 16 u16 prom[8], 32 u16 pressure OSR,
+ *		34 u16 temperature OSR (0 unknown), 40 u64 CLOCK_MONOTONIC
+ *		and 48 u64 CLOCK_REALTIME in ns taken together, 56 u64
+ *		samples, 64 u64 offset of the index, 0 if not written
+ *   block	 0 u32 "BLK1", 4 u32 payload bytes, 8 u32 samples,
+ *		12 u32 D1 and 16 u32 D2 of the first sample, 24 u64 its
+ *		timestamp, then for every further sample three varints:
+ *		the change of the timestamp delta, the D1 delta and the D2
+ *		delta, all zigzag coded
+ *   index	 0 u32 "IDX1", 4 u32 entries, then per block u64 offset,
+ *		u64 first and u64 last timestamp, u32 samples, u32 zero
+ *
+ * At a steady rate the timestamp takes one or two bytes and a D2 that is
+ * reused by temperature decimation one byte, so a sample is about four
+ * bytes against sixteen or more for the "%u %u" text plus a timestamp.
+ * Blocks can be found without the index, which is how a capture whose
+ * recorder died is still read.
+ *  */
+#define CAPTURE_MAGIC			"MS5611CP"
+#define CAPTURE_VERSION			1
+#define CAPTURE_HEADER_SIZE		80
+#define BLOCK_MAGIC			0x314b4c42	/* "BLK1" */
+#define BLOCK_HEADER_SIZE		32
+#define INDEX_MAGIC			0x31584449	/* "IDX1" */
+#define INDEX_ENTRY_SIZE		32
+#define DEFAULT_BLOCK_SAMPLES		4096
+#define MAX_BLOCK_SAMPLES		(1 << 20)
+#define VARINT_MAX			10
+
+struct capture_block {
+	unsigned long long offset;
+	unsigned long long first_ts;
+	unsigned long long last_ts;
+	unsigned int count;
+};
+
+struct ms5611_capture {
+	int fd;
+	struct ms5611_capture_info info;
+	unsigned long long offset;	/* Where the next block goes */
+	unsigned char *buf;		/* Block header and payload */
+	size_t len;
+	unsigned int count;		/* Samples in the block */
+	unsigned long long first_ts, prev_ts;
+	long long prev_delta;
+	uint32_t prev_d1, prev_d2;
+	struct capture_block *index;
+	size_t blocks, alloc;
+	int failed;			/* A block could not be written */
+};
+
+struct ms5611_replay {
+	int fd;
+	const unsigned char *base;
+	size_t size;
+	struct ms5611_capture_info info;
+	struct ms5611_calibration cali;
+	struct capture_block *index;
+	size_t blocks;
+	size_t block;			/* Decoded block, 'blocks' if none */
+	unsigned int count;		/* Samples in it */
+	unsigned int pos;		/* Next one to read */
+	unsigned long long *ts;
+	uint32_t *d1, *d2;
+	int32_t *p, *t;
+};
+
+static void put_le16(unsigned char *b, unsigned int v)
+{
+	b[0] = v;
+	b[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *b, uint32_t v)
+{
+	put_le16(b, v);
+	put_le16(b + 2, v >> 16);
+}
+
+static void put_le64(unsigned char *b, unsigned long long v)
+{
+	put_le32(b, v);
+	put_le32(b + 4, v >> 32);
+}
+
+static unsigned int get_le16(const unsigned char *b)
+{
+	return b[0] | b[1] << 8;
+}
+
+static uint32_t get_le32(const unsigned char *b)
+{
+	return get_le16(b) | (uint32_t)get_le16(b + 2) << 16;
+}
+
+static unsigned long long get_le64(const unsigned char *b)
+{
+	return get_le32(b) | (unsigned long long)get_le32(b + 4) << 32;
+}
+
+/* Zigzag varint, returning the bytes written */
+static size_t put_varint(unsigned char *b, long long v)
+{
+	unsigned long long u = ((unsigned long long)v << 1) ^ (v >> 63);
+	size_t n = 0;
+
+	while (u >= 0x80) {
+		b[n++] = u | 0x80;
+		u >>= 7;
+	}
+	b[n++] = u;
+	return n;
+}
+
+/* Returning NULL if the varint runs past @end */
+static const unsigned char *get_varint(const unsigned char *b,
+		const unsigned char *end, long long *v)
+{
+	unsigned long long u = 0;
+	unsigned int shift = 0;
+
+	do {
+		if (b >= end || shift > 63)
+			return NULL;
+		u |= (unsigned long long)(*b & 0x7f) << shift;
+		shift += 7;
+	} while (*b++ & 0x80);
+
+	*v = (long long)(u >> 1) ^ -(long long)(u & 1);
+	return b;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0)
+			return -1;
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void encode_header(unsigned char *b, const struct ms5611_capture_info *info,
+		unsigned long long index_offset)
+{
+	int i;
+
+	memset(b, 0, CAPTURE_HEADER_SIZE);
+	memcpy(b, CAPTURE_MAGIC, 8);
+	put_le16(b + 8, CAPTURE_VERSION);
+	put_le16(b + 10, CAPTURE_HEADER_SIZE);
+	put_le32(b + 12, info->block_samples);
+	for (i = 0; i < 8; i++)
+		put_le16(b + 16 + i * 2, info->prom[i]);
+	put_le16(b + 32, info->pressure_osr);
+	put_le16(b + 34, info->temp_osr);
+	put_le64(b + 40, info->mono_ns);
+	put_le64(b + 48, info->real_ns);
+	put_le64(b + 56, info->samples);
+	put_le64(b + 64, index_offset);
+}
+
+/*
+ * Start a capture at @path, replacing the file. @block_samples 0 takes the
+ * default; the OSRs are only recorded, 0 if unknown. Returning NULL on
+ * failure.
+ *  */
+struct ms5611_capture *ms5611_capture_create(const char *path,
+		const unsigned short *prom, unsigned short pressure_osr,
+		unsigned short temp_osr, unsigned int block_samples)
+{
+	unsigned char hdr[CAPTURE_HEADER_SIZE];
+	struct ms5611_capture *cap;
+	struct timespec mono, real;
+
+	if (!block_samples)
+		block_samples = DEFAULT_BLOCK_SAMPLES;
+	if (block_samples > MAX_BLOCK_SAMPLES)
+		return NULL;
+
+	cap = calloc(1, sizeof(*cap));
+	if (!cap)
+		return NULL;
+
+	cap->buf = malloc(BLOCK_HEADER_SIZE + block_samples * 3 * VARINT_MAX);
+	if (!cap->buf)
+		goto exit_free;
+
+	cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (cap->fd < 0) {
+		printf("Error: Create %s\n", path);
+		goto exit_buf;
+	}
+
+	memcpy(cap->info.prom, prom, sizeof(cap->info.prom));
+	cap->info.pressure_osr = pressure_osr;
+	cap->info.temp_osr = temp_osr;
+	cap->info.block_samples = block_samples;
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+	cap->info.mono_ns = mono.tv_sec * 1000000000ULL + mono.tv_nsec;
+	cap->info.real_ns = real.tv_sec * 1000000000ULL + real.tv_nsec;
+
+	encode_header(hdr, &cap->info, 0);
+	if (write_all(cap->fd, hdr, sizeof(hdr)) < 0)
+		goto exit_close;
+
+	cap->offset = CAPTURE_HEADER_SIZE;
+	cap->len = BLOCK_HEADER_SIZE;
+	return cap;
+
+exit_close:
+	close(cap->fd);
+exit_buf:
+	free(cap->buf);
+exit_free:
+	free(cap);
+	return NULL;
+}
+
+/*
+ * Write the block in progress. On failure the capture is marked failed,
+ * part of the block may be in the file and nothing more is written.
+ *  */
+static int capture_flush(struct ms5611_capture *cap)
+{
+	struct capture_block *entry;
+	size_t alloc;
+
+	if (!cap->count)
+		return 0;
+
+	if (cap->blocks == cap->alloc) {
+		alloc = cap->alloc ? cap->alloc * 2 : 64;
+		entry = realloc(cap->index, alloc * sizeof(*entry));
+		if (!entry)
+			goto exit_failed;
+		cap->index = entry;
+		cap->alloc = alloc;
+	}
+
+	put_le32(cap->buf, BLOCK_MAGIC);
+	put_le32(cap->buf + 4, cap->len - BLOCK_HEADER_SIZE);
+	put_le32(cap->buf + 8, cap->count);
+	if (write_all(cap->fd, cap->buf, cap->len) < 0)
+		goto exit_failed;
+
+	entry = &cap->index[cap->blocks++];
+	entry->offset = cap->offset;
+	entry->first_ts = cap->first_ts;
+	entry->last_ts = cap->prev_ts;
+	entry->count = cap->count;
+
+	cap->offset += cap->len;
+	cap->len = BLOCK_HEADER_SIZE;
+	cap->count = 0;
+	return 0;
+
+exit_failed:
+	cap->failed = 1;
+	return -1;
+}
+
+/*
+ * Append one sample, only the raw values and the timestamp are kept.
+ * Returning -1 if a block could not be written, now or before.
+ *  */
+int ms5611_capture_write(struct ms5611_capture *cap,
+		const struct ms5611_sample *sample)
+{
+	unsigned long long ts = sample->timestamp_ns;
+	long long delta;
+
+	if (cap->failed)
+		return -1;
+
+	if (!cap->count) {
+		memset(cap->buf + 4, 0, BLOCK_HEADER_SIZE - 4);
+		put_le32(cap->buf + 12, sample->raw_pressure);
+		put_le32(cap->buf + 16, sample->raw_temperature);
+		put_le64(cap->buf + 24, ts);
+		cap->first_ts = ts;
+		cap->prev_delta = 0;
+	} else {
+		delta = (long long)(ts - cap->prev_ts);
+		cap->len += put_varint(cap->buf + cap->len,
+				delta - cap->prev_delta);
+		cap->len += put_varint(cap->buf + cap->len,
+				(long long)sample->raw_pressure - cap->prev_d1);
+		cap->len += put_varint(cap->buf + cap->len,
+				(long long)sample->raw_temperature -
+				cap->prev_d2);
+		cap->prev_delta = delta;
+	}
+
+	cap->prev_ts = ts;
+	cap->prev_d1 = sample->raw_pressure;
+	cap->prev_d2 = sample->raw_temperature;
+	cap->info.samples++;
+
+	if (++cap->count >= cap->info.block_samples)
+		return capture_flush(cap);
+	return 0;
+}
+
+/*
+ * Write the last block, the index and the final header. Returning -1 if
+ * any of it failed, now or in an earlier ms5611_capture_write(), the
+ * blocks written so far can still be read. After a failed block only the
+ * handle is released, the file is left as it is.
+ *  */
+int ms5611_capture_close(struct ms5611_capture *cap)
+{
+	unsigned char hdr[CAPTURE_HEADER_SIZE], *idx = NULL;
+	size_t i, len;
+	int ret = -1;
+
+	if (cap->failed || capture_flush(cap) < 0)
+		goto exit;
+
+	len = 8 + cap->blocks * INDEX_ENTRY_SIZE;
+	idx = calloc(1, len);
+	if (!idx)
+		goto exit;
+
+	put_le32(idx, INDEX_MAGIC);
+	put_le32(idx + 4, cap->blocks);
+	for (i = 0; i < cap->blocks; i++) {
+		unsigned char *e = idx + 8 + i * INDEX_ENTRY_SIZE;
+
+		put_le64(e, cap->index[i].offset);
+		put_le64(e + 8, cap->index[i].first_ts);
+		put_le64(e + 16, cap->index[i].last_ts);
+		put_le32(e + 24, cap->index[i].count);
+	}
+	if (write_all(cap->fd, idx, len) < 0)
+		goto exit;
+
+	encode_header(hdr, &cap->info, cap->offset);
+	if (pwrite(cap->fd, hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto exit;
+
+	ret = 0;
+exit:
+	if (close(cap->fd) < 0)
+		ret = -1;
+	free(idx);
+	free(cap->index);
+	free(cap->buf);
+	free(cap);
+	return ret;
+}
+
+/* The index at the end of the file */
+static int replay_load_index(struct ms5611_replay *rp,
+		unsigned long long offset)
+{
+	const unsigned char *e;
+	size_t i, n;
+
+	if (offset > rp->size || rp->size - offset < 8 ||
+			get_le32(rp->base + offset) != INDEX_MAGIC)
+		return -1;
+
+	n = get_le32(rp->base + offset + 4);
+	if ((rp->size - offset - 8) / INDEX_ENTRY_SIZE < n)
+		return -1;
+
+	rp->index = calloc(n ? n : 1, sizeof(*rp->index));
+	if (!rp->index)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		e = rp->base + offset + 8 + i * INDEX_ENTRY_SIZE;
+		rp->index[i].offset = get_le64(e);
+		rp->index[i].first_ts = get_le64(e + 8);
+		rp->index[i].last_ts = get_le64(e + 16);
+		rp->index[i].count = get_le32(e + 24);
+	}
+	rp->blocks = n;
+	return 0;
+}
+
+static int replay_decode(struct ms5611_replay *rp, size_t block);
+
+/*
+ * No index, the recorder did not close the file. Walk the blocks and
+ * decode each for its last timestamp, up to the first one that is cut
+ * short.
+ *  */
+static int replay_scan(struct ms5611_replay *rp)
+{
+	unsigned long long offset = CAPTURE_HEADER_SIZE, bytes;
+	struct capture_block *entry;
+	size_t alloc = 0;
+	const unsigned char *b;
+
+	rp->info.samples = 0;
+	while (rp->size - offset >= BLOCK_HEADER_SIZE) {
+		b = rp->base + offset;
+		bytes = get_le32(b + 4);
+		if (get_le32(b) != BLOCK_MAGIC ||
+				rp->size - offset - BLOCK_HEADER_SIZE < bytes ||
+				get_le32(b + 8) > rp->info.block_samples)
+			break;
+
+		if (rp->blocks == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			entry = realloc(rp->index, alloc * sizeof(*entry));
+			if (!entry)
+				return -1;
+			rp->index = entry;
+		}
+
+		entry = &rp->index[rp->blocks];
+		entry->offset = offset;
+		entry->count = get_le32(b + 8);
+		entry->first_ts = get_le64(b + 24);
+		if (replay_decode(rp, rp->blocks) < 0)
+			break;
+		entry->last_ts = rp->ts[rp->count - 1];
+
+		rp->info.samples += entry->count;
+		rp->blocks++;
+		offset += BLOCK_HEADER_SIZE + bytes;
+	}
+
+	rp->block = rp->blocks;
+	return 0;
+}
+
+/*
+ * Open a capture for reading. The file is mapped, only the index is read
+ * here and blocks are decoded when a read or a seek gets to them.
+ * Returning NULL on failure.
+ *  */
+struct ms5611_replay *ms5611_replay_open(const char *path)
+{
+	struct ms5611_replay *rp;
+	unsigned long long index_offset;
+	const unsigned char *h;
+	struct stat st;
+	unsigned int n;
+	int i;
+
+	rp = calloc(1, sizeof(*rp));
+	if (!rp)
+		return NULL;
+
+	rp->fd = open(path, O_RDONLY);
+	if (rp->fd < 0) {
+		printf("Error: Open %s\n", path);
+		goto exit_free;
+	}
+
+	if (fstat(rp->fd, &st) < 0 || st.st_size < CAPTURE_HEADER_SIZE) {
+		printf("Error: %s is not a capture\n", path);
+		goto exit_close;
+	}
+
+	rp->size = st.st_size;
+	rp->base = mmap(NULL, rp->size, PROT_READ, MAP_SHARED, rp->fd, 0);
+	if (rp->base == MAP_FAILED) {
+		printf("Error: Map %s\n", path);
+		goto exit_close;
+	}
+
+	h = rp->base;
+	n = get_le32(h + 12);
+	if (memcmp(h, CAPTURE_MAGIC, 8) || get_le16(h + 8) != CAPTURE_VERSION ||
+			get_le16(h + 10) != CAPTURE_HEADER_SIZE ||
+			!n || n > MAX_BLOCK_SAMPLES) {
+		printf("Error: %s is not a capture\n", path);
+		goto exit_unmap;
+	}
+
+	rp->info.block_samples = n;
+	for (i = 0; i < 8; i++)
+		rp->info.prom[i] = get_le16(h + 16 + i * 2);
+	rp->info.pressure_osr = get_le16(h + 32);
+	rp->info.temp_osr = get_le16(h + 34);
+	rp->info.mono_ns = get_le64(h + 40);
+	rp->info.real_ns = get_le64(h + 48);
+	rp->info.samples = get_le64(h + 56);
+	ms5611_calibration_from_prom(&rp->cali, rp->info.prom);
+
+	rp->ts = malloc(n * sizeof(*rp->ts));
+	rp->d1 = malloc(n * sizeof(*rp->d1));
+	rp->d2 = malloc(n * sizeof(*rp->d2));
+	rp->p = malloc(n * sizeof(*rp->p));
+	rp->t = malloc(n * sizeof(*rp->t));
+	if (!rp->ts || !rp->d1 || !rp->d2 || !rp->p || !rp->t)
+		goto exit_unmap;
+
+	index_offset = get_le64(h + 64);
+	if (index_offset ? replay_load_index(rp, index_offset) < 0 :
+			replay_scan(rp) < 0) {
+		printf("Error: Index of %s\n", path);
+		goto exit_unmap;
+	}
+
+	rp->block = rp->blocks;
+	return rp;
+
+exit_unmap:
+	munmap((void *)rp->base, rp->size);
+exit_close:
+	close(rp->fd);
+exit_free:
+	free(rp->index);
+	free(rp->ts);
+	free(rp->d1);
+	free(rp->d2);
+	free(rp->p);
+	free(rp->t);
+	free(rp);
+	return NULL;
+}
+
+void ms5611_replay_close(struct ms5611_replay *rp)
+{
+	if (!rp)
+		return;
+
+	munmap((void *)rp->base, rp->size);
+	close(rp->fd);
+	free(rp->index);
+	free(rp->ts);
+	free(rp->d1);
+	free(rp->d2);
+	free(rp->p);
+	free(rp->t);
+	free(rp);
+}
+
+const struct ms5611_capture_info *ms5611_replay_info(struct ms5611_replay *rp)
+{
+	return &rp->info;
+}
+
+/*
+ * Decode @block into the sample arrays and compensate it in one batch.
+ * Returning -1 if the block is damaged.
+ *  */
+static int replay_decode(struct ms5611_replay *rp, size_t block)
+{
+	const struct capture_block *entry = &rp->index[block];
+	const unsigned char *b, *end;
+	long long delta = 0, v;
+	unsigned int i, n;
+
+	if (entry->offset > rp->size ||
+			rp->size - entry->offset < BLOCK_HEADER_SIZE)
+		return -1;
+
+	b = rp->base + entry->offset;
+	n = get_le32(b + 8);
+	if (get_le32(b) != BLOCK_MAGIC || !n || n > rp->info.block_samples ||
+			n != entry->count ||
+			rp->size - entry->offset - BLOCK_HEADER_SIZE <
+			get_le32(b + 4))
+		return -1;
+
+	end = b + BLOCK_HEADER_SIZE + get_le32(b + 4);
+	rp->d1[0] = get_le32(b + 12);
+	rp->d2[0] = get_le32(b + 16);
+	rp->ts[0] = get_le64(b + 24);
+	b += BLOCK_HEADER_SIZE;
+
+	for (i = 1; i < n; i++) {
+		if (!(b = get_varint(b, end, &v)))
+			return -1;
+		delta += v;
+		rp->ts[i] = rp->ts[i - 1] + delta;
+		if (!(b = get_varint(b, end, &v)))
+			return -1;
+		rp->d1[i] = rp->d1[i - 1] + v;
+		if (!(b = get_varint(b, end, &v)))
+			return -1;
+		rp->d2[i] = rp->d2[i - 1] + v;
+	}
+
+	ms5611_compensate_batch(&rp->cali, rp->d1, rp->d2, rp->p, rp->t, n);
+	rp->block = block;
+	rp->count = n;
+	rp->pos = 0;
+	return 0;
+}
+
+/*
+ * Read the next sample, compensated. Returning 1 for a sample, 0 at the
+ * end of the capture and -1 if a block is damaged.
+ *  */
+int ms5611_replay_read(struct ms5611_replay *rp, struct ms5611_sample *sample)
+{
+	size_t next;
+
+	if (rp->block >= rp->blocks || rp->pos >= rp->count) {
+		next = rp->block >= rp->blocks ? 0 : rp->block + 1;
+		if (next >= rp->blocks)
+			return 0;
+		if (replay_decode(rp, next) < 0)
+			return -1;
+	}
+
+	sample->raw_pressure = rp->d1[rp->pos];
+	sample->raw_temperature = rp->d2[rp->pos];
+	sample->pressure = rp->p[rp->pos];
+	sample->temperature = rp->t[rp->pos];
+	sample->timestamp_ns = rp->ts[rp->pos];
+	sample->boottime_ns = 0;		/* Not captured */
+	sample->temp_age_usec = 0;
+	rp->pos++;
+	return 1;
+}
+
+/*
+ * Position the reader at the first sample taken at or after @timestamp_ns,
+ * CLOCK_MONOTONIC like the samples. A binary search over the index picks
+ * the block and one inside the block the sample, so only that block is
+ * decoded. Past the last sample the next read returns 0. Returning -1 if
+ * the block is damaged.
+ *  */
+int ms5611_replay_seek(struct ms5611_replay *rp,
+		unsigned long long timestamp_ns)
+{
+	size_t lo = 0, hi = rp->blocks, mid;
+	unsigned int l, h, m;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rp->index[mid].last_ts < timestamp_ns)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == rp->blocks) {
+		if (rp->blocks && rp->block != rp->blocks - 1 &&
+				replay_decode(rp, rp->blocks - 1) < 0)
+			return -1;
+		rp->pos = rp->count;
+		return 0;
+	}
+
+	if (rp->block != lo && replay_decode(rp, lo) < 0)
+		return -1;
+
+	l = 0;
+	h = rp->count;
+	while (l < h) {
+		m = l + (h - l) / 2;
+		if (rp->ts[m] < timestamp_ns)
+			l = m + 1;
+		else
+			h = m;
+	}
+	rp->pos = l;
+	return 0;
+}
+
+/*
+ * capture backend, "capture:<file>", replays a capture through the device
+ * handle. Samples come back at the speed they are read, with the recorded
+ * timestamps; a read past the end fails.
+ *  */
+static int capture_open(struct ms5611_dev *dev, const char *arg)
+{
+	if (!arg) {
+		printf("Error: capture needs a file\n");
+		return -1;
+	}
+
+	dev->priv = ms5611_replay_open(arg);
+	return dev->priv ? 0 : -1;
+}
+
+static void capture_close(struct ms5611_dev *dev)
+{
+	ms5611_replay_close(dev->priv);
+}
+
+static int capture_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	struct ms5611_replay *rp = dev->priv;
+
+	memcpy(prom, rp->info.prom, sizeof(rp->info.prom));
+	return 0;
+}
+
+static int capture_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	return ms5611_replay_read(dev->priv, sample) == 1 ? 0 : -1;
+}
+
+const struct ms5611_backend ms5611_capture_backend = {
+	.name		= "capture",
+	.open		= capture_open,
+	.close		= capture_close,
+	.read_prom	= capture_read_prom,
+	.read		= capture_read,
+};
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "backend.h"
+#include "daemon.h"
+
+/*
+ * Client side of ms5611d, see daemon.h. The samples are copied out of the
+ * shared ring, the socket only says which one to take.
+ *  */
+struct ms5611_client {
+	int fd;
+	const struct ms5611d_ring *ring;
+	size_t len;
+	unsigned int mask;		/* Slots - 1, checked at open */
+	unsigned int decimation;
+	unsigned long long last;	/* Sequence of the previous sample */
+	struct ms5611_client_stats stats;
+};
+
+/* Receive the HELLO and the ring descriptor attached to it */
+static int recv_hello(int fd)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct ms5611d_msg msg;
+	struct iovec iov = { &msg, sizeof(msg) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct cmsghdr *cmsg;
+	int ring_fd;
+
+	if (recvmsg(fd, &mh, MSG_CMSG_CLOEXEC) != sizeof(msg) ||
+			msg.type != MS5611D_HELLO)
+		return -1;
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_RIGHTS)
+		return -1;
+
+	memcpy(&ring_fd, CMSG_DATA(cmsg), sizeof(int));
+	return ring_fd;
+}
+
+/*
+ * Connect to the daemon at @path, MS5611D_SOCKET if NULL, and subscribe
+ * to every @decimation-th sample. Returning NULL on failure.
+ *  */
+struct ms5611_client *ms5611_client_open(const char *path,
+		unsigned int decimation)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct ms5611d_msg msg = { .type = MS5611D_SUBSCRIBE };
+	struct ms5611_client *c;
+	struct stat st;
+	unsigned int size;
+	void *map;
+	int ring_fd;
+
+	if (!path)
+		path = MS5611D_SOCKET;
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return NULL;
+	strcpy(addr.sun_path, path);
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr,
+				sizeof(addr)) < 0) {
+		printf("Error: Connect to %s\n", path);
+		goto exit_close;
+	}
+
+	ring_fd = recv_hello(c->fd);
+	if (ring_fd < 0) {
+		printf("Error: No ring from %s\n", path);
+		goto exit_close;
+	}
+
+	if (fstat(ring_fd, &st) < 0 ||
+			st.st_size < (off_t)sizeof(struct ms5611d_ring)) {
+		close(ring_fd);
+		goto exit_close;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, ring_fd, 0);
+	close(ring_fd);
+	if (map == MAP_FAILED)
+		goto exit_close;
+
+	c->ring = map;
+	c->len = st.st_size;
+	size = 0;
+	if (__atomic_load_n(&c->ring->magic, __ATOMIC_ACQUIRE) ==
+			MS5611D_RING_MAGIC &&
+			c->ring->version == MS5611D_RING_VERSION)
+		size = c->ring->size;
+	/* Slots are indexed by seq & (size - 1), see client_copy() */
+	if (size == 0 || (size & (size - 1)) ||
+			sizeof(struct ms5611d_ring) + (size_t)size *
+			sizeof(struct ms5611d_slot) > c->len) {
+		printf("Error: Bad ring from %s\n", path);
+		goto exit_unmap;
+	}
+	c->mask = size - 1;
+
+	c->decimation = decimation ? decimation : 1;
+	msg.arg = c->decimation;
+	if (send(c->fd, &msg, sizeof(msg), MSG_NOSIGNAL) != sizeof(msg))
+		goto exit_unmap;
+
+	return c;
+
+exit_unmap:
+	munmap((void *)c->ring, c->len);
+exit_close:
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c);
+	return NULL;
+}
+
+void ms5611_client_close(struct ms5611_client *c)
+{
+	if (!c)
+		return;
+
+	munmap((void *)c->ring, c->len);
+	close(c->fd);
+	free(c);
+}
+
+const unsigned short *ms5611_client_prom(struct ms5611_client *c)
+{
+	return c->ring->prom;
+}
+
+/* Copy slot @seq, returning -1 if it was overwritten meanwhile */
+static int client_copy(struct ms5611_client *c, unsigned long long seq,
+		struct ms5611_sample *sample)
+{
+	const struct ms5611d_slot *slot =
+		&c->ring->slots[seq & c->mask];
+	unsigned long long before, after;
+
+	before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	sample->timestamp_ns = slot->timestamp_ns;
+	sample->raw_pressure = slot->raw_pressure;
+	sample->raw_temperature = slot->raw_temperature;
+	sample->pressure = slot->pressure;
+	sample->temperature = slot->temperature;
+	sample->temp_age_usec = slot->temp_age_usec;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	after = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+	return before == seq + 1 && after == before ? 0 : -1;
+}
+
+/*
+ * Wait for the next subscribed sample, compensated by the daemon.
+ * Samples come in order; one that was not sent or was overwritten before
+ * it was read counts as a drop. Returning -1 if the daemon is gone.
+ *  */
+int ms5611_client_read(struct ms5611_client *c, struct ms5611_sample *sample)
+{
+	struct ms5611d_msg msg;
+	unsigned long long head, lag;
+	ssize_t len;
+
+	for (;;) {
+		len = recv(c->fd, &msg, sizeof(msg), 0);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len != sizeof(msg))
+			return -1;
+		if (msg.type != MS5611D_SAMPLE)
+			continue;
+
+		if (c->stats.samples + c->stats.drops &&
+				msg.seq > c->last + c->decimation)
+			c->stats.drops += (msg.seq - c->last) /
+				c->decimation - 1;
+		c->last = msg.seq;
+
+		if (client_copy(c, msg.seq, sample) < 0) {
+			c->stats.drops++;
+			continue;
+		}
+		sample->boottime_ns = ms5611_boottime_ns(sample->timestamp_ns);
+
+		head = __atomic_load_n(&c->ring->head, __ATOMIC_ACQUIRE);
+		lag = head - 1 - msg.seq;
+		c->stats.samples++;
+		c->stats.lag = lag;
+		if (lag > c->stats.max_lag)
+			c->stats.max_lag = lag;
+		return 0;
+	}
+}
+
+/* Like ms5611_read_compensated(), pressure in 0.01 mbar, 0.01 degC */
+int ms5611_client_read_pressure_and_temperature(struct ms5611_client *c,
+		int *pressure, int *temperature)
+{
+	struct ms5611_sample sample;
+
+	if (ms5611_client_read(c, &sample) < 0)
+		return -1;
+
+	*pressure = sample.pressure;
+	*temperature = sample.temperature;
+	return 0;
+}
+
+void ms5611_client_stats(struct ms5611_client *c,
+		struct ms5611_client_stats *stats)
+{
+	*stats = c->stats;
+}
+
+/*
+ * daemon backend, "daemon[:<socket>[:<decimation>]]", reads through
+ * ms5611d like any other device.
+ *  */
+static int daemon_open(struct ms5611_dev *dev, const char *arg)
+{
+	char path[108] = MS5611D_SOCKET;
+	unsigned int decimation = 1;
+	const char *colon;
+
+	if (arg && *arg) {
+		colon = strchr(arg, ':');
+		if (colon)
+			decimation = strtoul(colon + 1, NULL, 0);
+		else
+			colon = arg + strlen(arg);
+		if (colon > arg) {
+			if ((size_t)(colon - arg) >= sizeof(path))
+				return -1;
+			memcpy(path, arg, colon - arg);
+			path[colon - arg] = '\0';
+		}
+	}
+
+	dev->priv = ms5611_client_open(path, decimation);
+	return dev->priv ? 0 : -1;
+}
+
+static void daemon_close(struct ms5611_dev *dev)
+{
+	ms5611_client_close(dev->priv);
+}
+
+static int daemon_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	memcpy(prom, ms5611_client_prom(dev->priv), 8 * sizeof(*prom));
+	return 0;
+}
+
+static int daemon_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	return ms5611_client_read(dev->priv, sample);
+}
+
+const struct ms5611_backend ms5611_daemon_backend = {
+	.name		= "daemon",
+	.open		= daemon_open,
+	.close		= daemon_close,
+	.read_prom	= daemon_read_prom,
+	.read		= daemon_read,
+};
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+#include "ms5611.h"
+
+/*
+ * Batch compensation, see ms5611_compensate_batch().
+ *
+ * All kernels compute the 64-bit formula of ms5611_compensate() with the
+ * second order terms made branch free: 'x >> 63' of the signed distance
+ * to 20 degC and to -15 degC is a mask of all ones below it, and the terms
+ * are added under that mask. Each 64-bit lane holds one sample.
+ *
+ * SSE4.1 and AVX2 have no 64-bit arithmetic shift and no 64-bit multiply.
+ * The shift is a logical one with the sign bit extended back, and every
+ * product but D1 * SENS has two factors that fit in 32 bits, which
+ * _mm_mul_epi32() takes. SENS needs up to 35 bits, so D1 * SENS is done as
+ * (D1 * (SENS >> 16) << 16) + D1 * (SENS & 0xFFFF). Both are exact for 24
+ * bit D1 and D2; larger ADC codes give unspecified results.
+ *  */
+typedef void (*compensate_fn)(const struct ms5611_calibration *,
+		const uint32_t *, const uint32_t *, int32_t *, int32_t *, size_t);
+
+#define SELECT_SAMPLES		256
+#define SELECT_ROUNDS		16
+
+struct compensate_kernel {
+	const char *name;
+	compensate_fn fn;
+	int (*supported)(void);		/* NULL if always there */
+};
+
+static void compensate_scalar(const struct ms5611_calibration *c,
+		const uint32_t *d1, const uint32_t *d2, int32_t *p, int32_t *t,
+		size_t n)
+{
+	int64_t dt, off, sens, temp, x, y, m1, m2, off2, sens2, sq;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		dt = (int64_t)d2[i] - ((int64_t)c->c5 << 8);
+		off = ((int64_t)c->c2 << 16) + ((c->c4 * dt) >> 7);
+		sens = ((int64_t)c->c1 << 15) + ((c->c3 * dt) >> 8);
+		temp = 2000 + ((c->c6 * dt) >> 23);
+
+		x = temp - 2000;
+		y = temp + 1500;
+		m1 = x >> 63;		/* Below 20 degC */
+		m2 = y >> 63;		/* Below -15 degC */
+		off2 = (5 * x * x) >> 1;
+		sens2 = off2 >> 1;
+		sq = y * y;
+		off2 += m2 & (7 * sq);
+		sens2 += m2 & ((11 * sq) >> 1);
+
+		temp -= m1 & ((dt * dt) >> 31);
+		off -= m1 & off2;
+		sens -= m1 & sens2;
+
+		t[i] = (int32_t)temp;
+		p[i] = (int32_t)((((d1[i] * sens) >> 21) - off) >> 15);
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/* Arithmetic right shift of 64-bit lanes by a constant */
+#define SSE_SRA64(x, n)							\
+	_mm_sub_epi64(_mm_xor_si128(_mm_srli_epi64(x, n),		\
+			_mm_set1_epi64x(1LL << (63 - (n)))),		\
+		_mm_set1_epi64x(1LL << (63 - (n))))
+#define AVX_SRA64(x, n)							\
+	_mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(x, n),	\
+			_mm256_set1_epi64x(1LL << (63 - (n)))),		\
+		_mm256_set1_epi64x(1LL << (63 - (n))))
+
+/* Two samples in the 64-bit lanes of @d1 and @d2 */
+static inline __attribute__((target("sse4.1"), always_inline)) void
+sse4_lanes(const struct ms5611_calibration *c, __m128i d1, __m128i d2,
+		__m128i *p, __m128i *t)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i dt, off, sens, temp, x, y, m1, m2, off2, sens2, sq, hi, lo;
+
+	dt = _mm_sub_epi64(d2, _mm_set1_epi64x((int64_t)c->c5 << 8));
+	off = _mm_add_epi64(_mm_set1_epi64x((int64_t)c->c2 << 16),
+			SSE_SRA64(_mm_mul_epi32(_mm_set1_epi64x(c->c4), dt), 7));
+	sens = _mm_add_epi64(_mm_set1_epi64x((int64_t)c->c1 << 15),
+			SSE_SRA64(_mm_mul_epi32(_mm_set1_epi64x(c->c3), dt), 8));
+	temp = SSE_SRA64(_mm_mul_epi32(_mm_set1_epi64x(c->c6), dt), 23);
+	x = temp;
+	temp = _mm_add_epi64(temp, _mm_set1_epi64x(2000));
+	y = _mm_add_epi64(temp, _mm_set1_epi64x(1500));
+	m1 = _mm_sub_epi64(zero, _mm_srli_epi64(x, 63));
+	m2 = _mm_sub_epi64(zero, _mm_srli_epi64(y, 63));
+
+	/* All of these are positive, a logical shift will do */
+	sq = _mm_mul_epi32(x, x);
+	off2 = _mm_srli_epi64(_mm_add_epi64(_mm_slli_epi64(sq, 2), sq), 1);
+	sens2 = _mm_srli_epi64(off2, 1);
+	sq = _mm_mul_epi32(y, y);
+	off2 = _mm_add_epi64(off2, _mm_and_si128(m2,
+			_mm_sub_epi64(_mm_slli_epi64(sq, 3), sq)));
+	sens2 = _mm_add_epi64(sens2, _mm_and_si128(m2, _mm_srli_epi64(
+			_mm_add_epi64(_mm_add_epi64(_mm_slli_epi64(sq, 3),
+					_mm_slli_epi64(sq, 1)), sq), 1)));
+
+	temp = _mm_sub_epi64(temp, _mm_and_si128(m1,
+			_mm_srli_epi64(_mm_mul_epi32(dt, dt), 31)));
+	off = _mm_sub_epi64(off, _mm_and_si128(m1, off2));
+	sens = _mm_sub_epi64(sens, _mm_and_si128(m1, sens2));
+
+	/* Only the low 32 bits are used, the sign need not be extended */
+	hi = _mm_slli_epi64(_mm_mul_epi32(d1, _mm_srli_epi64(sens, 16)), 16);
+	lo = _mm_mul_epu32(d1, _mm_and_si128(sens,
+				_mm_set1_epi64x(0xFFFF)));
+	*p = _mm_srli_epi64(_mm_sub_epi64(SSE_SRA64(_mm_add_epi64(hi, lo),
+					21), off), 15);
+	*t = temp;
+}
+
+/* Low halves of the 64-bit lanes of @a then @b */
+#define SSE_PACK32(a, b)						\
+	_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a),		\
+			_mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)))
+
+static __attribute__((target("sse4.1"))) void
+compensate_sse4(const struct ms5611_calibration *c, const uint32_t *d1,
+		const uint32_t *d2, int32_t *p, int32_t *t, size_t n)
+{
+	__m128i v1, v2, p0, t0, p1, t1;
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		v1 = _mm_loadu_si128((const __m128i *)(d1 + i));
+		v2 = _mm_loadu_si128((const __m128i *)(d2 + i));
+		sse4_lanes(c, _mm_cvtepu32_epi64(v1), _mm_cvtepu32_epi64(v2),
+				&p0, &t0);
+		sse4_lanes(c, _mm_cvtepu32_epi64(_mm_srli_si128(v1, 8)),
+				_mm_cvtepu32_epi64(_mm_srli_si128(v2, 8)),
+				&p1, &t1);
+		_mm_storeu_si128((__m128i *)(p + i), SSE_PACK32(p0, p1));
+		_mm_storeu_si128((__m128i *)(t + i), SSE_PACK32(t0, t1));
+	}
+
+	compensate_scalar(c, d1 + i, d2 + i, p + i, t + i, n - i);
+}
+
+/* Four samples in the 64-bit lanes of @d1 and @d2 */
+static inline __attribute__((target("avx2"), always_inline)) void
+avx2_lanes(const struct ms5611_calibration *c, __m256i d1, __m256i d2,
+		__m256i *p, __m256i *t)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i dt, off, sens, temp, x, y, m1, m2, off2, sens2, sq, hi, lo;
+
+	dt = _mm256_sub_epi64(d2, _mm256_set1_epi64x((int64_t)c->c5 << 8));
+	off = _mm256_add_epi64(_mm256_set1_epi64x((int64_t)c->c2 << 16),
+			AVX_SRA64(_mm256_mul_epi32(
+					_mm256_set1_epi64x(c->c4), dt), 7));
+	sens = _mm256_add_epi64(_mm256_set1_epi64x((int64_t)c->c1 << 15),
+			AVX_SRA64(_mm256_mul_epi32(
+					_mm256_set1_epi64x(c->c3), dt), 8));
+	temp = AVX_SRA64(_mm256_mul_epi32(_mm256_set1_epi64x(c->c6), dt), 23);
+	x = temp;
+	temp = _mm256_add_epi64(temp, _mm256_set1_epi64x(2000));
+	y = _mm256_add_epi64(temp, _mm256_set1_epi64x(1500));
+	m1 = _mm256_sub_epi64(zero, _mm256_srli_epi64(x, 63));
+	m2 = _mm256_sub_epi64(zero, _mm256_srli_epi64(y, 63));
+
+	sq = _mm256_mul_epi32(x, x);
+	off2 = _mm256_srli_epi64(_mm256_add_epi64(_mm256_slli_epi64(sq, 2),
+				sq), 1);
+	sens2 = _mm256_srli_epi64(off2, 1);
+	sq = _mm256_mul_epi32(y, y);
+	off2 = _mm256_add_epi64(off2, _mm256_and_si256(m2,
+			_mm256_sub_epi64(_mm256_slli_epi64(sq, 3), sq)));
+	sens2 = _mm256_add_epi64(sens2, _mm256_and_si256(m2,
+			_mm256_srli_epi64(_mm256_add_epi64(_mm256_add_epi64(
+					_mm256_slli_epi64(sq, 3),
+					_mm256_slli_epi64(sq, 1)), sq), 1)));
+
+	temp = _mm256_sub_epi64(temp, _mm256_and_si256(m1,
+			_mm256_srli_epi64(_mm256_mul_epi32(dt, dt), 31)));
+	off = _mm256_sub_epi64(off, _mm256_and_si256(m1, off2));
+	sens = _mm256_sub_epi64(sens, _mm256_and_si256(m1, sens2));
+
+	hi = _mm256_slli_epi64(_mm256_mul_epi32(d1,
+				_mm256_srli_epi64(sens, 16)), 16);
+	lo = _mm256_mul_epu32(d1, _mm256_and_si256(sens,
+				_mm256_set1_epi64x(0xFFFF)));
+	*p = _mm256_srli_epi64(_mm256_sub_epi64(AVX_SRA64(_mm256_add_epi64(hi,
+						lo), 21), off), 15);
+	*t = temp;
+}
+
+/* Low halves of the 64-bit lanes of @a then @b */
+static inline __attribute__((target("avx2"), always_inline)) __m256i
+avx2_pack32(__m256i a, __m256i b)
+{
+	const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+	return _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(a, idx),
+			_mm256_permutevar8x32_epi32(b, idx), 0x20);
+}
+
+static __attribute__((target("avx2"))) void
+compensate_avx2(const struct ms5611_calibration *c, const uint32_t *d1,
+		const uint32_t *d2, int32_t *p, int32_t *t, size_t n)
+{
+	__m128i a1, a2, b1, b2;
+	__m256i p0, t0, p1, t1;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		a1 = _mm_loadu_si128((const __m128i *)(d1 + i));
+		b1 = _mm_loadu_si128((const __m128i *)(d1 + i + 4));
+		a2 = _mm_loadu_si128((const __m128i *)(d2 + i));
+		b2 = _mm_loadu_si128((const __m128i *)(d2 + i + 4));
+		avx2_lanes(c, _mm256_cvtepu32_epi64(a1),
+				_mm256_cvtepu32_epi64(a2), &p0, &t0);
+		avx2_lanes(c, _mm256_cvtepu32_epi64(b1),
+				_mm256_cvtepu32_epi64(b2), &p1, &t1);
+		_mm256_storeu_si256((__m256i *)(p + i), avx2_pack32(p0, p1));
+		_mm256_storeu_si256((__m256i *)(t + i), avx2_pack32(t0, t1));
+	}
+
+	compensate_scalar(c, d1 + i, d2 + i, p + i, t + i, n - i);
+}
+
+static int have_sse4(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.1");
+}
+
+static int have_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+/* Product of the low 32 bits of the lanes, signed and unsigned */
+#define NEON_MUL32(a, b)	vmull_s32(vmovn_s64(a), vmovn_s64(b))
+#define NEON_MULU32(a, b)						\
+	vreinterpretq_s64_u64(vmull_u32(					\
+		vmovn_u64(vreinterpretq_u64_s64(a)),			\
+		vmovn_u64(vreinterpretq_u64_s64(b))))
+
+/*
+ * Two samples per 64-bit lane pair. NEON has the arithmetic shift, the
+ * products are split like on x86 since there is no 64-bit multiply.
+ *  */
+static void compensate_neon(const struct ms5611_calibration *c,
+		const uint32_t *d1, const uint32_t *d2, int32_t *p, int32_t *t,
+		size_t n)
+{
+	const int64x2_t c1 = vdupq_n_s64((int64_t)c->c1 << 15);
+	const int64x2_t c2 = vdupq_n_s64((int64_t)c->c2 << 16);
+	const int64x2_t c3 = vdupq_n_s64(c->c3);
+	const int64x2_t c4 = vdupq_n_s64(c->c4);
+	const int64x2_t c5 = vdupq_n_s64((int64_t)c->c5 << 8);
+	const int64x2_t c6 = vdupq_n_s64(c->c6);
+	int64x2_t v1, dt, off, sens, temp, y, m1, m2, off2, sens2, sq, hi, lo;
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		v1 = vreinterpretq_s64_u64(vmovl_u32(vld1_u32(d1 + i)));
+		dt = vsubq_s64(vreinterpretq_s64_u64(vmovl_u32(
+						vld1_u32(d2 + i))), c5);
+		off = vaddq_s64(c2, vshrq_n_s64(NEON_MUL32(c4, dt), 7));
+		sens = vaddq_s64(c1, vshrq_n_s64(NEON_MUL32(c3, dt), 8));
+		temp = vshrq_n_s64(NEON_MUL32(c6, dt), 23);
+		m1 = vshrq_n_s64(temp, 63);
+		sq = NEON_MUL32(temp, temp);
+		off2 = vshrq_n_s64(vaddq_s64(vshlq_n_s64(sq, 2), sq), 1);
+		sens2 = vshrq_n_s64(off2, 1);
+
+		temp = vaddq_s64(temp, vdupq_n_s64(2000));
+		y = vaddq_s64(temp, vdupq_n_s64(1500));
+		m2 = vshrq_n_s64(y, 63);
+		sq = NEON_MUL32(y, y);
+		off2 = vaddq_s64(off2, vandq_s64(m2,
+				vsubq_s64(vshlq_n_s64(sq, 3), sq)));
+		sens2 = vaddq_s64(sens2, vandq_s64(m2, vshrq_n_s64(
+				vaddq_s64(vaddq_s64(vshlq_n_s64(sq, 3),
+						vshlq_n_s64(sq, 1)), sq), 1)));
+
+		temp = vsubq_s64(temp, vandq_s64(m1,
+				vshrq_n_s64(NEON_MUL32(dt, dt), 31)));
+		off = vsubq_s64(off, vandq_s64(m1, off2));
+		sens = vsubq_s64(sens, vandq_s64(m1, sens2));
+
+		hi = vshlq_n_s64(NEON_MUL32(v1, vshrq_n_s64(sens, 16)), 16);
+		lo = NEON_MULU32(v1, vandq_s64(sens, vdupq_n_s64(0xFFFF)));
+		vst1_s32(p + i, vmovn_s64(vshrq_n_s64(vsubq_s64(
+				vshrq_n_s64(vaddq_s64(hi, lo), 21), off), 15)));
+		vst1_s32(t + i, vmovn_s64(temp));
+	}
+
+	compensate_scalar(c, d1 + i, d2 + i, p + i, t + i, n - i);
+}
+#endif
+
+/* Best first */
+static const struct compensate_kernel kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	{ "avx2", compensate_avx2, have_avx2 },
+	{ "sse4", compensate_sse4, have_sse4 },
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	{ "neon", compensate_neon, NULL },
+#endif
+	{ "scalar", compensate_scalar, NULL },
+};
+
+static const struct compensate_kernel *kernel;
+
+/*
+ * Best of SELECT_ROUNDS runs of @k on SELECT_SAMPLES samples, in ns. The
+ * codes walk the 24-bit range so both second order corrections are taken.
+ *  */
+static unsigned long long kernel_time(const struct compensate_kernel *k)
+{
+	static const struct ms5611_calibration datasheet = {
+		40127, 36924, 23317, 23282, 33464, 28312
+	};
+	uint32_t d1[SELECT_SAMPLES], d2[SELECT_SAMPLES];
+	int32_t p[SELECT_SAMPLES], t[SELECT_SAMPLES];
+	unsigned long long start, ns, best = ~0ULL;
+	unsigned int i;
+
+	for (i = 0; i < SELECT_SAMPLES; i++) {
+		d1[i] = (i * 65521U) & 0xFFFFFF;
+		d2[i] = (i * 40503U + 0x800000) & 0xFFFFFF;
+	}
+
+	k->fn(&datasheet, d1, d2, p, t, SELECT_SAMPLES);
+	for (i = 0; i < SELECT_ROUNDS; i++) {
+		start = ms5611_now_ns();
+		k->fn(&datasheet, d1, d2, p, t, SELECT_SAMPLES);
+		ns = ms5611_now_ns() - start;
+		if (ns < best)
+			best = ns;
+	}
+
+	return best;
+}
+
+/*
+ * Pick the kernel of ms5611_compensate_batch(). If @name is NULL every
+ * kernel the CPU runs is timed and the fastest taken: a wider instruction
+ * set is not always faster, SSE4.1 lacks the 64-bit multiply and shift
+ * and can lose to the scalar code. Returning -1 if @name is unknown or
+ * not supported.
+ *  */
+int ms5611_compensate_batch_select(const char *name)
+{
+	unsigned long long ns, best = ~0ULL;
+	const struct compensate_kernel *fastest = NULL;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		if (name && strcmp(name, kernels[i].name))
+			continue;
+		if (kernels[i].supported && !kernels[i].supported())
+			continue;
+
+		if (name) {
+			kernel = &kernels[i];
+			return 0;
+		}
+
+		ns = kernel_time(&kernels[i]);
+		if (ns < best) {
+			best = ns;
+			fastest = &kernels[i];
+		}
+	}
+
+	if (!fastest)
+		return -1;
+
+	kernel = fastest;
+	return 0;
+}
+
+/* Name of the kernel in use, selecting the fastest one if none was */
+const char *ms5611_compensate_batch_kernel(void)
+{
+	if (!kernel)
+		ms5611_compensate_batch_select(NULL);
+
+	return kernel->name;
+}
+
+/*
+ * Compensate @n samples, the same as ms5611_compensate() on each of them.
+ * The first call selects the kernel unless the caller did.
+ *  */
+void ms5611_compensate_batch(const struct ms5611_calibration *cali,
+		const uint32_t *d1, const uint32_t *d2, int32_t *p, int32_t *t,
+		size_t n)
+{
+	if (!kernel)
+		ms5611_compensate_batch_select(NULL);
+
+	kernel->fn(cali, d1, d2, p, t, n);
+}
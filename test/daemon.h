@@ -0,0 +1,57 @@
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <stdint.h>
+
+/*
+ * Protocol between ms5611d and its clients, see ms5611d.c.
+ *
+ * A client connects to the SOCK_SEQPACKET socket and gets a HELLO with the
+ * file descriptor of the shared ring attached. It sends SUBSCRIBE with a
+ * decimation n and from then on gets a SAMPLE for every n-th sample the
+ * daemon publishes, carrying the sequence number of its ring slot. The
+ * daemon does not wait for slow clients: a SAMPLE that does not fit in
+ * the socket is not sent, and a slot is overwritten one ring later, both
+ * of which the client counts as drops.
+ *  */
+#define MS5611D_SOCKET			"/tmp/ms5611d.sock"
+#define MS5611D_RING_MAGIC		0x4435534d	/* "MS5D" */
+#define MS5611D_RING_VERSION		1
+
+#define MS5611D_HELLO			1
+#define MS5611D_SUBSCRIBE		2
+#define MS5611D_SAMPLE			3
+
+struct ms5611d_msg {
+	uint32_t type;
+	uint32_t arg;			/* SUBSCRIBE: decimation */
+	uint64_t seq;			/* SAMPLE: slot sequence number */
+};
+
+/*
+ * A slot is valid for sample 'n' while its 'seq' reads n + 1 before and
+ * after copying it; the daemon sets it to 0 while it writes the slot.
+ *  */
+struct ms5611d_slot {
+	uint64_t seq;
+	uint64_t timestamp_ns;
+	uint32_t raw_pressure;
+	uint32_t raw_temperature;
+	int32_t pressure;
+	int32_t temperature;
+	uint32_t temp_age_usec;
+	uint32_t reserved;
+};
+
+struct ms5611d_ring {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;			/* Slots, power of two */
+	uint32_t period_usec;		/* 0 as fast as the device goes */
+	uint16_t prom[8];
+	uint64_t head;			/* Samples ever published */
+	uint8_t pad[24];		/* Slots start on a cache line */
+	struct ms5611d_slot slots[];
+};
+
+#endif /* _DAEMON_H_ */
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <math.h>
+
+/*
+ * Usage: gen_altitude > altitude_table.h
+ *
+ * Generates the tables of altitude.c. The barometric formula is
+ *   h = T0 / L * (1 - (p / QNH)^(R * L / (g * M)))
+ * and with p = 2^k * m, 1 <= m < 2, the power splits into 2^(k * e), one
+ * value per octave, and m^e, which is tabulated over [1, 2] and linearly
+ * interpolated. Both are Q30.
+ *  */
+#define ALT_EXPONENT		0.190263	/* R * L / (g * M) */
+#define ALT_TABLE_BITS		8
+#define ALT_OCTAVES		8		/* 2^9 to 2^17 Pa */
+
+int main(void)
+{
+	int i, n = 1 << ALT_TABLE_BITS;
+
+	printf("/* Generated by gen_altitude, do not edit */\n");
+	printf("#define ALT_EXPONENT\t\t%.6f\n", ALT_EXPONENT);
+	printf("#define ALT_TABLE_BITS\t\t%d\n\n", ALT_TABLE_BITS);
+
+	printf("/* m^e in Q30 for m = 1 + i / %d */\n", n);
+	printf("static const uint32_t alt_mantissa[%d] = {", n + 1);
+	for (i = 0; i <= n; i++)
+		printf("%s%10.0f,", i % 6 ? " " : "\n\t",
+				round(pow(1.0 + (double)i / n, ALT_EXPONENT) *
+					(1 << 30)));
+	printf("\n};\n\n");
+
+	printf("/* 2^(j * e) in Q30 for j = %d .. %d */\n", 1 - ALT_OCTAVES,
+			ALT_OCTAVES - 1);
+	printf("static const uint32_t alt_octave[%d] = {", 2 * ALT_OCTAVES - 1);
+	for (i = 1 - ALT_OCTAVES; i < ALT_OCTAVES; i++)
+		printf("%s%10.0f,", (i + ALT_OCTAVES - 1) % 6 ? " " : "\n\t",
+				round(pow(2.0, i * ALT_EXPONENT) * (1 << 30)));
+	printf("\n};\n");
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "backend.h"
+
+/*
+ * Userspace driver over /dev/i2c-N, no kernel module needed.
+ *
+ * Spec "i2c[:<bus>[:<addr>]]", default bus 1 and address 0x77. Every bus
+ * access is a single I2C_RDWR ioctl with combined messages: the whole PROM
+ * in one, and the ADC read of D1 together with the convert command of D2,
+ * so a sample costs three ioctls and two sleeps of the conversion time.
+ *  */
+struct i2cdev {
+	int fd;
+	unsigned short addr;
+	const struct ms5611_osr_info *pressure_osr;
+	const struct ms5611_osr_info *temp_osr;
+};
+
+static int i2cdev_transfer(struct i2cdev *i2c, struct i2c_msg *msgs, int n)
+{
+	struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = n };
+
+	if (ioctl(i2c->fd, I2C_RDWR, &xfer) != n) {
+		printf("Error: I2C transfer at 0x%02x\n", i2c->addr);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int i2cdev_command(struct i2cdev *i2c, unsigned char cmd)
+{
+	struct i2c_msg msg = { i2c->addr, 0, 1, &cmd };
+
+	return i2cdev_transfer(i2c, &msg, 1);
+}
+
+/*
+ * Read the ADC and, if @next is not 0, start the next conversion in the
+ * same transfer.
+ *  */
+static int i2cdev_read_adc(struct i2cdev *i2c, unsigned int *data,
+		unsigned char next)
+{
+	unsigned char cmd = CMD_ADC_READ, buf[3];
+	struct i2c_msg msgs[3] = {
+		{ i2c->addr, 0, 1, &cmd },
+		{ i2c->addr, I2C_M_RD, 3, buf },
+		{ i2c->addr, 0, 1, &next },
+	};
+
+	if (i2cdev_transfer(i2c, msgs, next ? 3 : 2) < 0)
+		return -1;
+
+	*data = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+	return 0;
+}
+
+static int i2cdev_open(struct ms5611_dev *dev, const char *arg)
+{
+	unsigned int bus = 1, addr = 0x77;
+	char path[32];
+	struct i2cdev *i2c;
+
+	if (arg && sscanf(arg, "%u:%i", &bus, &addr) < 1) {
+		printf("Error: I2C spec %s\n", arg);
+		return -1;
+	}
+
+	i2c = calloc(1, sizeof(*i2c));
+	if (!i2c)
+		return -1;
+
+	snprintf(path, sizeof(path), "/dev/i2c-%u", bus);
+	i2c->fd = open(path, O_RDWR);
+	if (i2c->fd < 0) {
+		printf("Error: Open %s\n", path);
+		free(i2c);
+		return -1;
+	}
+
+	i2c->addr = addr;
+	i2c->pressure_osr = ms5611_osr_info(4096);
+	i2c->temp_osr = ms5611_osr_info(4096);
+	dev->priv = i2c;
+
+	/* Same as ms5611_init_client() in the driver */
+	if (i2cdev_command(i2c, CMD_RST) < 0) {
+		close(i2c->fd);
+		free(i2c);
+		return -1;
+	}
+	ms5611_sleep_usec(3000);
+
+	return 0;
+}
+
+static void i2cdev_close(struct ms5611_dev *dev)
+{
+	struct i2cdev *i2c = dev->priv;
+
+	close(i2c->fd);
+	free(i2c);
+}
+
+/*
+ * All eight PROM words in one transfer, each a command and a 2 byte read.
+ *  */
+static int i2cdev_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	struct i2cdev *i2c = dev->priv;
+	unsigned char cmd[CALI_DATA_LEN], buf[CALI_DATA_LEN][2];
+	struct i2c_msg msgs[CALI_DATA_LEN * 2];
+	int i;
+
+	for (i = 0; i < CALI_DATA_LEN; i++) {
+		cmd[i] = CALI_DATA_START + i * 2;
+		msgs[i * 2] = (struct i2c_msg){ i2c->addr, 0, 1, &cmd[i] };
+		msgs[i * 2 + 1] = (struct i2c_msg){ i2c->addr, I2C_M_RD, 2,
+			buf[i] };
+	}
+
+	if (i2cdev_transfer(i2c, msgs, CALI_DATA_LEN * 2) < 0)
+		return -1;
+
+	for (i = 0; i < CALI_DATA_LEN; i++)
+		prom[i] = (buf[i][0] << 8) | buf[i][1];
+
+	if (!ms5611_prom_is_valid(prom)) {
+		printf("PROM integrity check failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int i2cdev_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	struct i2cdev *i2c = dev->priv;
+
+	if (i2cdev_command(i2c, i2c->pressure_osr->pressure_cmd) < 0)
+		return -1;
+	sample->timestamp_ns = ms5611_now_ns() +
+		i2c->pressure_osr->conv_usec * 500ULL;
+	ms5611_sleep_usec(i2c->pressure_osr->conv_usec);
+
+	if (i2cdev_read_adc(i2c, &sample->raw_pressure,
+				i2c->temp_osr->temp_cmd) < 0)
+		return -1;
+	ms5611_sleep_usec(i2c->temp_osr->conv_usec);
+
+	return i2cdev_read_adc(i2c, &sample->raw_temperature, 0);
+}
+
+static int i2cdev_set_oversampling(struct ms5611_dev *dev,
+		const struct ms5611_osr_info *pressure,
+		const struct ms5611_osr_info *temperature)
+{
+	struct i2cdev *i2c = dev->priv;
+
+	i2c->pressure_osr = pressure;
+	i2c->temp_osr = temperature;
+	return 0;
+}
+
+const struct ms5611_backend ms5611_i2cdev_backend = {
+	.name			= "i2c",
+	.open			= i2cdev_open,
+	.close			= i2cdev_close,
+	.read_prom		= i2cdev_read_prom,
+	.read			= i2cdev_read,
+	.set_oversampling	= i2cdev_set_oversampling,
+};
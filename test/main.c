@@ -1,13 +1,52 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "ms5611.h"
 
-int main(void)
+/*
+ * Usage: main [spec [count]]
+ *
+ * Without arguments reads one sample through the sysfs attributes. With a
+ * device spec, see ms5611.h, reads 'count' samples through that backend
+ * and prints the mean time per sample, e.g. to compare "i2c:1" with
+ * "sysfs" on the same board.
+ *  */
+int main(int argc, char *argv[])
 {
 	int temperature, pressure;
 	struct ms5611_calibration cali;
+	struct ms5611_sample sample;
+	struct ms5611_dev *dev;
+	unsigned long long start;
+	int i, count;
 
-	ms5611_read_calibration(&cali);
-	ms5611_read_pressure_and_temperature(&cali, &pressure, &temperature);
+	if (argc < 2) {
+		ms5611_read_calibration(&cali);
+		ms5611_read_pressure_and_temperature(&cali, &pressure,
+				&temperature);
+		return 0;
+	}
 
+	count = argc > 2 ? atoi(argv[2]) : 1;
+	dev = ms5611_open(argv[1]);
+	if (!dev)
+		return 1;
+
+	start = ms5611_now_ns();
+	for (i = 0; i < count; i++) {
+		if (ms5611_dev_read(dev, &sample) < 0) {
+			printf("Error: Read sample %d\n", i);
+			break;
+		}
+	}
+
+	if (i > 0)
+		printf("%s: %d samples, %.1f us/sample, last %d.%02d mbar "
+				"%d.%02d C\n", argv[1], i,
+				(ms5611_now_ns() - start) / 1000.0 / i,
+				sample.pressure / 100, abs(sample.pressure % 100),
+				sample.temperature / 100,
+				abs(sample.temperature % 100));
+
+	ms5611_close(dev);
 	return 0;
 }
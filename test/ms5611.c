@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
 #include "ops.h"
 #include "ms5611.h"
 
-#define MS561101BA_PATH_BASE		"/sys/devices/virtual/input/input4"
+#define BATCH_CHUNK			64
 
 /* Read calibration data from PROM */
 int ms5611_read_calibration(struct ms5611_calibration *cali)
@@ -43,27 +48,97 @@ static int read_adc_pressure_and_temperature(unsigned int *pressure,
 	return 0;
 }
 
-static int cal_temp_and_pressure(struct ms5611_calibration *cali,
-		int *pressure, int *temperature)
+static const struct ms5611_osr_info osr_table[] = {
+	{ 256,  0x40, 0x50, 600,  65 },
+	{ 512,  0x42, 0x52, 1170, 42 },
+	{ 1024, 0x44, 0x54, 2280, 27 },
+	{ 2048, 0x46, 0x56, 4540, 18 },
+	{ 4096, 0x48, 0x58, 9040, 12 },
+};
+
+/* Settings of an oversampling rate, NULL if the rate is not supported */
+const struct ms5611_osr_info *ms5611_osr_info(unsigned short rate)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(osr_table) / sizeof(osr_table[0]); i++)
+		if (osr_table[i].rate == rate)
+			return &osr_table[i];
+
+	return NULL;
+}
+
+/*
+ * 4-bit CRC of the PROM, as checked by ms5611_prom_is_valid() in the
+ * driver. The CRC itself sits in the low nibble of prom[7] and is left
+ * out of the calculation together with the rest of that byte.
+ *  */
+unsigned short ms5611_prom_crc4(const unsigned short *prom)
+{
+	unsigned short crc = 0, word;
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		word = i < 14 ? prom[i >> 1] : prom[7] & 0xFF00;
+		crc ^= (i % 2 == 1) ? word & 0x00FF : word >> 8;
+
+		for (j = 0; j < 8; j++) {
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x3000;
+			else
+				crc <<= 1;
+		}
+	}
+
+	return (crc >> 12) & 0x000F;
+}
+
+/* Returning 1 if the CRC of the PROM matches else 0 */
+int ms5611_prom_is_valid(const unsigned short *prom)
+{
+	unsigned short crc = prom[7] & 0x000F;
+
+	return crc != 0 && crc == ms5611_prom_crc4(prom);
+}
+
+void ms5611_calibration_from_prom(struct ms5611_calibration *cali,
+		const unsigned short *prom)
+{
+	cali->c1 = prom[1];
+	cali->c2 = prom[2];
+	cali->c3 = prom[3];
+	cali->c4 = prom[4];
+	cali->c5 = prom[5];
+	cali->c6 = prom[6];
+}
+
+/*
+ * Second order compensation of the datasheet, pressure in 0.01 mbar and
+ * temperature in 0.01 degC. The intermediate terms need 64 bits, 'long'
+ * is only 32 bits wide on ARM.
+ *  */
+int ms5611_compensate(const struct ms5611_calibration *cali,
+		unsigned int d1, unsigned int d2, int *pressure,
+		int *temperature)
 {
-	int t = *temperature, p = *pressure;
-	long off, sens, dt;
+	int64_t t, p = d1;
+	int64_t off, sens, dt;
 
-	dt = t - (cali->c5 << 8);
-	off = ((long)cali->c2<<16) + ((cali->c4 * dt) >> 7);
-	sens = ((long)cali->c1<<15) + ((cali->c3 * dt) >> 8);
+	dt = d2 - ((int64_t)cali->c5 << 8);
+	off = ((int64_t)cali->c2 << 16) + ((cali->c4 * dt) >> 7);
+	sens = ((int64_t)cali->c1 << 15) + ((cali->c3 * dt) >> 8);
 
 	t = 2000 + ((cali->c6 * dt) >> 23);
 
 	if (t < 2000) {
-		long off2, sens2, t2;
+		int64_t off2, sens2, t2;
 
 		t2 = (dt * dt) >> 31;
 		off2 = (5 * (t - 2000) * (t - 2000)) >> 1;
 		sens2 = off2 >> 1;
 
 		if (t < -1500) {
-			long tmp = (t + 1500) * (t + 1500);
+			int64_t tmp = (t + 1500) * (t + 1500);
 			off2 += 7 * tmp;
 			sens2 += (11 * tmp) >> 1;
 		}
@@ -73,8 +148,8 @@ static int cal_temp_and_pressure(struct ms5611_calibration *cali,
 		sens -= sens2;
 	}
 
-	*temperature = t;
-	*pressure = (((p * sens) >> 21) - off) >> 15;
+	*temperature = (int)t;
+	*pressure = (int)((((p * sens) >> 21) - off) >> 15);
 
 	return 0;
 }
@@ -90,7 +165,8 @@ int ms5611_read_pressure_and_temperature(struct ms5611_calibration *cali,
 		return -1;
 	}
 
-	if (cal_temp_and_pressure(cali, pressure, temperature) < 0) {
+	if (ms5611_compensate(cali, *pressure, *temperature, pressure,
+				temperature) < 0) {
 		printf("Error: Compensate temperature and pressure\n");
 		return -1;
 	}
@@ -98,6 +174,83 @@ int ms5611_read_pressure_and_temperature(struct ms5611_calibration *cali,
 	return 0;
 }
 
+/*
+ * Read a sample compensated by the driver, pressure in 0.01 mbar and
+ * temperature in 0.01 degC. No calibration data is needed.
+ *  */
+int ms5611_read_compensated(int *pressure, int *temperature)
+{
+	char *buf = NULL;
+	int ret;
+
+	ret = read_data_block(MS561101BA_PATH_BASE, "compensated", &buf);
+	if (ret < 0) {
+		printf("Error: Read compensated data\n");
+		free(buf);
+		return -1;
+	}
+
+	if (sscanf(buf, "%d %d", temperature, pressure) != 2) {
+		free(buf);
+		return -1;
+	}
+
+	free(buf);
+	return 0;
+}
+
+/*
+ * Acquire @n samples back to back in the driver, BATCH_CHUNK per ioctl.
+ * Returning the number of samples stored, or -1 if none could be read.
+ *  */
+int ms5611_read_batch(struct ms5611_sample *out, size_t n)
+{
+	struct ms5611_record recs[BATCH_CHUNK];
+	struct ms5611_batch batch;
+	size_t done = 0;
+	unsigned int i;
+	int fd;
+
+	if (!out)
+		return -1;
+
+	fd = open(MS561101BA_DEV_PATH, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Open %s\n", MS561101BA_DEV_PATH);
+		return -1;
+	}
+
+	while (done < n) {
+		batch.records = (unsigned long)recs;
+		batch.count = n - done < BATCH_CHUNK ? n - done : BATCH_CHUNK;
+		batch.done = 0;
+		batch.record_size = sizeof(recs[0]);
+		batch.reserved = 0;
+
+		if (ioctl(fd, MS5611_IOC_READ_BATCH, &batch) < 0 &&
+				batch.done == 0) {
+			printf("Error: Read batch\n");
+			break;
+		}
+
+		for (i = 0; i < batch.done; i++, done++) {
+			out[done].raw_pressure = recs[i].raw_pressure;
+			out[done].raw_temperature = recs[i].raw_temperature;
+			out[done].pressure = recs[i].pressure;
+			out[done].temperature = recs[i].temperature;
+			out[done].timestamp_ns = recs[i].timestamp_ns;
+			out[done].boottime_ns = recs[i].boottime_ns;
+			out[done].temp_age_usec = recs[i].temp_age_usec;
+		}
+
+		if (batch.done < batch.count)
+			break;
+	}
+
+	close(fd);
+	return done || n == 0 ? (int)done : -1;
+}
+
 int ms5611_get_oversampling_temperature(unsigned short *sample)
 {
 	int ret;
@@ -149,3 +302,162 @@ int ms5611_set_oversampling_pressure(unsigned short sample)
 
 	return 0;
 }
+
+/*
+ * Read a consistent 'head' of the mapped ring. The header 'seq' is odd
+ * while the driver writes, and 'head' may tear on 32-bit machines.
+ *  */
+static unsigned long long map_head(const struct ms5611_ring_header *hdr,
+		unsigned int *seq)
+{
+	unsigned long long head;
+	unsigned int s;
+
+	for (;;) {
+		s = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (s & 1)
+			continue;
+
+		head = hdr->head;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == s)
+			break;
+	}
+
+	if (seq)
+		*seq = s;
+	return head;
+}
+
+/*
+ * Map the sample ring of the driver. @dev is the stream device, NULL for
+ * the default one. ms5611_map_read() starts with the next published sample.
+ *  */
+int ms5611_map_open(struct ms5611_map *map, const char *dev)
+{
+	struct ms5611_ring_header hdr;
+	void *base;
+
+	if (!map)
+		return -1;
+
+	if (!dev)
+		dev = MS561101BA_DEV_PATH;
+
+	map->fd = open(dev, O_RDONLY);
+	if (map->fd < 0) {
+		printf("Error: Open %s\n", dev);
+		return -1;
+	}
+
+	base = mmap(NULL, sizeof(hdr), PROT_READ, MAP_SHARED, map->fd, 0);
+	if (base == MAP_FAILED)
+		goto err_map;
+	memcpy(&hdr, base, sizeof(hdr));
+	munmap(base, sizeof(hdr));
+
+	if (hdr.magic != MS5611_RING_MAGIC ||
+			hdr.version != MS5611_RING_VERSION ||
+			hdr.record_size != sizeof(struct ms5611_record)) {
+		printf("Error: Unknown sample ring layout\n");
+		close(map->fd);
+		return -1;
+	}
+
+	map->len = hdr.data_offset + (size_t)hdr.size * hdr.record_size;
+	map->base = mmap(NULL, map->len, PROT_READ, MAP_SHARED, map->fd, 0);
+	if (map->base == MAP_FAILED)
+		goto err_map;
+
+	map->hdr = map->base;
+	map->slots = (const struct ms5611_record *)
+		((const char *)map->base + hdr.data_offset);
+	map->tail = map_head(map->hdr, NULL);
+	map->overruns = 0;
+	return 0;
+
+err_map:
+	printf("Error: Map %s\n", dev);
+	close(map->fd);
+	return -1;
+}
+
+void ms5611_map_close(struct ms5611_map *map)
+{
+	if (!map)
+		return;
+
+	munmap(map->base, map->len);
+	close(map->fd);
+}
+
+/* Calibration data as read by the driver at probe time */
+void ms5611_map_calibration(struct ms5611_map *map,
+		struct ms5611_calibration *cali)
+{
+	const unsigned short *c = map->hdr->calibration;
+
+	cali->c1 = c[1];
+	cali->c2 = c[2];
+	cali->c3 = c[3];
+	cali->c4 = c[4];
+	cali->c5 = c[5];
+	cali->c6 = c[6];
+}
+
+/*
+ * Copy the latest published sample. Returning -1 when nothing has been
+ * published yet else 0.
+ *  */
+int ms5611_map_latest(struct ms5611_map *map, struct ms5611_record *rec)
+{
+	unsigned long long head;
+	unsigned int seq;
+
+	do {
+		head = map_head(map->hdr, &seq);
+		if (head == 0)
+			return -1;
+
+		memcpy(rec, &map->slots[(head - 1) & (map->hdr->size - 1)],
+				sizeof(*rec));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&map->hdr->seq, __ATOMIC_RELAXED) != seq);
+
+	return 0;
+}
+
+/*
+ * Copy up to @n samples published since the last call, oldest first.
+ * Samples overwritten before they could be copied are skipped and counted
+ * in 'overruns'. Returning the number of samples copied.
+ *  */
+int ms5611_map_read(struct ms5611_map *map, struct ms5611_record *recs, int n)
+{
+	unsigned long long head;
+	unsigned int size = map->hdr->size;
+	int done = 0;
+
+	while (done < n) {
+		head = map_head(map->hdr, NULL);
+		if (head - map->tail >= size) {
+			map->overruns += head - map->tail - (size - 1);
+			map->tail = head - (size - 1);
+		}
+		if (map->tail == head)
+			break;
+
+		memcpy(&recs[done], &map->slots[map->tail & (size - 1)],
+				sizeof(*recs));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		/* Overwritten while we copied it, the next pass skips it */
+		if (map_head(map->hdr, NULL) - map->tail >= size)
+			continue;
+
+		map->tail++;
+		done++;
+	}
+
+	return done;
+}
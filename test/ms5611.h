@@ -1,6 +1,14 @@
 #ifndef _SENSOR_MS5611_H
 #define _SENSOR_MS5611_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "../src/ms561101ba.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*
  * MS5611-01BA03 Barometric Pressure Sensor
  *
@@ -13,20 +21,311 @@
  *    tempsens		Read Only	temperature coefficient of the temperature		"%d"
  *    oversampling_temp RW		oversampling of temperature				"%d"
  *    oversampling_pres RW		oversampling of pressure				"%d"
- *    temp_and_pressure	Read Only	digital pressure and digital temperature value		"%d %d"
+ *    temp_decimation	RW		samples sharing one temperature conversion		"%d"
+ *    temp_max_age_usec RW		temperature refresh age, 0 disabled			"%d"
+ *    osr_mode		RW		0 manual, 1 fit the period, 2 fit target_noise		"%d"
+ *    target_noise	RW		target RMS pressure noise in 0.001 mbar			"%d"
+ *    noise		Read Only	estimated RMS pressure noise in 0.001 mbar		"%d"
+ *    temp_and_pressure	Read Only	digital temperature and pressure			"%d %d"
+ *    sample_timestamp_ns Read Only	D1 midpoint of the latest sample, CLOCK_MONOTONIC ns	"%lld"
+ *    compensated	Read Only	temperature (0.01 degC) and pressure (0.01 mbar)	"%d %d"
+ *    mode		RW		0 on-demand, 1 continuous acquisition			"%d"
+ *    period_usec	RW		continuous sampling period in microseconds		"%d"
+ *    pipelined		RW		ADC read and next convert in one transfer		"%d"
+ *    bus_nsec		RW		bus time per sample: last, mean, max; write resets max	"%lld %lld %lld"
+ *    rate_mhz		Read Only	achieved sample rate of the last second in mHz		"%d"
+ *    bus_load		Read Only	bus time permille of the sensor and of its adapter	"%d %d"
+ *
+ * Every sample is also streamed as a binary 'struct ms5611_record' through
+ * /dev/ms5611-<bus>-<addr>, see src/ms561101ba.h. /dev/ms5611 streams the
+ * samples of all sensors in timestamp order as 'struct ms5611_merged_record'.
+ * A file of either returns the records of format 1, without 'boottime_ns',
+ * until MS5611_IOC_SET_FORMAT asks for MS5611_FORMAT; the library does.
+ *
+ * With debugfs, ms5611/<device>/ holds the counters conversions, bus_errors,
+ * retries, overruns and dropped, and the log2 histograms bus_latency_hist
+ * and sample_latency_hist. The ms5611 trace system has the events
+ * ms5611_convert, ms5611_adc_read and ms5611_sample.
  *  */
 
+/* Default sysfs directory and sample stream of the sensor */
+#define MS561101BA_PATH_BASE		"/sys/devices/virtual/input/input4"
+#define MS561101BA_DEV_PATH		"/dev/ms5611-1-77"
+
 /* struct ms5611_calibration for calibration data */
 struct ms5611_calibration {
 	unsigned short c1, c2, c3;
 	unsigned short c4, c5, c6;
 };
 
+/* Oversampling settings, mirrors the OSR tables of the driver */
+struct ms5611_osr_info {
+	unsigned short rate;
+	unsigned char pressure_cmd;	/* Convert D1 command */
+	unsigned char temp_cmd;		/* Convert D2 command */
+	unsigned int conv_usec;		/* Conversion time */
+	unsigned int noise;		/* Datasheet RMS noise, 0.001 mbar */
+};
+
+const struct ms5611_osr_info *ms5611_osr_info(unsigned short);
+unsigned short ms5611_prom_crc4(const unsigned short *);
+int ms5611_prom_is_valid(const unsigned short *);
+void ms5611_calibration_from_prom(struct ms5611_calibration *,
+		const unsigned short *);
+int ms5611_compensate(const struct ms5611_calibration *, unsigned int,
+		unsigned int, int *, int *);
+
+/*
+ * Compensate n samples from separate D1 and D2 arrays into separate
+ * pressure and temperature arrays, bit for bit like ms5611_compensate().
+ * The fastest kernel the CPU runs is timed and picked on first use, see
+ * compensate.c.
+ *  */
+void ms5611_compensate_batch(const struct ms5611_calibration *,
+		const uint32_t *, const uint32_t *, int32_t *, int32_t *, size_t);
+int ms5611_compensate_batch_select(const char *);
+const char *ms5611_compensate_batch_kernel(void);
+
+/*
+ * Pressure altitude of the standard atmosphere over a reference pressure,
+ * from tables instead of pow(), see altitude.c for the error. Pressures
+ * are in Pa, 0.01 mbar, like ms5611_compensate() gives them.
+ *  */
+#define MS5611_ALT_OCTAVES	8
+
+struct ms5611_altitude_ref {
+	int32_t qnh;
+	int64_t mm[MS5611_ALT_OCTAVES];		/* Per octave of the pressure */
+	float m[MS5611_ALT_OCTAVES];		/* The same, for the float API */
+};
+
+void ms5611_altitude_ref_init(struct ms5611_altitude_ref *, int32_t);
+int32_t ms5611_altitude_mm(const struct ms5611_altitude_ref *, int32_t);
+float ms5611_altitude_m(const struct ms5611_altitude_ref *, float);
+void ms5611_altitude_mm_batch(const struct ms5611_altitude_ref *,
+		const int32_t *, int32_t *, size_t);
+void ms5611_altitude_m_batch(const struct ms5611_altitude_ref *,
+		const float *, float *, size_t);
+
 int ms5611_read_calibration(struct ms5611_calibration *);
 int ms5611_read_pressure_and_temperature(struct ms5611_calibration *, int *, int *);
-int ms5611_get_oversampling_temeprature(unsigned short *);
+int ms5611_read_compensated(int *, int *);
+int ms5611_get_oversampling_temperature(unsigned short *);
 int ms5611_get_oversampling_pressure(unsigned short *);
-int ms5611_set_oversampling_temeprature(unsigned short);
+int ms5611_set_oversampling_temperature(unsigned short);
 int ms5611_set_oversampling_pressure(unsigned short);
 
+/*
+ * One compensated sample, pressure in 0.01 mbar, temperature in 0.01 degC.
+ * Both timestamps are the middle of the D1 conversion, like those of
+ * struct ms5611_record, whichever backend it came from.
+ *  */
+struct ms5611_sample {
+	unsigned int raw_pressure;
+	unsigned int raw_temperature;
+	int pressure;
+	int temperature;
+	unsigned long long timestamp_ns;	/* CLOCK_MONOTONIC */
+	unsigned int temp_age_usec;		/* Age of the temperature */
+	unsigned long long boottime_ns;		/* CLOCK_BOOTTIME */
+};
+
+int ms5611_read_batch(struct ms5611_sample *, size_t);
+
+/*
+ * Device handle over one of the backends, selected by the spec given to
+ * ms5611_open():
+ *   "sysfs[:<dir>]"	attributes of the kernel driver
+ *   "chardev[:<dev>]"	sample stream of the kernel driver
+ *   "sim[:<key>=<value>,...]"	in-process simulator, see sim.c
+ *   "i2c[:<bus>[:<addr>]]"	userspace driver over /dev/i2c-<bus>
+ *   "spi[:<bus>.<cs>[:<hz>]]"	userspace driver over /dev/spidev<bus>.<cs>
+ *   "capture:<file>"	samples of a capture file, see below
+ *   "daemon[:<socket>[:<n>]]"	every n-th sample of ms5611d, see below
+ * NULL opens the default sysfs directory.
+ *  */
+struct ms5611_dev;
+
+struct ms5611_dev *ms5611_open(const char *);
+void ms5611_close(struct ms5611_dev *);
+const struct ms5611_calibration *ms5611_dev_calibration(struct ms5611_dev *);
+const unsigned short *ms5611_dev_prom(struct ms5611_dev *);
+int ms5611_dev_read(struct ms5611_dev *, struct ms5611_sample *);
+int ms5611_dev_set_oversampling(struct ms5611_dev *, unsigned short,
+		unsigned short);
+unsigned long long ms5611_now_ns(void);
+unsigned long long ms5611_boottime_ns(unsigned long long);
+
+/* Read-only mapping of the driver's sample ring, no syscall per sample */
+struct ms5611_map {
+	int fd;
+	void *base;
+	size_t len;
+	const struct ms5611_ring_header *hdr;
+	const struct ms5611_record *slots;
+	unsigned long long tail;	/* Next record for ms5611_map_read() */
+	unsigned long long overruns;	/* Records lost by ms5611_map_read() */
+};
+
+int ms5611_map_open(struct ms5611_map *, const char *);
+void ms5611_map_close(struct ms5611_map *);
+void ms5611_map_calibration(struct ms5611_map *, struct ms5611_calibration *);
+int ms5611_map_latest(struct ms5611_map *, struct ms5611_record *);
+int ms5611_map_read(struct ms5611_map *, struct ms5611_record *, int);
+
+/*
+ * Capture files of raw samples, delta coded in blocks with a time index,
+ * see capture.c for the layout. A capture is written in sample order and
+ * read back through a mapping, seeking by timestamp.
+ *  */
+struct ms5611_capture_info {
+	unsigned short prom[8];
+	unsigned short pressure_osr;		/* 0 if not known */
+	unsigned short temp_osr;
+	unsigned long long mono_ns;		/* Clock base, CLOCK_MONOTONIC */
+	unsigned long long real_ns;		/* CLOCK_REALTIME at mono_ns */
+	unsigned long long samples;
+	unsigned int block_samples;
+};
+
+struct ms5611_capture;
+struct ms5611_replay;
+
+struct ms5611_capture *ms5611_capture_create(const char *,
+		const unsigned short *, unsigned short, unsigned short,
+		unsigned int);
+int ms5611_capture_write(struct ms5611_capture *,
+		const struct ms5611_sample *);
+int ms5611_capture_close(struct ms5611_capture *);
+
+struct ms5611_replay *ms5611_replay_open(const char *);
+void ms5611_replay_close(struct ms5611_replay *);
+const struct ms5611_capture_info *ms5611_replay_info(struct ms5611_replay *);
+int ms5611_replay_read(struct ms5611_replay *, struct ms5611_sample *);
+int ms5611_replay_seek(struct ms5611_replay *, unsigned long long);
+
+/*
+ * Client of ms5611d, which owns the device and shares its samples, see
+ * ms5611d.c. Samples the client missed, because it was too slow or the
+ * daemon could not notify it, are counted as drops; the lag is how many
+ * samples the daemon had published since the one just read.
+ *  */
+struct ms5611_client_stats {
+	unsigned long long samples;
+	unsigned long long drops;
+	unsigned long long lag;
+	unsigned long long max_lag;
+};
+
+struct ms5611_client;
+
+struct ms5611_client *ms5611_client_open(const char *, unsigned int);
+void ms5611_client_close(struct ms5611_client *);
+const unsigned short *ms5611_client_prom(struct ms5611_client *);
+int ms5611_client_read(struct ms5611_client *, struct ms5611_sample *);
+int ms5611_client_read_pressure_and_temperature(struct ms5611_client *,
+		int *, int *);
+void ms5611_client_stats(struct ms5611_client *,
+		struct ms5611_client_stats *);
+
+/*
+ * Asynchronous reads over io_uring, see async.c. A read is submitted with
+ * a callback and completes in ms5611_async_run(), so one thread keeps
+ * reads of many sensors in flight.
+ *  */
+struct ms5611_async;
+
+typedef void (*ms5611_async_cb)(void *, int, const struct ms5611_sample *);
+
+struct ms5611_async *ms5611_async_create(unsigned int);
+void ms5611_async_destroy(struct ms5611_async *);
+int ms5611_async_fd(struct ms5611_async *);
+int ms5611_async_open(struct ms5611_async *, const char *, unsigned short,
+		unsigned short);
+struct ms5611_dev *ms5611_async_dev(struct ms5611_async *, int);
+long long ms5611_async_submit(struct ms5611_async *, int, unsigned long long,
+		ms5611_async_cb, void *);
+int ms5611_async_cancel(struct ms5611_async *, long long);
+int ms5611_async_run(struct ms5611_async *, int);
+
+/*
+ * Linear resampling of the samples onto the caller's ticks, such as those
+ * of an IMU, see resample.c. Samples are pushed and ticks resampled in
+ * batches; a resampled point carries the tick as its timestamp.
+ *  */
+#define MS5611_RESAMPLE_HISTORY		32	/* Power of two */
+
+#define MS5611_RESAMPLE_HELD		0x1	/* Nearest sample, not interpolated */
+#define MS5611_RESAMPLE_EXTRAPOLATED	0x2	/* Past the latest sample */
+
+struct ms5611_resampled {
+	unsigned long long timestamp_ns;
+	float pressure;				/* 0.01 mbar */
+	float temperature;			/* 0.01 degC */
+	unsigned int flags;
+};
+
+struct ms5611_resampler {
+	int boottime;				/* Use CLOCK_BOOTTIME */
+	unsigned long long max_gap_ns;		/* Hold across wider gaps */
+	unsigned long long max_ahead_ns;	/* Extrapolate up to this */
+	unsigned long long count;		/* Samples pushed */
+	unsigned long long cursor;		/* Sample before the last tick */
+	unsigned long long ts[MS5611_RESAMPLE_HISTORY];
+	int pressure[MS5611_RESAMPLE_HISTORY];
+	int temperature[MS5611_RESAMPLE_HISTORY];
+};
+
+void ms5611_resample_init(struct ms5611_resampler *, int, unsigned long long,
+		unsigned long long);
+size_t ms5611_resample_push(struct ms5611_resampler *,
+		const struct ms5611_sample *, size_t);
+size_t ms5611_resample(struct ms5611_resampler *, const unsigned long long *,
+		size_t, struct ms5611_resampled *);
+
+/*
+ * Fixed rate reads of a device on absolute deadlines, see scheduler.c,
+ * optionally on a pinned SCHED_FIFO thread with locked memory. The
+ * callback gets every sample and stops the loop by returning non-zero.
+ *  */
+#define MS5611_SCHED_HIST		24	/* log2 us buckets, up to 8 s */
+
+struct ms5611_sched_config {
+	unsigned int period_usec;	/* 0 as fast as the OSRs allow */
+	int timerfd;			/* Wait in a timerfd, else clock_nanosleep() */
+	int priority;			/* SCHED_FIFO priority, 0 keeps the policy */
+	int cpu;			/* CPU to pin to, -1 any */
+	int lock_memory;		/* mlockall() */
+};
+
+struct ms5611_sched_stats {
+	unsigned long long period_ns;		/* After the OSR minimum */
+	unsigned long long samples;
+	unsigned long long errors;		/* Failed reads */
+	unsigned long long misses;		/* Periods without a sample */
+	unsigned long long overruns;		/* Reads past their period */
+	unsigned long long wake_max_ns;
+	unsigned long long jitter_max_ns;
+	double jitter_rms_ns;
+	unsigned long long wake_hist[MS5611_SCHED_HIST];	/* Wake-up latency */
+	unsigned long long jitter_hist[MS5611_SCHED_HIST];	/* Period error */
+};
+
+struct ms5611_sched;
+
+typedef int (*ms5611_sched_cb)(void *, const struct ms5611_sample *);
+
+struct ms5611_sched *ms5611_sched_create(struct ms5611_dev *,
+		const struct ms5611_sched_config *);
+void ms5611_sched_destroy(struct ms5611_sched *);
+int ms5611_sched_run(struct ms5611_sched *, ms5611_sched_cb, void *);
+int ms5611_sched_start(struct ms5611_sched *, ms5611_sched_cb, void *);
+void ms5611_sched_stop(struct ms5611_sched *);
+int ms5611_sched_join(struct ms5611_sched *);
+void ms5611_sched_stats(struct ms5611_sched *, struct ms5611_sched_stats *);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif	/* _SENSOR_MS5611_H */
@@ -0,0 +1,401 @@
+#ifndef _SENSOR_MS5611_HPP
+#define _SENSOR_MS5611_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "ms5611.h"
+
+/*
+ * C++17 layer over ms5611.h, header only.
+ *
+ * The oversampling rates are template parameters, so the command bytes
+ * and conversion times of a sensor<> are constants of its read(). The
+ * PROM check and the compensation are constexpr and give the same bits
+ * as ms5611_prom_crc4() and ms5611_compensate(), see bench_cpp.cpp, which
+ * also times this layer against the C calls. Pressures and temperatures
+ * are distinct types, timestamps are std::chrono::steady_clock, which is
+ * CLOCK_MONOTONIC like ms5611_now_ns().
+ *  */
+namespace ms5611 {
+
+using prom = std::array<uint16_t, 8>;
+using clock = std::chrono::steady_clock;
+
+/* An integer in a unit, only comparable and addable within that unit */
+template <class Unit>
+class quantity {
+public:
+	constexpr quantity() : value_(0) {}
+	constexpr explicit quantity(int32_t value) : value_(value) {}
+	constexpr int32_t count() const { return value_; }
+
+	constexpr quantity operator+(quantity q) const
+	{
+		return quantity(value_ + q.value_);
+	}
+	constexpr quantity operator-(quantity q) const
+	{
+		return quantity(value_ - q.value_);
+	}
+	constexpr bool operator==(quantity q) const { return value_ == q.value_; }
+	constexpr bool operator!=(quantity q) const { return value_ != q.value_; }
+	constexpr bool operator<(quantity q) const { return value_ < q.value_; }
+	constexpr bool operator>(quantity q) const { return value_ > q.value_; }
+
+private:
+	int32_t value_;
+};
+
+struct pascal_unit {};
+struct centi_celsius_unit {};
+
+using pascal = quantity<pascal_unit>;			/* Pa, 0.01 mbar */
+using centi_celsius = quantity<centi_celsius_unit>;	/* 0.01 degC */
+
+constexpr double to_mbar(pascal p) { return p.count() / 100.0; }
+constexpr double to_celsius(centi_celsius t) { return t.count() / 100.0; }
+
+namespace detail {
+
+/* Same rows as osr_table in ms5611.c and the driver's OSR arrays */
+struct osr_row {
+	unsigned int rate;
+	unsigned int conv_usec;
+	unsigned int noise;
+};
+
+constexpr osr_row osr_rows[] = {
+	{ 256,  600,  65 },
+	{ 512,  1170, 42 },
+	{ 1024, 2280, 27 },
+	{ 2048, 4540, 18 },
+	{ 4096, 9040, 12 },
+};
+
+constexpr int osr_index(unsigned int rate)
+{
+	for (unsigned int i = 0; i < sizeof(osr_rows) / sizeof(osr_rows[0]); i++)
+		if (osr_rows[i].rate == rate)
+			return i;
+	return -1;
+}
+
+} /* namespace detail */
+
+/* Settings of oversampling rate @Rate, a compile error if not supported */
+template <unsigned int Rate>
+struct osr {
+	static_assert(detail::osr_index(Rate) >= 0,
+			"OSR must be 256, 512, 1024, 2048 or 4096");
+
+	static constexpr unsigned int index = detail::osr_index(Rate);
+	static constexpr unsigned int rate = Rate;
+	static constexpr uint8_t pressure_cmd = 0x40 + 2 * index;
+	static constexpr uint8_t temp_cmd = 0x50 + 2 * index;
+	static constexpr std::chrono::microseconds conv_time{
+		detail::osr_rows[index].conv_usec };
+	static constexpr unsigned int noise = detail::osr_rows[index].noise;
+};
+
+/* Like ms5611_prom_crc4() */
+constexpr uint16_t prom_crc4(const prom &words)
+{
+	uint16_t crc = 0, word = 0;
+
+	for (int i = 0; i < 16; i++) {
+		word = i < 14 ? words[i >> 1] : words[7] & 0xFF00;
+		crc ^= (i % 2 == 1) ? word & 0x00FF : word >> 8;
+
+		for (int j = 0; j < 8; j++) {
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x3000;
+			else
+				crc <<= 1;
+		}
+	}
+
+	return (crc >> 12) & 0x000F;
+}
+
+/* Like ms5611_prom_is_valid() */
+constexpr bool prom_is_valid(const prom &words)
+{
+	return (words[7] & 0x000F) != 0 &&
+		(words[7] & 0x000F) == prom_crc4(words);
+}
+
+constexpr ms5611_calibration calibration_from_prom(const prom &words)
+{
+	return { words[1], words[2], words[3], words[4], words[5], words[6] };
+}
+
+struct measurement {
+	pascal pressure;
+	centi_celsius temperature;
+};
+
+/* Like ms5611_compensate(), bit for bit */
+constexpr measurement compensate(const ms5611_calibration &cali, uint32_t d1,
+		uint32_t d2)
+{
+	int64_t dt = d2 - ((int64_t)cali.c5 << 8);
+	int64_t off = ((int64_t)cali.c2 << 16) + ((cali.c4 * dt) >> 7);
+	int64_t sens = ((int64_t)cali.c1 << 15) + ((cali.c3 * dt) >> 8);
+	int64_t t = 2000 + ((cali.c6 * dt) >> 23);
+
+	if (t < 2000) {
+		int64_t t2 = (dt * dt) >> 31;
+		int64_t off2 = (5 * (t - 2000) * (t - 2000)) >> 1;
+		int64_t sens2 = off2 >> 1;
+
+		if (t < -1500) {
+			int64_t tmp = (t + 1500) * (t + 1500);
+			off2 += 7 * tmp;
+			sens2 += (11 * tmp) >> 1;
+		}
+
+		t -= t2;
+		off -= off2;
+		sens -= sens2;
+	}
+
+	return { pascal((int32_t)(((((int64_t)d1 * sens) >> 21) - off) >> 15)),
+		centi_celsius((int32_t)t) };
+}
+
+struct sample {
+	clock::time_point timestamp;		/* Middle of the D1 conversion */
+	std::chrono::microseconds temp_age;	/* Age of the temperature */
+	uint32_t raw_pressure;
+	uint32_t raw_temperature;
+	pascal pressure;
+	centi_celsius temperature;
+};
+
+inline sample from_c(const ms5611_sample &s)
+{
+	return { clock::time_point(std::chrono::nanoseconds(s.timestamp_ns)),
+		std::chrono::microseconds(s.temp_age_usec), s.raw_pressure,
+		s.raw_temperature, pascal(s.pressure),
+		centi_celsius(s.temperature) };
+}
+
+/*
+ * Any backend of ms5611_open() at fixed oversampling rates. Not usable,
+ * false, if the device did not open or can not set the rates.
+ *  */
+template <unsigned int PressureOsr = 4096, unsigned int TempOsr = PressureOsr>
+class device {
+public:
+	using pressure_osr = osr<PressureOsr>;
+	using temp_osr = osr<TempOsr>;
+
+	static constexpr auto sample_time = pressure_osr::conv_time +
+		temp_osr::conv_time;
+
+	explicit device(const char *spec = nullptr) : dev_(ms5611_open(spec))
+	{
+		if (dev_ && ms5611_dev_set_oversampling(dev_, PressureOsr,
+					TempOsr) < 0) {
+			ms5611_close(dev_);
+			dev_ = nullptr;
+		}
+	}
+
+	device(device &&d) : dev_(std::exchange(d.dev_, nullptr)) {}
+	device &operator=(device &&d)
+	{
+		std::swap(dev_, d.dev_);
+		return *this;
+	}
+	device(const device &) = delete;
+	device &operator=(const device &) = delete;
+	~device() { ms5611_close(dev_); }
+
+	explicit operator bool() const { return dev_ != nullptr; }
+
+	const ms5611_calibration &calibration() const
+	{
+		return *ms5611_dev_calibration(dev_);
+	}
+
+	std::optional<sample> read()
+	{
+		ms5611_sample s;
+
+		if (ms5611_dev_read(dev_, &s) < 0)
+			return std::nullopt;
+		return from_c(s);
+	}
+
+	/* The C handle, for the rest of ms5611.h */
+	ms5611_dev *get() { return dev_; }
+
+private:
+	ms5611_dev *dev_;
+};
+
+/*
+ * /dev/i2c-N, what sensor<> needs from a bus: the whole PROM, a command,
+ * an ADC read that also starts the next conversion if @next is not 0, and
+ * waiting for a conversion. Like i2cdev.c each is one I2C_RDWR ioctl.
+ *  */
+class i2c_bus {
+public:
+	explicit i2c_bus(unsigned int bus = 1, uint16_t addr = 0x77) : addr_(addr)
+	{
+		char path[32];
+
+		snprintf(path, sizeof(path), "/dev/i2c-%u", bus);
+		fd_ = open(path, O_RDWR | O_CLOEXEC);
+	}
+
+	i2c_bus(i2c_bus &&b) : fd_(std::exchange(b.fd_, -1)), addr_(b.addr_) {}
+	i2c_bus(const i2c_bus &) = delete;
+	i2c_bus &operator=(const i2c_bus &) = delete;
+	~i2c_bus()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+	explicit operator bool() const { return fd_ >= 0; }
+
+	int command(uint8_t cmd)
+	{
+		i2c_msg msg = { addr_, 0, 1, &cmd };
+
+		return transfer(&msg, 1);
+	}
+
+	int read_adc(uint32_t &data, uint8_t next)
+	{
+		uint8_t cmd = 0x00, buf[3];
+		i2c_msg msgs[3] = {
+			{ addr_, 0, 1, &cmd },
+			{ addr_, I2C_M_RD, 3, buf },
+			{ addr_, 0, 1, &next },
+		};
+
+		if (transfer(msgs, next ? 3 : 2) < 0)
+			return -1;
+
+		data = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+		return 0;
+	}
+
+	int read_prom(prom &words)
+	{
+		uint8_t cmd[8], buf[8][2];
+		i2c_msg msgs[16];
+
+		for (int i = 0; i < 8; i++) {
+			cmd[i] = 0xA0 + i * 2;
+			msgs[i * 2] = { addr_, 0, 1, &cmd[i] };
+			msgs[i * 2 + 1] = { addr_, I2C_M_RD, 2, buf[i] };
+		}
+
+		if (transfer(msgs, 16) < 0)
+			return -1;
+
+		for (int i = 0; i < 8; i++)
+			words[i] = (buf[i][0] << 8) | buf[i][1];
+		return 0;
+	}
+
+	void wait(std::chrono::microseconds usec)
+	{
+		std::this_thread::sleep_for(usec);
+	}
+
+private:
+	int transfer(i2c_msg *msgs, int n)
+	{
+		i2c_rdwr_ioctl_data xfer = { msgs, (uint32_t)n };
+
+		return ioctl(fd_, I2C_RDWR, &xfer) == n ? 0 : -1;
+	}
+
+	int fd_;
+	uint16_t addr_;
+};
+
+/*
+ * The sensor on a bus like i2c_bus, read at compile time oversampling
+ * rates: one command, two waits and two ADC reads per sample, the second
+ * conversion started by the first read.
+ *  */
+template <class Bus, unsigned int PressureOsr = 4096,
+	unsigned int TempOsr = PressureOsr>
+class sensor {
+public:
+	using pressure_osr = osr<PressureOsr>;
+	using temp_osr = osr<TempOsr>;
+
+	static constexpr auto sample_time = pressure_osr::conv_time +
+		temp_osr::conv_time;
+
+	explicit sensor(Bus bus) : bus_(std::move(bus)), cali_{}, valid_(false)
+	{
+		prom words{};
+
+		/* Same as ms5611_init_client() in the driver */
+		if (bus_.command(0x1E) < 0)
+			return;
+		bus_.wait(std::chrono::microseconds(3000));
+
+		if (bus_.read_prom(words) < 0 || !prom_is_valid(words))
+			return;
+
+		cali_ = calibration_from_prom(words);
+		valid_ = true;
+	}
+
+	explicit operator bool() const { return valid_; }
+
+	const ms5611_calibration &calibration() const { return cali_; }
+
+	std::optional<sample> read()
+	{
+		sample s{};
+
+		if (bus_.command(pressure_osr::pressure_cmd) < 0)
+			return std::nullopt;
+		s.timestamp = clock::now() + pressure_osr::conv_time / 2;
+		bus_.wait(pressure_osr::conv_time);
+
+		if (bus_.read_adc(s.raw_pressure, temp_osr::temp_cmd) < 0)
+			return std::nullopt;
+		bus_.wait(temp_osr::conv_time);
+
+		if (bus_.read_adc(s.raw_temperature, 0) < 0)
+			return std::nullopt;
+
+		measurement m = compensate(cali_, s.raw_pressure,
+				s.raw_temperature);
+		s.pressure = m.pressure;
+		s.temperature = m.temperature;
+		return s;
+	}
+
+	Bus &bus() { return bus_; }
+
+private:
+	Bus bus_;
+	ms5611_calibration cali_;
+	bool valid_;
+};
+
+} /* namespace ms5611 */
+
+#endif	/* _SENSOR_MS5611_HPP */
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include "ms5611.h"
+#include "daemon.h"
+
+/*
+ * Usage: ms5611d [-b spec] [-o pres:temp] [-r hz] [-s socket] [-n slots]
+ *
+ * Owns the device, see ms5611.h for the spec, reads it at 'hz' samples per
+ * second, or back to back without -r, and shares the samples with any
+ * number of local clients, see daemon.h for the protocol and client.c for
+ * the client side. Every sample is read from the device once however many
+ * clients there are. SIGUSR1 prints the clients, SIGINT and SIGTERM stop.
+ *  */
+#define DEFAULT_SLOTS			4096
+
+struct client {
+	int fd;
+	unsigned int decimation;	/* 0 until SUBSCRIBE */
+	unsigned long long next;	/* Next sample to notify */
+	unsigned long long sent;
+	unsigned long long skipped;	/* Socket full */
+};
+
+static volatile sig_atomic_t stop, dump;
+
+static void on_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		dump = 1;
+	else
+		stop = 1;
+}
+
+static struct ms5611d_ring *ring_create(int *fd, unsigned int slots,
+		unsigned int period_usec, const unsigned short *prom)
+{
+	size_t len = sizeof(struct ms5611d_ring) +
+		slots * sizeof(struct ms5611d_slot);
+	struct ms5611d_ring *ring;
+
+	*fd = memfd_create("ms5611d", MFD_CLOEXEC);
+	if (*fd < 0 || ftruncate(*fd, len) < 0) {
+		printf("Error: Create the ring\n");
+		return NULL;
+	}
+
+	ring = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+	if (ring == MAP_FAILED) {
+		printf("Error: Map the ring\n");
+		return NULL;
+	}
+
+	ring->size = slots;
+	ring->period_usec = period_usec;
+	memcpy(ring->prom, prom, sizeof(ring->prom));
+	ring->version = MS5611D_RING_VERSION;
+	__atomic_store_n(&ring->magic, MS5611D_RING_MAGIC, __ATOMIC_RELEASE);
+	return ring;
+}
+
+static void ring_publish(struct ms5611d_ring *ring,
+		const struct ms5611_sample *sample)
+{
+	unsigned long long n = ring->head;
+	struct ms5611d_slot *slot = &ring->slots[n & (ring->size - 1)];
+
+	__atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->timestamp_ns = sample->timestamp_ns;
+	slot->raw_pressure = sample->raw_pressure;
+	slot->raw_temperature = sample->raw_temperature;
+	slot->pressure = sample->pressure;
+	slot->temperature = sample->temperature;
+	slot->temp_age_usec = sample->temp_age_usec;
+	__atomic_store_n(&slot->seq, n + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, n + 1, __ATOMIC_RELEASE);
+}
+
+static int listen_socket(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Error: Socket path %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(fd, 16) < 0) {
+		printf("Error: Listen on %s\n", path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* HELLO with the ring attached */
+static int send_hello(int fd, int ring_fd)
+{
+	struct ms5611d_msg msg = { .type = MS5611D_HELLO };
+	char control[CMSG_SPACE(sizeof(int))];
+	struct iovec iov = { &msg, sizeof(msg) };
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = sizeof(control),
+	};
+	struct cmsghdr *cmsg;
+
+	memset(control, 0, sizeof(control));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &ring_fd, sizeof(int));
+
+	return sendmsg(fd, &mh, MSG_NOSIGNAL) == sizeof(msg) ? 0 : -1;
+}
+
+static void print_clients(const struct client *clients, int n,
+		unsigned long long head)
+{
+	int i;
+
+	printf("%llu samples, %d clients\n", head, n);
+	for (i = 0; i < n; i++)
+		printf("  fd %d: 1/%u, %llu sent, %llu skipped\n",
+				clients[i].fd, clients[i].decimation,
+				clients[i].sent, clients[i].skipped);
+	fflush(stdout);
+}
+
+/* Tell the subscribed clients whose turn it is about sample @n */
+static void notify(struct client *clients, int n_clients,
+		unsigned long long n)
+{
+	struct ms5611d_msg msg = { .type = MS5611D_SAMPLE, .seq = n };
+	struct client *c;
+	int i;
+
+	for (i = 0; i < n_clients; i++) {
+		c = &clients[i];
+		if (!c->decimation || n < c->next)
+			continue;
+
+		c->next = n + c->decimation;
+		if (send(c->fd, &msg, sizeof(msg),
+					MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+			c->skipped++;
+		else
+			c->sent++;
+	}
+}
+
+/* Returning -1 if the client is gone */
+static int client_request(struct client *c, unsigned long long head)
+{
+	struct ms5611d_msg msg;
+	ssize_t len;
+
+	len = recv(c->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return 0;
+	if (len != sizeof(msg))
+		return -1;
+
+	if (msg.type == MS5611D_SUBSCRIBE) {
+		c->decimation = msg.arg ? msg.arg : 1;
+		c->next = head;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *spec = NULL, *path = MS5611D_SOCKET;
+	unsigned int pres_osr = 0, temp_osr = 0, slots = DEFAULT_SLOTS;
+	double rate = 0;
+	struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+	struct client *clients = NULL, *c;
+	struct ms5611_sample sample;
+	struct ms5611d_ring *ring;
+	struct pollfd *pfds = NULL;
+	struct ms5611_dev *dev;
+	int listen_fd, timer_fd = -1, ring_fd, opt, fd, i, n;
+	int n_clients = 0, alloc = 0, ret = 0;
+	unsigned long long ticks, missed = 0, period_nsec = 0;
+
+	while ((opt = getopt(argc, argv, "b:o:r:s:n:")) != -1) {
+		switch (opt) {
+		case 'b':
+			spec = optarg;
+			break;
+		case 'o':
+			if (sscanf(optarg, "%u:%u", &pres_osr, &temp_osr) != 2) {
+				printf("Error: OSR %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 'n':
+			slots = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	if (!slots || (slots & (slots - 1))) {
+		printf("Error: Slots must be a power of two\n");
+		return 1;
+	}
+
+	dev = ms5611_open(spec);
+	if (!dev)
+		return 1;
+	if (pres_osr && ms5611_dev_set_oversampling(dev, pres_osr,
+				temp_osr) < 0) {
+		printf("Error: Set oversampling %u:%u\n", pres_osr, temp_osr);
+		return 1;
+	}
+
+	if (rate > 0) {
+		period_nsec = 1e9 / rate;
+		its.it_interval.tv_sec = period_nsec / 1000000000;
+		its.it_interval.tv_nsec = period_nsec % 1000000000;
+		its.it_value = its.it_interval;
+		timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &its,
+					NULL) < 0) {
+			printf("Error: Timer\n");
+			return 1;
+		}
+	}
+
+	ring = ring_create(&ring_fd, slots, period_nsec / 1000,
+			ms5611_dev_prom(dev));
+	if (!ring)
+		return 1;
+
+	listen_fd = listen_socket(path);
+	if (listen_fd < 0)
+		return 1;
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGUSR1, on_signal);
+
+	while (!stop) {
+		if (alloc < n_clients + 2) {
+			alloc = (n_clients + 2) * 2;
+			pfds = realloc(pfds, alloc * sizeof(*pfds));
+			if (!pfds) {
+				ret = 1;
+				break;
+			}
+		}
+
+		pfds[0] = (struct pollfd){ listen_fd, POLLIN, 0 };
+		pfds[1] = (struct pollfd){ timer_fd, POLLIN, 0 };
+		for (i = 0; i < n_clients; i++)
+			pfds[i + 2] = (struct pollfd){ clients[i].fd, POLLIN, 0 };
+
+		n = poll(pfds, n_clients + 2, timer_fd < 0 ? 0 : -1);
+		if (dump) {
+			dump = 0;
+			print_clients(clients, n_clients, ring->head);
+			if (missed)
+				printf("  %llu periods missed\n", missed);
+		}
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = 1;
+			break;
+		}
+
+		/* Requests before the sample, a new SUBSCRIBE gets it */
+		for (i = 0; i < n_clients; i++) {
+			if (!pfds[i + 2].revents ||
+					client_request(&clients[i],
+						ring->head) == 0)
+				continue;
+
+			close(clients[i].fd);
+			clients[i] = clients[--n_clients];
+			pfds[i + 2] = pfds[n_clients + 2];
+			i--;
+		}
+
+		if (pfds[0].revents) {
+			fd = accept4(listen_fd, NULL, NULL,
+					SOCK_CLOEXEC | SOCK_NONBLOCK);
+			if (fd >= 0 && send_hello(fd, ring_fd) < 0) {
+				close(fd);
+				fd = -1;
+			}
+			if (fd >= 0) {
+				c = realloc(clients, (n_clients + 1) *
+						sizeof(*clients));
+				if (!c) {
+					close(fd);
+				} else {
+					clients = c;
+					clients[n_clients++] = (struct client){
+						.fd = fd };
+				}
+			}
+		}
+
+		if (timer_fd >= 0) {
+			if (!pfds[1].revents || read(timer_fd, &ticks,
+						sizeof(ticks)) != sizeof(ticks))
+				continue;
+			missed += ticks - 1;
+		}
+
+		if (ms5611_dev_read(dev, &sample) < 0) {
+			printf("Error: Read sample %llu\n",
+					(unsigned long long)ring->head);
+			if (timer_fd < 0)
+				usleep(10000);
+			continue;
+		}
+		ring_publish(ring, &sample);
+		notify(clients, n_clients, ring->head - 1);
+	}
+
+	print_clients(clients, n_clients, ring->head);
+	for (i = 0; i < n_clients; i++)
+		close(clients[i].fd);
+	close(listen_fd);
+	unlink(path);
+	ms5611_close(dev);
+	free(clients);
+	free(pfds);
+	return ret;
+}
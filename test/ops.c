@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -13,7 +14,7 @@ char *get_path(const char *base, const char *name)
 	if (name == NULL)
 		return NULL;
 
-	char *pathname = malloc(sizeof(char) * (strlen(base)+strlen(name)+1));
+	char *pathname = malloc(sizeof(char) * (strlen(base)+strlen(name)+2));
 	if (pathname == NULL) {
 		printf("ERROR: Get pathname!\n");
 		return NULL;
@@ -46,28 +47,37 @@ int write_ops(const char *pathname, unsigned short data)
 	return 0;
 }
 
+/* On failure *buf is freed and set to NULL */
 int read_block_ops(const char *pathname, char **buf)
 {
+	ssize_t len;
 	int fd;
 	*buf = (char *)malloc(sizeof(char) * BUF_MAX);
 
 	if (*buf) {
-		fd = open(pathname, O_RDWR);
+		fd = open(pathname, O_RDONLY);
 		if (fd < 0) {
 			printf("Error: Open %s fail!\n", pathname);
-			return -EIO;
+			goto fail;
 		}
 
-		if (read(fd, *buf, BUF_MAX) < 0) {
+		len = read(fd, *buf, BUF_MAX - 1);
+		close(fd);
+		if (len < 0) {
 			printf("Error: Read %s fail!\n", pathname);
-			return -EIO;
+			goto fail;
 		}
 
-		close(fd);
+		(*buf)[len] = '\0';
 		return 0;
 	}
 
 	return -ENOMEM;
+
+fail:
+	free(*buf);
+	*buf = NULL;
+	return -EIO;
 }
 
 int read_ops(const char *pathname, unsigned short *data)
@@ -75,13 +85,13 @@ int read_ops(const char *pathname, unsigned short *data)
 	char buf[BUF_MAX] = "";
 	int fd;
 
-	fd = open(pathname, O_RDWR);
+	fd = open(pathname, O_RDONLY);
 	if (fd < 0) {
 		printf("ERROR: Open %s fail!\n", pathname);
 		return -EIO;
 	}
 
-	if (read(fd, buf, sizeof(buf)) < 0) {
+	if (read(fd, buf, sizeof(buf) - 1) < 0) {
 		printf("ERROR: Read %s fail!\n", pathname);
 		close(fd);
 		return -1;
@@ -97,14 +107,14 @@ int read_ops(const char *pathname, unsigned short *data)
 int write_data(const char *base, const char *name, unsigned short data)
 {
 	char *pathname = get_path(base, name);
+	int ret = -1;
 
 	if (pathname) {
-		if (write_ops(pathname, data) < 0)
-			return -1;
+		ret = write_ops(pathname, data);
+		free(pathname);
 	}
 
-	free(pathname);
-	return 0;
+	return ret;
 }
 
 /* int get_ops(const char *base, const char *name, unsigned short *data)
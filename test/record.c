@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "ms5611.h"
+
+/*
+ * Usage: record [-b spec] [-o pres:temp] [-n samples] [-d seconds]
+ *               [-B block_samples] file
+ *
+ * Reads samples through a device handle, see ms5611.h for the spec, and
+ * writes them to a capture file until 'samples' were read, 'seconds'
+ * passed or SIGINT/SIGTERM, whichever comes first. Without -n and -d it
+ * runs until a signal. The capture is closed properly on a signal, so its
+ * index is written.
+ *  */
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *spec = NULL;
+	unsigned int pres_osr = 0, temp_osr = 0, block = 0;
+	unsigned long long count = 0, n = 0, end = 0;
+	struct ms5611_capture *cap;
+	struct ms5611_sample sample;
+	struct ms5611_dev *dev;
+	double seconds = 0;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "b:o:n:d:B:")) != -1) {
+		switch (opt) {
+		case 'b':
+			spec = optarg;
+			break;
+		case 'o':
+			if (sscanf(optarg, "%u:%u", &pres_osr, &temp_osr) != 2) {
+				printf("Error: OSR %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			seconds = atof(optarg);
+			break;
+		case 'B':
+			block = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		printf("Usage: record [-b spec] [-o pres:temp] [-n samples] "
+				"[-d seconds] [-B block_samples] file\n");
+		return 1;
+	}
+
+	dev = ms5611_open(spec);
+	if (!dev)
+		return 1;
+
+	if (pres_osr && ms5611_dev_set_oversampling(dev, pres_osr,
+				temp_osr) < 0) {
+		printf("Error: Set oversampling %u:%u\n", pres_osr, temp_osr);
+		ms5611_close(dev);
+		return 1;
+	}
+
+	cap = ms5611_capture_create(argv[optind], ms5611_dev_prom(dev),
+			pres_osr, temp_osr, block);
+	if (!cap) {
+		ms5611_close(dev);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (seconds > 0)
+		end = ms5611_now_ns() + (unsigned long long)(seconds * 1e9);
+
+	while (!stop && (!count || n < count) &&
+			(!end || ms5611_now_ns() < end)) {
+		if (ms5611_dev_read(dev, &sample) < 0) {
+			printf("Error: Read sample %llu\n", n);
+			ret = 1;
+			break;
+		}
+		if (ms5611_capture_write(cap, &sample) < 0) {
+			printf("Error: Write %s\n", argv[optind]);
+			ret = 1;
+			break;
+		}
+		n++;
+	}
+
+	if (ms5611_capture_close(cap) < 0) {
+		printf("Error: Close %s\n", argv[optind]);
+		ret = 1;
+	}
+	ms5611_close(dev);
+
+	printf("%llu samples\n", n);
+	return ret;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ms5611.h"
+
+/*
+ * Usage: replay [-i] [-w] [-s seconds] [-e seconds] [-n samples] file
+ *
+ * Prints the samples of a capture file, one per line:
+ *   timestamp_ns D1 D2 pressure temperature
+ * with pressure in 0.01 mbar and temperature in 0.01 degC. -s and -e are
+ * seconds from the clock base of the capture, -s seeks there without
+ * decoding what comes before. -w prints CLOCK_REALTIME timestamps instead
+ * of CLOCK_MONOTONIC ones. -i prints the header and the size per sample
+ * instead of the samples.
+ *  */
+static void print_info(const char *path, const struct ms5611_capture_info *info)
+{
+	struct stat st;
+	int i;
+
+	printf("samples        %llu\n", info->samples);
+	printf("block_samples  %u\n", info->block_samples);
+	printf("oversampling   %u:%u\n", info->pressure_osr, info->temp_osr);
+	printf("clock base     %llu ns monotonic, %llu ns realtime\n",
+			info->mono_ns, info->real_ns);
+	printf("prom          ");
+	for (i = 0; i < 8; i++)
+		printf(" %u", info->prom[i]);
+	printf("\n");
+
+	if (stat(path, &st) == 0 && info->samples)
+		printf("size           %lld bytes, %.2f bytes/sample\n",
+				(long long)st.st_size,
+				(double)st.st_size / info->samples);
+}
+
+int main(int argc, char *argv[])
+{
+	double from = -1, to = -1;
+	unsigned long long count = 0, n = 0, offset = 0;
+	const struct ms5611_capture_info *info;
+	struct ms5611_sample sample;
+	struct ms5611_replay *rp;
+	int opt, info_only = 0, ret = 0;
+
+	while ((opt = getopt(argc, argv, "iws:e:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			info_only = 1;
+			break;
+		case 'w':
+			offset = 1;
+			break;
+		case 's':
+			from = atof(optarg);
+			break;
+		case 'e':
+			to = atof(optarg);
+			break;
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1) {
+		printf("Usage: replay [-i] [-w] [-s seconds] [-e seconds] "
+				"[-n samples] file\n");
+		return 1;
+	}
+
+	rp = ms5611_replay_open(argv[optind]);
+	if (!rp)
+		return 1;
+	info = ms5611_replay_info(rp);
+
+	if (info_only) {
+		print_info(argv[optind], info);
+		ms5611_replay_close(rp);
+		return 0;
+	}
+
+	if (offset)
+		offset = info->real_ns - info->mono_ns;
+
+	if (from >= 0 && ms5611_replay_seek(rp, info->mono_ns +
+				(unsigned long long)(from * 1e9)) < 0) {
+		printf("Error: Seek to %.3f s\n", from);
+		ms5611_replay_close(rp);
+		return 1;
+	}
+
+	while ((!count || n < count) && (ret = ms5611_replay_read(rp,
+					&sample)) > 0) {
+		if (to >= 0 && sample.timestamp_ns >= info->mono_ns +
+				(unsigned long long)(to * 1e9))
+			break;
+		printf("%llu %u %u %d %d\n", sample.timestamp_ns + offset,
+				sample.raw_pressure, sample.raw_temperature,
+				sample.pressure, sample.temperature);
+		n++;
+	}
+
+	ms5611_replay_close(rp);
+	if (ret < 0) {
+		printf("Error: Damaged block after %llu samples\n", n);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include "ms5611.h"
+
+/*
+ * Resampling of the sample stream onto the ticks of another sensor.
+ *
+ * Samples are dated at the middle of their D1 conversion, see struct
+ * ms5611_record, so between two of them pressure and temperature are
+ * interpolated linearly at each tick. The last MS5611_RESAMPLE_HISTORY
+ * samples are kept, ticks in ascending order cost a step or two of the
+ * cursor each, ticks further back walk the history.
+ *
+ * A tick after the latest sample has nothing to interpolate against: it
+ * is extrapolated from the last two samples if it is at most
+ * 'max_ahead_ns' past the latest one, otherwise ms5611_resample() stops
+ * there and the caller passes it again once more samples were pushed.
+ * Interpolating adds up to one sample period of delay, extrapolating
+ * none but follows the noise. Across a gap wider than 'max_gap_ns', such
+ * as dropped samples, the nearest sample is held rather than bridged.
+ *  */
+#define RS_SLOT(i)	((unsigned int)(i) & (MS5611_RESAMPLE_HISTORY - 1))
+
+/*
+ * Resample the CLOCK_MONOTONIC timestamps of the samples, or with
+ * @boottime their CLOCK_BOOTTIME ones. Zero @max_gap_ns bridges any gap,
+ * zero @max_ahead_ns never extrapolates.
+ *  */
+void ms5611_resample_init(struct ms5611_resampler *rs, int boottime,
+		unsigned long long max_gap_ns, unsigned long long max_ahead_ns)
+{
+	rs->boottime = boottime;
+	rs->max_gap_ns = max_gap_ns;
+	rs->max_ahead_ns = max_ahead_ns;
+	rs->count = 0;
+	rs->cursor = 0;
+}
+
+/*
+ * Append @n samples. A sample not newer than the latest one is dropped,
+ * returning how many were taken.
+ *  */
+size_t ms5611_resample_push(struct ms5611_resampler *rs,
+		const struct ms5611_sample *samples, size_t n)
+{
+	unsigned long long ts;
+	size_t i, taken = 0;
+	unsigned int slot;
+
+	for (i = 0; i < n; i++) {
+		ts = rs->boottime ? samples[i].boottime_ns :
+			samples[i].timestamp_ns;
+		if (rs->count && ts <= rs->ts[RS_SLOT(rs->count - 1)])
+			continue;
+
+		slot = RS_SLOT(rs->count);
+		rs->ts[slot] = ts;
+		rs->pressure[slot] = samples[i].pressure;
+		rs->temperature[slot] = samples[i].temperature;
+		rs->count++;
+		taken++;
+	}
+
+	return taken;
+}
+
+/* Sample @i, moved by @frac of the way to sample @i + 1 */
+static void rs_point(const struct ms5611_resampler *rs, unsigned long long i,
+		double frac, struct ms5611_resampled *out)
+{
+	unsigned int a = RS_SLOT(i), b = RS_SLOT(i + 1);
+
+	out->pressure = rs->pressure[a];
+	out->temperature = rs->temperature[a];
+	if (frac == 0)
+		return;
+
+	out->pressure += (rs->pressure[b] - rs->pressure[a]) * frac;
+	out->temperature += (rs->temperature[b] - rs->temperature[a]) * frac;
+}
+
+/* Whether samples @i and @i + 1 are too far apart to interpolate */
+static int rs_gap(const struct ms5611_resampler *rs, unsigned long long i)
+{
+	return rs->max_gap_ns && rs->ts[RS_SLOT(i + 1)] -
+		rs->ts[RS_SLOT(i)] > rs->max_gap_ns;
+}
+
+/*
+ * Resample at the @n @ticks, on the clock given to ms5611_resample_init(),
+ * into @out. Returning how many ticks were done, fewer than @n if a tick
+ * is too far past the latest sample; the rest are for a later call.
+ *  */
+size_t ms5611_resample(struct ms5611_resampler *rs,
+		const unsigned long long *ticks, size_t n,
+		struct ms5611_resampled *out)
+{
+	unsigned long long first, last, i, t0, t1;
+	size_t k;
+
+	if (!rs->count)
+		return 0;
+
+	last = rs->count - 1;
+	first = rs->count > MS5611_RESAMPLE_HISTORY ?
+		rs->count - MS5611_RESAMPLE_HISTORY : 0;
+	i = rs->cursor < first ? first : rs->cursor;
+
+	for (k = 0; k < n; k++) {
+		out[k].timestamp_ns = ticks[k];
+		out[k].flags = 0;
+
+		if (ticks[k] > rs->ts[RS_SLOT(last)]) {
+			if (ticks[k] - rs->ts[RS_SLOT(last)] >
+					rs->max_ahead_ns)
+				break;
+
+			out[k].flags = MS5611_RESAMPLE_EXTRAPOLATED;
+			if (last == first || rs_gap(rs, last - 1)) {
+				out[k].flags |= MS5611_RESAMPLE_HELD;
+				rs_point(rs, last, 0, &out[k]);
+				continue;
+			}
+
+			t0 = rs->ts[RS_SLOT(last - 1)];
+			t1 = rs->ts[RS_SLOT(last)];
+			rs_point(rs, last - 1, (double)(ticks[k] - t0) /
+					(t1 - t0), &out[k]);
+			continue;
+		}
+
+		if (ticks[k] < rs->ts[RS_SLOT(first)]) {
+			out[k].flags = MS5611_RESAMPLE_HELD;
+			rs_point(rs, first, 0, &out[k]);
+			i = first;
+			continue;
+		}
+
+		/* ts[i] <= tick, and tick < ts[i + 1] unless i is the last */
+		while (i < last && rs->ts[RS_SLOT(i + 1)] <= ticks[k])
+			i++;
+		while (rs->ts[RS_SLOT(i)] > ticks[k])
+			i--;
+
+		t0 = rs->ts[RS_SLOT(i)];
+		if (i == last || t0 == ticks[k]) {
+			rs_point(rs, i, 0, &out[k]);
+		} else if (rs_gap(rs, i)) {
+			t1 = rs->ts[RS_SLOT(i + 1)];
+			out[k].flags = MS5611_RESAMPLE_HELD;
+			rs_point(rs, ticks[k] - t0 <= t1 - ticks[k] ? i :
+					i + 1, 0, &out[k]);
+		} else {
+			t1 = rs->ts[RS_SLOT(i + 1)];
+			rs_point(rs, i, (double)(ticks[k] - t0) / (t1 - t0),
+					&out[k]);
+		}
+	}
+
+	rs->cursor = i;
+	return k;
+}
@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include "backend.h"
+
+/*
+ * Fixed rate acquisition.
+ *
+ * Period n starts at start + n * period, an absolute CLOCK_MONOTONIC
+ * deadline, so the time spent in the read and the callback does not add
+ * up the way a relative sleep after each read does. The loop sleeps to
+ * the deadline in clock_nanosleep(TIMER_ABSTIME), or in a read() of a
+ * timerfd armed with the same start and period, then reads one sample and
+ * hands it to the callback.
+ *
+ * The period is at least the conversion times of the OSRs of the device
+ * plus SCHED_BUS_USEC for the transfers and the wake-up, a shorter one is
+ * raised to that. A sample that ends after the start of the next period is
+ * an overrun. Periods whose deadline passed while the previous one ran
+ * are missed: they get no sample, the loop goes on with the latest
+ * deadline and the stream stays on its grid.
+ *
+ * Every wake-up adds its latency, now minus the deadline, and the error of
+ * the interval since the previous wake-up, the period jitter, to log2
+ * microsecond histograms. The statistics are written under a sequence
+ * count, so another thread takes a consistent copy without ever blocking
+ * the loop.
+ *  */
+#define SCHED_BUS_USEC			500
+#define SCHED_STACK_PREFAULT		(64 * 1024)
+
+struct ms5611_sched {
+	struct ms5611_dev *dev;
+	struct ms5611_sched_config cfg;
+	unsigned long long period_ns;
+	int timer_fd;			/* -1 with clock_nanosleep() */
+	volatile int stop;
+	unsigned int seq;		/* Odd while 'stats' is written */
+	struct ms5611_sched_stats stats;
+	double jitter_sq;		/* Sum of squared jitter, ns^2 */
+	unsigned long long jitter_n;
+
+	/* ms5611_sched_start() */
+	pthread_t thread;
+	int started;
+	ms5611_sched_cb cb;
+	void *arg;
+	int ret;
+};
+
+/*
+ * Pace reads of @dev at @cfg, see struct ms5611_sched_config. The device
+ * has to stay open while the scheduler exists. Returning NULL on failure.
+ *  */
+struct ms5611_sched *ms5611_sched_create(struct ms5611_dev *dev,
+		const struct ms5611_sched_config *cfg)
+{
+	struct ms5611_sched *s;
+	unsigned long long min_ns;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->dev = dev;
+	s->cfg = *cfg;
+	s->timer_fd = -1;
+
+	min_ns = (dev->pressure_osr->conv_usec + dev->temp_osr->conv_usec +
+			SCHED_BUS_USEC) * 1000ULL;
+	s->period_ns = cfg->period_usec * 1000ULL;
+	if (s->period_ns < min_ns)
+		s->period_ns = min_ns;
+	s->stats.period_ns = s->period_ns;
+
+	if (cfg->timerfd) {
+		s->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if (s->timer_fd < 0) {
+			printf("Error: Create timerfd\n");
+			free(s);
+			return NULL;
+		}
+	}
+
+	return s;
+}
+
+void ms5611_sched_destroy(struct ms5611_sched *s)
+{
+	if (!s)
+		return;
+
+	if (s->started)
+		ms5611_sched_join(s);
+	if (s->timer_fd >= 0)
+		close(s->timer_fd);
+	free(s);
+}
+
+/* Touch the stack the loop will use, so it does not fault once locked */
+static void __attribute__((noinline)) sched_prefault(void)
+{
+	volatile char stack[SCHED_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+/* Pin, lock and raise the calling thread as @cfg asks */
+static int sched_setup(const struct ms5611_sched_config *cfg)
+{
+	struct sched_param param = { .sched_priority = cfg->priority };
+	cpu_set_t cpus;
+
+	if (cfg->cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cfg->cpu, &cpus);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpus),
+					&cpus)) {
+			printf("Error: Pin to CPU %d\n", cfg->cpu);
+			return -1;
+		}
+	}
+
+	if (cfg->lock_memory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			printf("Error: Lock memory\n");
+			return -1;
+		}
+		sched_prefault();
+	}
+
+	if (cfg->priority > 0 && pthread_setschedparam(pthread_self(),
+				SCHED_FIFO, &param)) {
+		printf("Error: SCHED_FIFO priority %d\n", cfg->priority);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void ns_to_timespec(unsigned long long ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/* log2 microsecond bucket of @ns */
+static void sched_hist_add(unsigned long long *hist, unsigned long long ns)
+{
+	unsigned long long usec = ns / 1000;
+	int i = usec ? 63 - __builtin_clzll(usec) : 0;
+
+	hist[i < MS5611_SCHED_HIST ? i : MS5611_SCHED_HIST - 1]++;
+}
+
+/*
+ * Sleep to period *@n, or with a timerfd to its latest expiry. Periods
+ * already over are skipped and *@n moved past them. Returning the
+ * deadline slept to, 0 on failure.
+ *  */
+static unsigned long long sched_wait(struct ms5611_sched *s,
+		unsigned long long start, unsigned long long *n,
+		unsigned long long *missed)
+{
+	unsigned long long deadline, now, ticks;
+	struct timespec ts;
+	int err;
+
+	if (s->timer_fd >= 0) {
+		while (read(s->timer_fd, &ticks, sizeof(ticks)) !=
+				sizeof(ticks))
+			if (errno != EINTR || s->stop)
+				return 0;
+		*missed = ticks - 1;
+		*n += ticks - 1;
+		return start + *n * s->period_ns;
+	}
+
+	*missed = 0;
+	deadline = start + *n * s->period_ns;
+	now = ms5611_now_ns();
+	if (now >= deadline + s->period_ns) {
+		*missed = (now - deadline) / s->period_ns;
+		*n += *missed;
+		deadline += *missed * s->period_ns;
+	}
+
+	ns_to_timespec(deadline, &ts);
+	while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+					NULL)) != 0)
+		if (err != EINTR || s->stop)
+			return 0;
+
+	return deadline;
+}
+
+/*
+ * Run the loop in the calling thread until ms5611_sched_stop() or until
+ * @cb returns non-zero. A failed read counts as an error and the period
+ * goes by without a sample. Returning -1 if the thread could not be set
+ * up or the wait failed, else 0.
+ *  */
+int ms5611_sched_run(struct ms5611_sched *s, ms5611_sched_cb cb, void *arg)
+{
+	struct ms5611_sched_stats *st = &s->stats;
+	unsigned long long start, deadline, woke, end, missed, n = 0, prev = 0;
+	long long jitter;
+	struct ms5611_sample sample;
+	struct itimerspec its;
+	int ret, stop = 0;
+
+	if (sched_setup(&s->cfg) < 0)
+		return -1;
+
+	start = ms5611_now_ns() + s->period_ns;
+	if (s->timer_fd >= 0) {
+		ns_to_timespec(start, &its.it_value);
+		ns_to_timespec(s->period_ns, &its.it_interval);
+		if (timerfd_settime(s->timer_fd, TFD_TIMER_ABSTIME, &its,
+					NULL) < 0) {
+			printf("Error: Arm timerfd\n");
+			return -1;
+		}
+	}
+
+	while (!s->stop && !stop) {
+		deadline = sched_wait(s, start, &n, &missed);
+		if (!deadline)
+			return s->stop ? 0 : -1;
+		woke = ms5611_now_ns();
+
+		ret = ms5611_dev_read(s->dev, &sample);
+		end = ms5611_now_ns();
+
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		st->misses += missed;
+		if (ret < 0)
+			st->errors++;
+		else
+			st->samples++;
+		if (end > deadline + s->period_ns)
+			st->overruns++;
+
+		sched_hist_add(st->wake_hist, woke - deadline);
+		if (woke - deadline > st->wake_max_ns)
+			st->wake_max_ns = woke - deadline;
+
+		/* The interval is only one period without misses */
+		if (prev && !missed) {
+			jitter = (long long)(woke - prev - s->period_ns);
+			if (jitter < 0)
+				jitter = -jitter;
+			sched_hist_add(st->jitter_hist, jitter);
+			if ((unsigned long long)jitter > st->jitter_max_ns)
+				st->jitter_max_ns = jitter;
+			s->jitter_sq += (double)jitter * jitter;
+			s->jitter_n++;
+		}
+		prev = woke;
+		__atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+
+		if (ret == 0)
+			stop = cb(arg, &sample);
+		n++;
+	}
+
+	return 0;
+}
+
+/*
+ * A consistent copy of the statistics, also while the loop runs in
+ * another thread.
+ *  */
+void ms5611_sched_stats(struct ms5611_sched *s,
+		struct ms5611_sched_stats *stats)
+{
+	unsigned int before, after;
+	double sq;
+	unsigned long long n;
+
+	do {
+		before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		memcpy(stats, &s->stats, sizeof(*stats));
+		sq = s->jitter_sq;
+		n = s->jitter_n;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+
+	stats->jitter_rms_ns = n ? sqrt(sq / n) : 0;
+}
+
+/* Make the loop return after the current period, safe in a signal handler */
+void ms5611_sched_stop(struct ms5611_sched *s)
+{
+	s->stop = 1;
+}
+
+static void *sched_thread(void *arg)
+{
+	struct ms5611_sched *s = arg;
+
+	s->ret = ms5611_sched_run(s, s->cb, s->arg);
+	return NULL;
+}
+
+/*
+ * Run the loop in a thread of its own, with the priority, CPU and memory
+ * locking of the configuration. Returning -1 if it could not be started.
+ *  */
+int ms5611_sched_start(struct ms5611_sched *s, ms5611_sched_cb cb, void *arg)
+{
+	if (s->started)
+		return -1;
+
+	s->cb = cb;
+	s->arg = arg;
+	s->stop = 0;
+	if (pthread_create(&s->thread, NULL, sched_thread, s)) {
+		printf("Error: Start scheduler thread\n");
+		return -1;
+	}
+
+	s->started = 1;
+	return 0;
+}
+
+/*
+ * Stop the thread of ms5611_sched_start() and wait for it, which takes up
+ * to a period. Returning what its loop returned.
+ *  */
+int ms5611_sched_join(struct ms5611_sched *s)
+{
+	if (!s->started)
+		return -1;
+
+	ms5611_sched_stop(s);
+	pthread_join(s->thread, NULL);
+	s->started = 0;
+	return s->ret;
+}
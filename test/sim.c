@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "backend.h"
+
+/*
+ * In-process MS5611 simulator.
+ *
+ * The PROM holds the calibration of the datasheet example with a valid
+ * CRC4. Samples follow a pressure and temperature trajectory plus gaussian
+ * noise at the datasheet RMS level of the oversampling rate, and are turned
+ * into D1/D2 by inverting the compensation. Every conversion advances a
+ * virtual clock by its conversion time; with 'realtime=1' it also sleeps
+ * that long, like the real sensor would make a driver wait.
+ *
+ * Options of the "sim:" spec, comma separated:
+ *   p=<Pa>		pressure at time zero, default 100000
+ *   dp=<Pa/s>		pressure slope, default 0
+ *   amp=<Pa>		amplitude of a sine on the pressure, default 0
+ *   period=<s>		period of that sine, default 10
+ *   t=<0.01 degC>	temperature at time zero, default 2000
+ *   dt=<0.01 degC/s>	temperature slope, default 0
+ *   noise=<scale>	multiple of the datasheet noise, default 1
+ *   seed=<n>		noise seed, default 1
+ *   realtime=<0|1>	sleep through conversions, default 0
+ *  */
+struct sim {
+	unsigned short prom[8];
+	const struct ms5611_osr_info *pressure_osr;
+	const struct ms5611_osr_info *temp_osr;
+	double p0, dp, amp, period;
+	double t0, dt;
+	double noise;
+	unsigned long long seed;
+	int realtime;
+	unsigned long long now_ns;	/* Virtual time since open */
+	unsigned long long start_ns;	/* CLOCK_MONOTONIC at open */
+};
+
+/* xorshift64*, deterministic for a given seed */
+static double sim_uniform(struct sim *sim)
+{
+	sim->seed ^= sim->seed >> 12;
+	sim->seed ^= sim->seed << 25;
+	sim->seed ^= sim->seed >> 27;
+	return ((sim->seed * 2685821657736338717ULL) >> 11) *
+		(1.0 / 9007199254740992.0);
+}
+
+static double sim_gauss(struct sim *sim)
+{
+	double u = sim_uniform(sim), v = sim_uniform(sim);
+
+	if (u < 1e-300)
+		u = 1e-300;
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/*
+ * Raw values the sensor would report for pressure @p in 0.01 mbar and
+ * temperature @t in 0.01 degC. Inverts ms5611_compensate(), including the
+ * second order terms, which are evaluated at the target temperature.
+ *  */
+static void sim_inverse(const struct ms5611_calibration *c, double p,
+		double t, unsigned int *d1, unsigned int *d2)
+{
+	double dt, off, sens, t1 = t, off2 = 0, sens2 = 0;
+	int i;
+
+	/* TEMP = 2000 + dT * C6 / 2^23 - T2 with T2 = dT^2 / 2^31 */
+	for (i = 0; i < 8; i++) {
+		dt = (t1 - 2000) * 8388608.0 / c->c6;
+		t1 = t < 2000 ? t + dt * dt / 2147483648.0 : t;
+	}
+	dt = (t1 - 2000) * 8388608.0 / c->c6;
+
+	off = c->c2 * 65536.0 + c->c4 * dt / 128.0;
+	sens = c->c1 * 32768.0 + c->c3 * dt / 256.0;
+	if (t1 < 2000) {
+		off2 = 5 * (t1 - 2000) * (t1 - 2000) / 2;
+		sens2 = off2 / 2;
+		if (t1 < -1500) {
+			off2 += 7 * (t1 + 1500) * (t1 + 1500);
+			sens2 += 11 * (t1 + 1500) * (t1 + 1500) / 2;
+		}
+	}
+	off -= off2;
+	sens -= sens2;
+
+	*d2 = (unsigned int)fmin(fmax(c->c5 * 256.0 + dt + 0.5, 0), 0xFFFFFF);
+	*d1 = (unsigned int)fmin(fmax((p * 32768.0 + off) * 2097152.0 / sens +
+				0.5, 0), 0xFFFFFF);
+}
+
+/* One conversion of @osr, advancing the clock by its conversion time */
+static void sim_convert(struct sim *sim, const struct ms5611_osr_info *osr)
+{
+	struct timespec ts;
+
+	sim->now_ns += osr->conv_usec * 1000ULL;
+	if (!sim->realtime)
+		return;
+
+	ts.tv_sec = osr->conv_usec / 1000000;
+	ts.tv_nsec = (osr->conv_usec % 1000000) * 1000L;
+	nanosleep(&ts, NULL);
+}
+
+static int sim_parse(struct sim *sim, const char *arg)
+{
+	char *opts, *opt, *save = NULL, *val;
+
+	if (!arg)
+		return 0;
+
+	opts = strdup(arg);
+	if (!opts)
+		return -1;
+
+	for (opt = strtok_r(opts, ",", &save); opt;
+			opt = strtok_r(NULL, ",", &save)) {
+		val = strchr(opt, '=');
+		if (!val) {
+			printf("Error: Simulator option %s\n", opt);
+			free(opts);
+			return -1;
+		}
+		*val++ = '\0';
+
+		if (!strcmp(opt, "p"))
+			sim->p0 = atof(val);
+		else if (!strcmp(opt, "dp"))
+			sim->dp = atof(val);
+		else if (!strcmp(opt, "amp"))
+			sim->amp = atof(val);
+		else if (!strcmp(opt, "period"))
+			sim->period = atof(val);
+		else if (!strcmp(opt, "t"))
+			sim->t0 = atof(val);
+		else if (!strcmp(opt, "dt"))
+			sim->dt = atof(val);
+		else if (!strcmp(opt, "noise"))
+			sim->noise = atof(val);
+		else if (!strcmp(opt, "seed"))
+			sim->seed = strtoull(val, NULL, 0);
+		else if (!strcmp(opt, "realtime"))
+			sim->realtime = atoi(val);
+		else {
+			printf("Error: Simulator option %s\n", opt);
+			free(opts);
+			return -1;
+		}
+	}
+
+	free(opts);
+	return 0;
+}
+
+static int sim_open(struct ms5611_dev *dev, const char *arg)
+{
+	static const unsigned short cali[8] = {
+		0, 40127, 36924, 23317, 23282, 33464, 28312, 0
+	};
+	struct sim *sim = calloc(1, sizeof(*sim));
+
+	if (!sim)
+		return -1;
+
+	sim->p0 = 100000;
+	sim->period = 10;
+	sim->t0 = 2000;
+	sim->noise = 1;
+	sim->seed = 1;
+	sim->pressure_osr = ms5611_osr_info(4096);
+	sim->temp_osr = ms5611_osr_info(4096);
+
+	if (sim_parse(sim, arg) < 0 || sim->period <= 0) {
+		free(sim);
+		return -1;
+	}
+	if (!sim->seed)
+		sim->seed = 1;
+
+	/* Factory word 0 is free, pick one that gives a non-zero CRC */
+	memcpy(sim->prom, cali, sizeof(sim->prom));
+	while ((sim->prom[7] = ms5611_prom_crc4(sim->prom)) == 0)
+		sim->prom[0]++;
+
+	sim->start_ns = ms5611_now_ns();
+	dev->priv = sim;
+	return 0;
+}
+
+static void sim_close(struct ms5611_dev *dev)
+{
+	free(dev->priv);
+}
+
+static int sim_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	struct sim *sim = dev->priv;
+
+	memcpy(prom, sim->prom, sizeof(sim->prom));
+	return ms5611_prom_is_valid(prom) ? 0 : -1;
+}
+
+/*
+ * D1 then D2, like the driver. The sample is the pressure at the middle of
+ * D1, which is also its timestamp.
+ *  */
+static int sim_read(struct ms5611_dev *dev, struct ms5611_sample *sample)
+{
+	struct sim *sim = dev->priv;
+	struct ms5611_calibration cali;
+	unsigned long long mid = sim->pressure_osr->conv_usec * 500ULL;
+	double secs = (sim->now_ns + mid) / 1e9, p, t;
+
+	ms5611_calibration_from_prom(&cali, sim->prom);
+
+	p = sim->p0 + sim->dp * secs +
+		sim->amp * sin(2.0 * M_PI * secs / sim->period);
+	p += sim_gauss(sim) * sim->noise * sim->pressure_osr->noise / 10.0;
+	t = sim->t0 + sim->dt * secs;
+
+	sample->timestamp_ns = (sim->realtime ? ms5611_now_ns() :
+		sim->start_ns + sim->now_ns) + mid;
+	sim_inverse(&cali, p, t, &sample->raw_pressure,
+			&sample->raw_temperature);
+
+	sim_convert(sim, sim->pressure_osr);
+	sim_convert(sim, sim->temp_osr);
+	return 0;
+}
+
+static int sim_set_oversampling(struct ms5611_dev *dev,
+		const struct ms5611_osr_info *pressure,
+		const struct ms5611_osr_info *temperature)
+{
+	struct sim *sim = dev->priv;
+
+	sim->pressure_osr = pressure;
+	sim->temp_osr = temperature;
+	return 0;
+}
+
+const struct ms5611_backend ms5611_sim_backend = {
+	.name			= "sim",
+	.open			= sim_open,
+	.close			= sim_close,
+	.read_prom		= sim_read_prom,
+	.read			= sim_read,
+	.set_oversampling	= sim_set_oversampling,
+};
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "backend.h"
+
+/*
+ * Userspace driver over /dev/spidevB.C, the SPI counterpart of i2cdev.c.
+ *
+ * Spec "spi[:<bus>.<cs>[:<hz>]]", default 0.0 at 20 MHz, the fastest the
+ * sensor takes. Chip select frames every command; the ADC read of D1 and
+ * the convert command of D2 are one SPI_IOC_MESSAGE with chip select
+ * toggled in between, so a sample costs three ioctls like over I2C but
+ * each takes a few microseconds instead of a few hundred.
+ *  */
+struct spidev {
+	int fd;
+	unsigned int hz;
+	const struct ms5611_osr_info *pressure_osr;
+	const struct ms5611_osr_info *temp_osr;
+};
+
+static void spidev_xfer(struct spi_ioc_transfer *t, const void *tx, void *rx,
+		unsigned int len, unsigned int hz)
+{
+	memset(t, 0, sizeof(*t));
+	t->tx_buf = (unsigned long)tx;
+	t->rx_buf = (unsigned long)rx;
+	t->len = len;
+	t->speed_hz = hz;
+	t->bits_per_word = 8;
+}
+
+static int spidev_transfer(struct spidev *spi, struct spi_ioc_transfer *t,
+		int n)
+{
+	if (ioctl(spi->fd, SPI_IOC_MESSAGE(n), t) < 0) {
+		printf("Error: SPI transfer\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int spidev_command(struct spidev *spi, unsigned char cmd)
+{
+	struct spi_ioc_transfer t;
+
+	spidev_xfer(&t, &cmd, NULL, 1, spi->hz);
+	return spidev_transfer(spi, &t, 1);
+}
+
+/*
+ * Send @cmd and read @len bytes in one chip select frame. If @next is not
+ * 0, chip select is released and @next sent in the same message.
+ *  */
+static int spidev_read(struct spidev *spi, unsigned char cmd,
+		unsigned char *buf, unsigned int len, unsigned char next)
+{
+	struct spi_ioc_transfer t[3];
+
+	spidev_xfer(&t[0], &cmd, NULL, 1, spi->hz);
+	spidev_xfer(&t[1], NULL, buf, len, spi->hz);
+	spidev_xfer(&t[2], &next, NULL, 1, spi->hz);
+	/* On the last transfer cs_change would keep chip select asserted */
+	t[1].cs_change = next != 0;
+
+	return spidev_transfer(spi, t, next ? 3 : 2);
+}
+
+static int spidev_read_adc(struct spidev *spi, unsigned int *data,
+		unsigned char next)
+{
+	unsigned char buf[3];
+
+	if (spidev_read(spi, CMD_ADC_READ, buf, 3, next) < 0)
+		return -1;
+
+	*data = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+	return 0;
+}
+
+static int spidev_open(struct ms5611_dev *dev, const char *arg)
+{
+	unsigned int bus = 0, cs = 0, hz = 20000000;
+	unsigned char mode = SPI_MODE_0, bits = 8;
+	char path[32];
+	struct spidev *spi;
+
+	if (arg && sscanf(arg, "%u.%u:%u", &bus, &cs, &hz) < 2) {
+		printf("Error: SPI spec %s\n", arg);
+		return -1;
+	}
+
+	spi = calloc(1, sizeof(*spi));
+	if (!spi)
+		return -1;
+
+	snprintf(path, sizeof(path), "/dev/spidev%u.%u", bus, cs);
+	spi->fd = open(path, O_RDWR);
+	if (spi->fd < 0) {
+		printf("Error: Open %s\n", path);
+		free(spi);
+		return -1;
+	}
+
+	if (ioctl(spi->fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+			ioctl(spi->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+			ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &hz) < 0) {
+		printf("Error: Set up %s\n", path);
+		close(spi->fd);
+		free(spi);
+		return -1;
+	}
+
+	spi->hz = hz;
+	spi->pressure_osr = ms5611_osr_info(4096);
+	spi->temp_osr = ms5611_osr_info(4096);
+	dev->priv = spi;
+
+	if (spidev_command(spi, CMD_RST) < 0) {
+		close(spi->fd);
+		free(spi);
+		return -1;
+	}
+	ms5611_sleep_usec(3000);
+
+	return 0;
+}
+
+static void spidev_close(struct ms5611_dev *dev)
+{
+	struct spidev *spi = dev->priv;
+
+	close(spi->fd);
+	free(spi);
+}
+
+static int spidev_read_prom(struct ms5611_dev *dev, unsigned short *prom)
+{
+	struct spidev *spi = dev->priv;
+	unsigned char buf[2];
+	int i;
+
+	for (i = 0; i < CALI_DATA_LEN; i++) {
+		if (spidev_read(spi, CALI_DATA_START + i * 2, buf, 2, 0) < 0)
+			return -1;
+		prom[i] = (buf[0] << 8) | buf[1];
+	}
+
+	if (!ms5611_prom_is_valid(prom)) {
+		printf("PROM integrity check failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int spidev_read_sample(struct ms5611_dev *dev,
+		struct ms5611_sample *sample)
+{
+	struct spidev *spi = dev->priv;
+
+	if (spidev_command(spi, spi->pressure_osr->pressure_cmd) < 0)
+		return -1;
+	sample->timestamp_ns = ms5611_now_ns() +
+		spi->pressure_osr->conv_usec * 500ULL;
+	ms5611_sleep_usec(spi->pressure_osr->conv_usec);
+
+	if (spidev_read_adc(spi, &sample->raw_pressure,
+				spi->temp_osr->temp_cmd) < 0)
+		return -1;
+	ms5611_sleep_usec(spi->temp_osr->conv_usec);
+
+	return spidev_read_adc(spi, &sample->raw_temperature, 0);
+}
+
+static int spidev_set_oversampling(struct ms5611_dev *dev,
+		const struct ms5611_osr_info *pressure,
+		const struct ms5611_osr_info *temperature)
+{
+	struct spidev *spi = dev->priv;
+
+	spi->pressure_osr = pressure;
+	spi->temp_osr = temperature;
+	return 0;
+}
+
+const struct ms5611_backend ms5611_spidev_backend = {
+	.name			= "spi",
+	.open			= spidev_open,
+	.close			= spidev_close,
+	.read_prom		= spidev_read_prom,
+	.read			= spidev_read_sample,
+	.set_oversampling	= spidev_set_oversampling,
+};